@@ -0,0 +1,229 @@
+/*
+    Copyright 2018 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ Micro-benchmark of the number parser and formatter in zynqshell.c
+ against the libc calls they replaced (atoi, atof, sscanf("%x"),
+ snprintf("%f")). Prints values/second for both.
+
+ It also checks that fmt_float output reads back as the same float,
+ and is never longer than the shortest "%.<n>g" that does, for every
+ float in a sweep over all exponents, and that every fp16, q15 and
+ q7 element reads back as itself.
+
+   ./bench_numconv [values]
+ */
+
+#define main zynqshell_main
+#include "../zynqshell.c"
+#undef main
+
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static volatile u32 sink;
+
+static void report(const char *what, int count, double t_old, double t_new) {
+  printf("%-22s %12.0f %12.0f %8.1fx\n", what,
+         count / t_old, count / t_new, t_old / t_new);
+}
+
+/* Text for count values of type, one per entry */
+static char **make_text(int count, int type) {
+  char **text = malloc(count * sizeof(char *));
+  int i;
+
+  for (i = 0; i < count; i++) {
+    char buf[32];
+    u32 r = (u32)rand() * 2654435761u;
+    switch (type) {
+    case INT_TYPE:   snprintf(buf, sizeof(buf), "%d", (s32)r); break;
+    case UINT_TYPE:  snprintf(buf, sizeof(buf), "0x%x", r); break;
+    default:         snprintf(buf, sizeof(buf), "%f",
+                              (double)(s32)r / (1 + (r & 0xFFFF))); break;
+    }
+    text[i] = strdup(buf);
+  }
+  return text;
+}
+
+static void bench_parse(int count) {
+  char **text;
+  double t0, t1, t2;
+  int i;
+
+  text = make_text(count, INT_TYPE);
+  t0 = now();
+  for (i = 0; i < count; i++) sink += atoi(text[i]);
+  t1 = now();
+  for (i = 0; i < count; i++) {
+    s32 v;
+    parse_arg(text[i], INT_TYPE, &v);
+    sink += v;
+  }
+  t2 = now();
+  report("parse int (atoi)", count, t1 - t0, t2 - t1);
+
+  text = make_text(count, UINT_TYPE);
+  t0 = now();
+  for (i = 0; i < count; i++) {
+    unsigned int v;
+    sscanf(text[i], "%x", &v);
+    sink += v;
+  }
+  t1 = now();
+  for (i = 0; i < count; i++) {
+    u32 v;
+    parse_arg(text[i], UINT_TYPE, &v);
+    sink += v;
+  }
+  t2 = now();
+  report("parse hex (sscanf)", count, t1 - t0, t2 - t1);
+
+  text = make_text(count, FLOAT_TYPE);
+  t0 = now();
+  for (i = 0; i < count; i++) sink += (u32)(float)atof(text[i]);
+  t1 = now();
+  for (i = 0; i < count; i++) {
+    float v;
+    parse_arg(text[i], FLOAT_TYPE, &v);
+    sink += (u32)v;
+  }
+  t2 = now();
+  report("parse float (atof)", count, t1 - t0, t2 - t1);
+}
+
+static void bench_format(int count) {
+  float *f = malloc(count * sizeof(float));
+  s32 *v = malloc(count * sizeof(s32));
+  char buf[64];
+  double t0, t1, t2;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    u32 r = (u32)rand() * 2654435761u;
+    v[i] = (s32)r;
+    f[i] = (float)(s32)r / (1 + (r & 0xFFFF));
+  }
+
+  t0 = now();
+  for (i = 0; i < count; i++) sink += snprintf(buf, sizeof(buf), "%d", v[i]);
+  t1 = now();
+  for (i = 0; i < count; i++) sink += fmt_int(buf, v[i]);
+  t2 = now();
+  report("format int (%d)", count, t1 - t0, t2 - t1);
+
+  t0 = now();
+  for (i = 0; i < count; i++) sink += snprintf(buf, sizeof(buf), "%f", f[i]);
+  t1 = now();
+  for (i = 0; i < count; i++) sink += fmt_float(buf, f[i]);
+  t2 = now();
+  report("format float (%f)", count, t1 - t0, t2 - t1);
+}
+
+/* Length of the shortest %.<n>g that reads back as f */
+static int shortest_g(float f) {
+  char buf[64];
+  int p;
+  for (p = 1; p < 9; p++) {
+    snprintf(buf, sizeof(buf), "%.*g", p, f);
+    if (strtof(buf, NULL) == f) break;
+  }
+  return p;
+}
+
+/* Significant digits in a fmt_float result */
+static int sig_digits(const char *s) {
+  int n = 0, zeros = 0, lead = 1;
+
+  for (; *s && *s != 'e'; s++) {
+    if (*s < '0' || *s > '9') continue;
+    if (lead && *s == '0') continue;
+    lead = 0;
+    n++;
+    zeros = *s == '0' ? zeros + 1 : 0;
+  }
+  return n - zeros; /* "100.0" has one */
+}
+
+static int check_roundtrip(void) {
+  u32 bits;
+  int bad = 0, longer = 0, checked = 0;
+
+  /* Every 257th bit pattern hits all exponents and many mantissas */
+  for (bits = 0; bits < 0x7F800000; bits += 257) {
+    float f, g;
+    char buf[64];
+    const char *p = buf;
+
+    memcpy(&f, &bits, sizeof(f));
+    fmt_float(buf, f);
+    if (parse_value(&p, FLOAT_TYPE, &g) != PARSE_OK || g != f) {
+      if (bad++ < 5) printf("  %08x: %s does not read back\n", bits, buf);
+    }
+    if (checked++ % 16 == 0 && sig_digits(buf) > shortest_g(f)) {
+      if (longer++ < 5) printf("  %08x: %s is not the shortest\n", bits, buf);
+    }
+  }
+  printf("round trip: %d floats, %d do not read back, %d not shortest\n",
+         checked, bad, longer);
+  return bad == 0 && longer == 0;
+}
+
+/* Every bit pattern of the 16 and 8 bit types that print as numbers */
+static int check_narrow(void) {
+  static const int narrow[] = { FP16_TYPE, Q15_TYPE, Q7_TYPE };
+  int i, bad = 0, checked = 0;
+  u32 v;
+
+  for (i = 0; i < 3; i++) {
+    int t = narrow[i];
+    for (v = 0; v < (1U << (types[t].size * 8)); v++) {
+      u16 in = v, out = 0;
+      char buf[64];
+      const char *p = buf;
+
+      if (t == FP16_TYPE && (v & 0x7C00) == 0x7C00) continue; /* inf, nan */
+      fmt_value(buf, t, &in, 0);
+      if (parse_value(&p, t, &out) != PARSE_OK ||
+          memcmp(&in, &out, types[t].size) != 0) {
+        if (bad++ < 5) printf("  %s %04x: %s does not read back\n",
+                              types[t].name, v, buf);
+      }
+      checked++;
+    }
+  }
+  printf("round trip: %d narrow values, %d do not read back\n", checked, bad);
+  return bad == 0;
+}
+
+int main(int argc, char **argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 200000;
+  int ok;
+
+  printf("%-22s %12s %12s %9s\n", "values/s", "libc", "zynqshell", "speedup");
+  bench_parse(count);
+  bench_format(count);
+  ok = check_roundtrip();
+  ok &= check_narrow();
+  return ok ? 0 : 1;
+}
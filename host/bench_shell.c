@@ -0,0 +1,329 @@
+/*
+    Copyright 2018 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ Throughput of whole shell commands, without the serial line:
+
+  - loadArray: values/s and text MB/s for each element type. The
+    text is put straight into the RX ring, as the UART interrupt
+    would, so what is measured is inputline and the parser.
+  - dumpArray raw, hex and base64: array bytes/s. Output is thrown
+    away at outbyte (as bench does), so this is the formatting and
+    the calls into outbyte.
+  - checksum crc32 and xxh64 against a plain bytewise CRC-32.
+  - LZ4 pack and unpack MB/s (of unpacked bytes) and ratio, for data
+    like a bitstream (mostly zeros, some repeats) and for random data
+    that does not pack. Both are checked to unpack to what they were.
+  - dispatch: ns per command line (variables, tokenize, lookup,
+    statistics, uart_flush) on top of the command itself.
+
+ The line itself (115200 baud is 11.5 KB/s) is far slower than any of
+ these; the numbers show how much headroom the shell leaves and catch
+ regressions in it. Loaded values and checksums are also checked.
+
+   ./bench_shell [values]
+ */
+
+#define main zynqshell_main
+#include "../zynqshell.c"
+#undef main
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#define MIN_TIME 0.2 /* seconds per measurement */
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Run a command line through dispatch, as main does */
+static int run(const char *line) {
+  static char buf[512], exp[512];
+  static char *toks[20];
+  char **tokens = toks;
+  int n;
+
+  strncpy(buf, line, sizeof(buf) - 1);
+  if (!expand_vars(buf, exp, sizeof(exp))) return FAILURE;
+  n = tokenize(exp, &tokens);
+  return dispatch(n, tokens);
+}
+
+/* Hand text to inbyte as if it had arrived on the UART */
+static void feed(const char *text, u32 len) {
+  u32 i;
+
+  if (len > RX_RING_SIZE - (rx_head - rx_tail)) {
+    fprintf(stderr, "bench_shell: %u bytes do not fit the RX ring\n", len);
+    exit(1);
+  }
+  for (i = 0; i < len; i++) rx_ring[(rx_head + i) & (RX_RING_SIZE - 1)] = text[i];
+  rx_head += len;
+}
+
+/* Text for count elements of type, 16 to a line, and the values */
+static u32 make_values(int type, int count, char *text, u32 size, u8 *data) {
+  u32 len = 0;
+  int i, esize = types[type].size;
+
+  for (i = 0; i < count; i++) {
+    u32 r = (u32)rand() * 2654435761u;
+    char v[MAX_VALUE_LEN];
+    const char *p = v;
+    double d = (double)(s32)r / (1 + (r & 0xFFFF));
+
+    switch (types[type].kind) {
+    case TK_INT:   store_int(data + i * esize, esize, (s32)r >> (32 - esize * 8)); break;
+    case TK_UINT:  store_int(data + i * esize, esize, r >> (32 - esize * 8)); break;
+    case TK_FIXED: store_int(data + i * esize, esize, (s32)r >> (32 - esize * 8)); break;
+    default:
+      if (type == FP16_TYPE) d /= 1024;
+      if (type == FP16_TYPE) *(u16 *)(data + i * esize) = double_to_half(d);
+      else if (type == FLOAT_TYPE) *(float *)(data + i * esize) = (float)d;
+      else *(double *)(data + i * esize) = d;
+      break;
+    }
+    /* The shortest text that reads back, as dumps and show print it */
+    fmt_value(v, type, data + i * esize, 0);
+    if (parse_value(&p, type, data + i * esize) != PARSE_OK) return 0;
+    len += snprintf(text + len, size - len, "%s%s", v,
+                    i % 16 == 15 || i == count - 1 ? "\n" : " ");
+  }
+  return len;
+}
+
+static int bench_load(int count) {
+  static const int load_types[] = { BYTE_TYPE, INT_TYPE, UINT_TYPE,
+                                    FLOAT_TYPE, INT16_TYPE, FP16_TYPE,
+                                    Q15_TYPE, Q16_TYPE, DOUBLE_TYPE };
+  char *text = malloc(RX_RING_SIZE);
+  u8 *data = malloc(count * 8);
+  char cmd[64];
+  int i, ok = 1;
+
+  printf("%-22s %12s %12s\n", "loadArray", "values/s", "text MB/s");
+  for (i = 0; i < (int)(sizeof(load_types) / sizeof(int)); i++) {
+    int type = load_types[i];
+    u32 len = make_values(type, count, text, RX_RING_SIZE, data);
+    double t0, t;
+    u32 runs = 0;
+    array *a;
+
+    if (len == 0 || len >= RX_RING_SIZE) {
+      printf("%-22s values do not fit the RX ring, use fewer\n", types[type].name);
+      return 0;
+    }
+    snprintf(cmd, sizeof(cmd), "loadArray %s %d bench", types[type].name, count);
+    t0 = now();
+    do {
+      feed(text, len);
+      if (!run(cmd)) ok = 0;
+      runs++;
+    } while ((t = now() - t0) < MIN_TIME);
+
+    a = getArray("bench");
+    if (!a || memcmp(a->data, data, count * types[type].size) != 0) {
+      printf("  %s: loaded values differ\n", types[type].name);
+      ok = 0;
+    }
+    printf("%-22s %12.0f %12.2f\n", types[type].name,
+           runs * count / t, runs * len / t / 1e6);
+    run("rmArray bench");
+  }
+  free(text);
+  free(data);
+  return ok;
+}
+
+static void bench_dump(u32 bytes) {
+  static const char *formats[] = { "raw", "hex", "base64" };
+  char cmd[64];
+  array *a;
+  u32 i;
+
+  snprintf(cmd, sizeof(cmd), "mkArray byte %u bench", bytes);
+  run(cmd);
+  a = getArray("bench");
+  for (i = 0; i < bytes; i++) a->data[i] = rand();
+
+  printf("%-22s %12s\n", "dumpArray", "MB/s");
+  for (i = 0; i < 3; i++) {
+    double t0, t;
+    u32 runs = 0;
+
+    snprintf(cmd, sizeof(cmd), "dumpArray bench %s", formats[i]);
+    t0 = now();
+    do {
+      run(cmd);
+      runs++;
+    } while ((t = now() - t0) < MIN_TIME);
+    printf("%-22s %12.1f\n", formats[i], (double)runs * bytes / t / 1e6);
+  }
+  run("rmArray bench");
+}
+
+static u32 crc32_bytewise(const u8 *p, u32 len) {
+  u32 crc = ~0U;
+  while (len--) crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static volatile u64 sink;
+
+static int bench_checksum(u32 bytes) {
+  u8 *data = malloc(bytes + 3);
+  double t0, t;
+  u32 runs, i, off;
+  int alg, ok = 1;
+
+  for (i = 0; i < bytes + 3; i++) data[i] = rand();
+  /* Any alignment gives the same CRC */
+  for (off = 0; off < 4; off++) {
+    if (crc32_update(0, data + off, bytes - off) !=
+        crc32_bytewise(data + off, bytes - off)) {
+      printf("  crc32 differs from the bytewise CRC at offset %u\n", off);
+      ok = 0;
+    }
+  }
+
+  printf("%-22s %12s\n", "checksum", "MB/s");
+  runs = 0;
+  t0 = now();
+  do {
+    sink += crc32_bytewise(data, bytes);
+    runs++;
+  } while ((t = now() - t0) < MIN_TIME);
+  printf("%-22s %12.1f\n", "crc32 bytewise", (double)runs * bytes / t / 1e6);
+
+  for (alg = 0; alg < NUM_SUMS; alg++) {
+    runs = 0;
+    t0 = now();
+    do {
+      sink += checksum(alg, data, bytes);
+      runs++;
+    } while ((t = now() - t0) < MIN_TIME);
+    printf("%-22s %12.1f\n", sum_str[alg], (double)runs * bytes / t / 1e6);
+  }
+  free(data);
+  return ok;
+}
+
+/* Mostly zeros, with stretches of a short repeat and some noise */
+static void make_bitstream(u8 *p, u32 bytes) {
+  u32 i, j;
+
+  memset(p, 0, bytes);
+  for (i = 0; i < bytes; i += 4096) {
+    u32 r = rand() % 10, end = i + 4096 < bytes ? i + 4096 : bytes;
+    if (r < 2) for (j = i; j < end; j++) p[j] = rand();
+    else if (r < 5) for (j = i; j < end; j++) p[j] = (j % 7) * 37;
+  }
+}
+
+static int bench_lz4(u32 bytes) {
+  u8 *data = malloc(bytes), *packed = malloc(LZ4_FRAME_BOUND(bytes));
+  u8 *out = malloc(bytes);
+  static const char *names[] = { "bitstream-like", "random" };
+  lz4_frame f;
+  double t0, t1, t2;
+  u32 runs, len = 0, i, k;
+  int ok = 1, n = 0;
+
+  printf("%-22s %12s %12s %8s\n", "lz4", "pack MB/s", "unpack MB/s", "ratio");
+  for (k = 0; k < 2; k++) {
+    if (k == 0) make_bitstream(data, bytes);
+    else for (i = 0; i < bytes; i++) data[i] = rand();
+
+    runs = 0;
+    t0 = now();
+    do {
+      len = lz4_frame_encode(packed, data, bytes);
+      runs++;
+    } while ((t1 = now() - t0) < MIN_TIME);
+    t1 /= runs;
+
+    runs = 0;
+    t0 = now();
+    do {
+      memset(&f, 0, sizeof(f));
+      n = lz4_frame_header(&f, packed, len);
+      f.dst = out;
+      f.cap = bytes;
+      if (n > 0) n += lz4_frame_feed(&f, packed + n, len - n);
+      runs++;
+    } while ((t2 = now() - t0) < MIN_TIME);
+    t2 /= runs;
+
+    if (n != (int)len || f.state != LZ4_DONE || f.out != bytes ||
+        memcmp(out, data, bytes) != 0) {
+      printf("  %s: unpacked data differs (%s)\n", names[k], lz4_msg);
+      ok = 0;
+    }
+    printf("%-22s %12.1f %12.1f %8.2f\n", names[k], bytes / t1 / 1e6,
+           bytes / t2 / 1e6, (double)bytes / len);
+  }
+  free(data);
+  free(packed);
+  free(out);
+  return ok;
+}
+
+static void bench_dispatch(void) {
+  static char *args[] = { "set", "bench", "1" };
+  double t0, t1, t2;
+  u32 runs = 0, i;
+
+  t0 = now();
+  do {
+    run("set bench 1");
+    runs++;
+  } while ((t1 = now()) - t0 < MIN_TIME);
+  for (i = 0; i < runs; i++) set_cmd(3, args);
+  t2 = now();
+
+  printf("%-22s %12s\n", "dispatch", "ns/command");
+  printf("%-22s %12.0f\n", "line \"set bench 1\"", (t1 - t0) / runs * 1e9);
+  printf("%-22s %12.0f\n", "set_cmd alone", (t2 - t1) / runs * 1e9);
+  printf("%-22s %12.0f\n", "overhead", ((t1 - t0) - (t2 - t1)) / runs * 1e9);
+}
+
+int main(int argc, char **argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 1024;
+  int null = open("/dev/null", O_RDONLY);
+  int ok;
+
+  /* The UART model must not take the terminal; input is fed to the
+     RX ring and output is dropped, so no UART interrupts are needed */
+  if (null >= 0) dup2(null, 0);
+  init_platform();
+  crc32_init();
+  init_arenas();
+  uart_irq_ok = 1;
+  out_quiet = 1;
+  echo = 0;
+
+  ok = bench_load(count);
+  bench_dump(1 << 20);
+  ok &= bench_checksum(1 << 20);
+  ok &= bench_lz4(4 << 20);
+  bench_dispatch();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,827 @@
+/*
+    Copyright 2018 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ Host (Linux) stand-ins for the parts of the Xilinx standalone BSP that
+ zynqshell.c uses. The UART (host_uart.c) is connected to stdin/stdout,
+ or to a pty when the environment variable ZS_PTY is set. The pty slave
+ path is printed on stderr so that a host tool (zsxfer) can be attached
+ to it.
+
+ The shell also uses a few fixed physical addresses (on-chip memory,
+ SLCR registers). These are backed by plain memory mapped at the same
+ addresses, which works because the host build is not position
+ independent and leaves the low 4 GB to us.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "platform.h"
+#include "xil_printf.h"
+#include "xil_cache.h"
+#include "xil_mmu.h"
+#include "xtime_l.h"
+#include "xdevcfg.h"
+#include "xdmaps.h"
+/* FatFS and dirent.h both have a DIR */
+#define DIR FF_DIR
+#include "ff.h"
+#undef DIR
+
+/* ************************************************************
+ * Platform
+ * ********************************************************* */
+
+void host_intc_init(void);
+void host_uart_start(int fd_in, int fd_out);
+void host_uart_drain(void);
+static void init_mmu_table(void);
+
+static const struct {
+  UINTPTR addr;
+  u32 size;
+} host_regions[] = {
+  { 0xF8000000, 0x1000 },  /* SLCR */
+  { 0xFFFC0000, 0x40000 }, /* OCM, mapped high */
+  { 0x43C00000, 0x10000 }, /* AXI GP0, the accelerator model */
+};
+
+static void map_regions(void) {
+  int i;
+  for (i = 0; i < (int)(sizeof(host_regions) / sizeof(host_regions[0])); i++) {
+    void *p = mmap((void *)host_regions[i].addr, host_regions[i].size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (p != (void *)host_regions[i].addr) {
+      fprintf(stderr, "zynqshell: cannot map %lx\n",
+              (unsigned long)host_regions[i].addr);
+      exit(1);
+    }
+  }
+}
+
+static int tty_saved = 0;
+static struct termios tty_orig;
+
+static void restore_tty(void) {
+  if (tty_saved) tcsetattr(0, TCSANOW, &tty_orig);
+}
+
+void init_platform(void) {
+  struct termios t;
+  int uart_in = 0, uart_out = 1;
+
+  if (getenv("ZS_PTY")) {
+    int m = posix_openpt(O_RDWR | O_NOCTTY);
+    int slave;
+    if (m < 0 || grantpt(m) != 0 || unlockpt(m) != 0) {
+      perror("zynqshell: pty");
+      exit(1);
+    }
+    /* Keep the slave open so the master does not see a hangup
+       between host tool sessions. */
+    slave = open(ptsname(m), O_RDWR | O_NOCTTY);
+    if (slave >= 0 && tcgetattr(slave, &t) == 0) {
+      cfmakeraw(&t);
+      tcsetattr(slave, TCSANOW, &t);
+    }
+    fprintf(stderr, "zynqshell: UART on %s\n", ptsname(m));
+    uart_in = m;
+    uart_out = m;
+  } else if (isatty(0) && tcgetattr(0, &tty_orig) == 0) {
+    tty_saved = 1;
+    t = tty_orig;
+    cfmakeraw(&t);
+    t.c_oflag |= OPOST; /* keep stderr readable */
+    tcsetattr(0, TCSANOW, &t);
+    atexit(restore_tty);
+  }
+
+  map_regions();
+  init_mmu_table();
+  host_intc_init();
+  host_uart_start(uart_in, uart_out);
+}
+
+void cleanup_platform(void) {
+  host_uart_drain();
+}
+
+/* ************************************************************
+ * Output
+ * ********************************************************* */
+
+void xil_printf(const char *fmt, ...) {
+  char *buf;
+  va_list ap;
+  int i, n;
+
+  va_start(ap, fmt);
+  n = vasprintf(&buf, fmt, ap);
+  va_end(ap);
+  if (n < 0) return;
+  for (i = 0; i < n; i++) outbyte(buf[i]);
+  free(buf);
+}
+
+/* ************************************************************
+ * Timer, caches and MMU
+ * ********************************************************* */
+
+void XTime_GetTime(XTime *Xtime_Global) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  *Xtime_Global = (XTime)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The host is coherent, so cache maintenance does nothing. With
+ * ZS_CACHE_LOG=1 every operation is reported on stderr, to check
+ * which ranges the shell flushes and invalidates. */
+static int cache_log = -1;
+
+static void cache_op(const char *op, INTPTR adr, u32 len) {
+  if (cache_log < 0) cache_log = getenv("ZS_CACHE_LOG") != NULL;
+  if (!cache_log) return;
+  if (len == ~0U)
+    fprintf(stderr, "[cache] %s all\n", op);
+  else
+    fprintf(stderr, "[cache] %s %08lx +%u\n", op, (unsigned long)adr, len);
+}
+
+void Xil_DCacheFlush(void) { cache_op("flush", 0, ~0U); }
+void Xil_DCacheInvalidate(void) { cache_op("invalidate", 0, ~0U); }
+void Xil_DCacheFlushRange(INTPTR adr, u32 len) { cache_op("flush", adr, len); }
+void Xil_DCacheInvalidateRange(INTPTR adr, u32 len) { cache_op("invalidate", adr, len); }
+
+/* The translation table, one entry per 1 MB section, set up like the
+   one in the BSP (translation_table.S). It only records attributes,
+   host memory is cached whatever they say. */
+u32 MMUTable[4096];
+
+static void init_mmu_table(void) {
+  u32 i, attr;
+  for (i = 0; i < 4096; i++) {
+    if (i < 0x400) attr = NORM_WB_CACHE;       /* DDR */
+    else if (i < 0xC00) attr = STRONG_ORDERED; /* PL, AXI GP0 and GP1 */
+    else if (i >= 0xE00 && i < 0xFFF) attr = DEVICE_MEMORY;
+    else if (i == 0xFFF) attr = NORM_WB_CACHE; /* OCM, mapped high */
+    else attr = 0;                             /* unassigned */
+    MMUTable[i] = attr ? (i << 20) | attr : 0;
+  }
+}
+
+static void accel_model_start(void);
+
+/* Mapping the section of the accelerator model (as the accel command
+   does) switches the model on */
+void Xil_SetTlbAttributes(INTPTR addr, u32 attrib) {
+  MMUTable[(addr >> 20) & 0xFFF] = (addr & 0xFFF00000) | attrib;
+  if ((addr & ~0xFFFFF) == 0x43C00000) accel_model_start();
+}
+
+/* ************************************************************
+ * DevCfg
+ *
+ * A model of the PCAP DMA. A transfer completes (DMA done and D_P
+ * done are set) after the time it takes at ZS_PCAP_MBPS (default 128,
+ * 0 for no limit), so it runs in parallel with whatever the shell
+ * does meanwhile. Completion is noticed either when the shell polls
+ * the status, or by a model thread that then raises the DevC
+ * interrupt if it is enabled. A bitstream may be sent in several
+ * transfers; bit 0 of the source address marks the last. PCFG_DONE
+ * (the FPGA is configured) is set after the last transfer if the data
+ * held the sync word. Pulsing PROG_B cancels a transfer in flight.
+ * With ZS_PCAP_LOG=1 each configuration is reported on stderr with
+ * its length and CRC-32, to compare with the file sent.
+ *
+ * XDcfg_Transfer can be called from the IRQ handler, so the state
+ * shared with the model thread is only touched with atomics.
+ * ********************************************************* */
+
+#define PCAP_SYNC_WORD 0xAA995566
+
+void host_irq_raise(u32 Int_Id);
+
+static XDcfg_Config dcfg_config = { XPAR_XDCFG_0_DEVICE_ID, XPAR_XDCFG_0_BASEADDR };
+
+static double pcap_mbps = 128;
+static int pcap_log = 0;
+static XDcfg *dcfg_inst = NULL;
+static int dma_busy = 0;
+static XTime dma_done_at;
+static u32 dma_done_bits;
+
+static u32 cfg_bytes = 0;
+static u32 cfg_crc = 0;
+static int cfg_sync = 0;
+
+static u32 crc32_update_host(u32 crc, const u8 *p, u32 len) {
+  static u32 table[256];
+  u32 c;
+  int i, k;
+
+  if (!table[1]) {
+    for (i = 0; i < 256; i++) {
+      for (c = i, k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320 & -(c & 1));
+      table[i] = c;
+    }
+  }
+  crc = ~crc;
+  while (len--) crc = (crc >> 8) ^ table[(crc ^ *p++) & 0xFF];
+  return ~crc;
+}
+
+/* Finish the transfer in flight if its time has come. Returns 1 if
+   this call finished it. */
+static int dcfg_update(XDcfg *InstancePtr) {
+  XTime now;
+  u32 bits;
+  if (!__atomic_load_n(&dma_busy, __ATOMIC_ACQUIRE)) return 0;
+  XTime_GetTime(&now);
+  if (now < dma_done_at) return 0;
+  bits = dma_done_bits;
+  if (!__atomic_exchange_n(&dma_busy, 0, __ATOMIC_ACQ_REL)) return 0;
+  __atomic_fetch_or(&InstancePtr->IntrStatus, bits, __ATOMIC_SEQ_CST);
+  return 1;
+}
+
+static void *dcfg_thread(void *arg) {
+  struct timespec ts = { 0, 50000 };
+  (void)arg;
+  for (;;) {
+    nanosleep(&ts, NULL);
+    if (dcfg_update(dcfg_inst) &&
+        (dcfg_inst->IntrStatus & dcfg_inst->IntrEnabled))
+      host_irq_raise(XPAR_XDCFG_0_INTR);
+  }
+  return NULL;
+}
+
+XDcfg_Config *XDcfg_LookupConfig(u16 DeviceId) {
+  return DeviceId == dcfg_config.DeviceId ? &dcfg_config : NULL;
+}
+
+int XDcfg_CfgInitialize(XDcfg *InstancePtr, XDcfg_Config *ConfigPtr,
+                        u32 EffectiveAddress) {
+  pthread_t t;
+
+  InstancePtr->Config = *ConfigPtr;
+  InstancePtr->Config.BaseAddr = EffectiveAddress;
+  InstancePtr->IsReady = 1;
+  InstancePtr->IntrStatus = 0;
+  InstancePtr->IntrEnabled = 0;
+  InstancePtr->Control = XDCFG_CTRL_PCFG_PROG_B_MASK;
+  if (getenv("ZS_PCAP_MBPS")) pcap_mbps = atof(getenv("ZS_PCAP_MBPS"));
+  pcap_log = getenv("ZS_PCAP_LOG") != NULL;
+  if (!dcfg_inst) {
+    dcfg_inst = InstancePtr;
+    pthread_create(&t, NULL, dcfg_thread, NULL);
+  }
+  return XST_SUCCESS;
+}
+
+int XDcfg_SelfTest(XDcfg *InstancePtr) {
+  return InstancePtr->IsReady ? XST_SUCCESS : XST_FAILURE;
+}
+
+void XDcfg_IntrClear(XDcfg *InstancePtr, u32 Mask) {
+  dcfg_update(InstancePtr);
+  __atomic_fetch_and(&InstancePtr->IntrStatus, ~Mask, __ATOMIC_SEQ_CST);
+}
+
+u32 XDcfg_IntrGetStatus(XDcfg *InstancePtr) {
+  dcfg_update(InstancePtr);
+  return InstancePtr->IntrStatus;
+}
+
+void XDcfg_IntrEnable(XDcfg *InstancePtr, u32 Mask) {
+  InstancePtr->IntrEnabled |= Mask;
+}
+
+void XDcfg_IntrDisable(XDcfg *InstancePtr, u32 Mask) {
+  InstancePtr->IntrEnabled &= ~Mask;
+}
+
+void XDcfg_SetControlRegister(XDcfg *InstancePtr, u32 Mask) {
+  InstancePtr->Control |= Mask;
+}
+
+/* Taking PROG_B low resets the PL and the PCAP */
+void XDcfg_ClearControlRegister(XDcfg *InstancePtr, u32 Mask) {
+  InstancePtr->Control &= ~Mask;
+  if (Mask & XDCFG_CTRL_PCFG_PROG_B_MASK) {
+    __atomic_store_n(&dma_busy, 0, __ATOMIC_SEQ_CST);
+    __atomic_fetch_and(&InstancePtr->IntrStatus, ~XDCFG_IXR_PCFG_DONE_MASK,
+                       __ATOMIC_SEQ_CST);
+    cfg_bytes = 0;
+    cfg_crc = 0;
+    cfg_sync = 0;
+  }
+}
+
+u32 XDcfg_Transfer(XDcfg *InstancePtr, void *SourcePtr, u32 SrcWordLength,
+                   void *DestPtr, u32 DestWordLength, u32 TransferType) {
+  UINTPTR src = (UINTPTR)SourcePtr;
+  int last = src & 1;
+  const u32 *w = (const u32 *)(src & ~(UINTPTR)3);
+  XTime now;
+  u32 i;
+  (void)DestPtr; (void)DestWordLength;
+
+  dcfg_update(InstancePtr);
+  if (__atomic_load_n(&dma_busy, __ATOMIC_ACQUIRE)) return XST_DEVICE_BUSY;
+  if (TransferType != XDCFG_NON_SECURE_PCAP_WRITE || SrcWordLength == 0)
+    return XST_FAILURE;
+
+  for (i = 0; i < SrcWordLength; i++) cfg_sync |= w[i] == PCAP_SYNC_WORD;
+  if (pcap_log)
+    cfg_crc = crc32_update_host(cfg_crc, (const u8 *)w, SrcWordLength * 4);
+  cfg_bytes += SrcWordLength * 4;
+
+  dma_done_bits = XDCFG_IXR_DMA_DONE_MASK | XDCFG_IXR_D_P_DONE_MASK;
+  if (last) {
+    if (cfg_sync) dma_done_bits |= XDCFG_IXR_PCFG_DONE_MASK;
+    if (pcap_log)
+      fprintf(stderr, "pcap: %u bytes, crc32 %08x, %s\n", cfg_bytes, cfg_crc,
+              cfg_sync ? "configured" : "no sync word");
+    cfg_bytes = 0;
+    cfg_crc = 0;
+    cfg_sync = 0;
+  }
+
+  XTime_GetTime(&now);
+  dma_done_at = now;
+  if (pcap_mbps > 0)
+    dma_done_at += (XTime)(SrcWordLength * 4 / (pcap_mbps * 1e6) * 1e9);
+  __atomic_store_n(&dma_busy, 1, __ATOMIC_RELEASE);
+  return XST_SUCCESS;
+}
+
+/* ************************************************************
+ * PS DMA
+ *
+ * A model of the PL330 behind the xdmaps driver API, one command per
+ * channel at a time. A command is checked the way the controller
+ * would take it (burst size 1, 2, 4 or 8 bytes, burst length 1 to 16,
+ * addresses and length multiples of the burst size) and its data is
+ * copied when the time it takes at ZS_DMA_MBPS (default 600, 0 for no
+ * limit) has passed. Then the done interrupt of the channel is
+ * raised, or for a bad command the fault interrupt. ZS_DMA_LOG=1
+ * prints every command on stderr.
+ * ********************************************************* */
+
+#define DMAPS_IDLE    0
+#define DMAPS_BUSY    1
+#define DMAPS_COPYING 2
+#define DMAPS_DONE    3 /* waiting for the done ISR */
+#define DMAPS_FAULT   4 /* waiting for the fault ISR */
+
+static XDmaPs_Config dmaps_config = { XPAR_XDMAPS_1_DEVICE_ID,
+                                     XPAR_XDMAPS_1_BASEADDR };
+static double dmaps_mbps = 600;
+static int dmaps_log = 0;
+static XDmaPs *dmaps_inst = NULL;
+static int dmaps_state[XDMAPS_CHANNELS_PER_DEV];
+static XTime dmaps_done_at[XDMAPS_CHANNELS_PER_DEV];
+
+/* Done interrupts 0-3 and 4-7 are in two groups */
+static u32 dmaps_done_intr(unsigned int Channel) {
+  return Channel < 4 ? XPAR_XDMAPS_0_DONE_INTR_0 + Channel
+                     : 72U + Channel - 4;
+}
+
+static int dmaps_set(unsigned int Channel, int from, int to) {
+  return __atomic_compare_exchange_n(&dmaps_state[Channel], &from, to, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void *dmaps_thread(void *arg) {
+  struct timespec ts = { 0, 20000 };
+  XDmaPs_Cmd *cmd;
+  XTime now;
+  unsigned int c;
+  (void)arg;
+
+  for (;;) {
+    nanosleep(&ts, NULL);
+    XTime_GetTime(&now);
+    for (c = 0; c < XDMAPS_CHANNELS_PER_DEV; c++) {
+      if (now < dmaps_done_at[c] || !dmaps_set(c, DMAPS_BUSY, DMAPS_COPYING))
+        continue;
+      cmd = dmaps_inst->Chans[c].Cmd;
+      memcpy((void *)(UINTPTR)cmd->BD.DstAddr,
+             (const void *)(UINTPTR)cmd->BD.SrcAddr, cmd->BD.Length);
+      dmaps_set(c, DMAPS_COPYING, DMAPS_DONE);
+      host_irq_raise(dmaps_done_intr(c));
+    }
+  }
+  return NULL;
+}
+
+XDmaPs_Config *XDmaPs_LookupConfig(u16 DeviceId) {
+  return DeviceId == dmaps_config.DeviceId ? &dmaps_config : NULL;
+}
+
+int XDmaPs_CfgInitialize(XDmaPs *InstPtr, XDmaPs_Config *Config,
+                         u32 EffectiveAddr) {
+  pthread_t t;
+
+  memset(InstPtr, 0, sizeof(*InstPtr));
+  InstPtr->Config = *Config;
+  InstPtr->Config.BaseAddress = EffectiveAddr;
+  InstPtr->IsReady = 1;
+  if (getenv("ZS_DMA_MBPS")) dmaps_mbps = atof(getenv("ZS_DMA_MBPS"));
+  dmaps_log = getenv("ZS_DMA_LOG") != NULL;
+  if (!dmaps_inst) {
+    dmaps_inst = InstPtr;
+    pthread_create(&t, NULL, dmaps_thread, NULL);
+    pthread_detach(t);
+  }
+  return XST_SUCCESS;
+}
+
+int XDmaPs_Start(XDmaPs *InstPtr, unsigned int Channel, XDmaPs_Cmd *Cmd,
+                 int HoldDmaProg) {
+  XDmaPs_ChanCtrl *c = &Cmd->ChanCtrl;
+  u32 size = c->SrcBurstSize;
+  int ok;
+  XTime now;
+  (void)HoldDmaProg;
+
+  if (Channel >= XDMAPS_CHANNELS_PER_DEV ||
+      __atomic_load_n(&dmaps_state[Channel], __ATOMIC_ACQUIRE) != DMAPS_IDLE)
+    return XST_FAILURE;
+
+  ok = (size == 1 || size == 2 || size == 4 || size == 8) &&
+       c->DstBurstSize == size && c->SrcInc && c->DstInc &&
+       c->SrcBurstLen >= 1 && c->SrcBurstLen <= 16 &&
+       c->DstBurstLen >= 1 && c->DstBurstLen <= 16 &&
+       Cmd->BD.Length > 0 && Cmd->BD.Length % size == 0 &&
+       Cmd->BD.SrcAddr % size == 0 && Cmd->BD.DstAddr % size == 0;
+  if (dmaps_log)
+    fprintf(stderr, "dma: ch %u %08x -> %08x +%u, burst %ux%u%s\n", Channel,
+            Cmd->BD.SrcAddr, Cmd->BD.DstAddr, Cmd->BD.Length, size,
+            c->SrcBurstLen, ok ? "" : ", fault");
+
+  InstPtr->Chans[Channel].Cmd = Cmd;
+  if (!ok) {
+    __atomic_store_n(&dmaps_state[Channel], DMAPS_FAULT, __ATOMIC_RELEASE);
+    host_irq_raise(XPAR_XDMAPS_0_FAULT_INTR);
+    return XST_SUCCESS;
+  }
+  XTime_GetTime(&now);
+  dmaps_done_at[Channel] = now;
+  if (dmaps_mbps > 0)
+    dmaps_done_at[Channel] += (XTime)(Cmd->BD.Length / (dmaps_mbps * 1e6) * 1e9);
+  __atomic_store_n(&dmaps_state[Channel], DMAPS_BUSY, __ATOMIC_RELEASE);
+  return XST_SUCCESS;
+}
+
+int XDmaPs_IsActive(XDmaPs *InstPtr, unsigned int Channel) {
+  int s = __atomic_load_n(&dmaps_state[Channel], __ATOMIC_ACQUIRE);
+  (void)InstPtr;
+  return s == DMAPS_BUSY || s == DMAPS_COPYING;
+}
+
+int XDmaPs_SetDoneHandler(XDmaPs *InstPtr, unsigned Channel,
+                          XDmaPsDoneHandler DoneHandler, void *CallbackRef) {
+  if (Channel >= XDMAPS_CHANNELS_PER_DEV) return XST_FAILURE;
+  InstPtr->Chans[Channel].DoneHandler = DoneHandler;
+  InstPtr->Chans[Channel].DoneRef = CallbackRef;
+  return XST_SUCCESS;
+}
+
+int XDmaPs_SetFaultHandler(XDmaPs *InstPtr, XDmaPsFaultHandler FaultHandler,
+                           void *CallbackRef) {
+  InstPtr->FaultHandler = FaultHandler;
+  InstPtr->FaultRef = CallbackRef;
+  return XST_SUCCESS;
+}
+
+/* Kill the command on the channel, without an interrupt */
+int XDmaPs_ResetChannel(XDmaPs *InstPtr, unsigned int Channel) {
+  struct timespec ts = { 0, 1000 };
+
+  if (Channel >= XDMAPS_CHANNELS_PER_DEV) return XST_FAILURE;
+  while (__atomic_load_n(&dmaps_state[Channel], __ATOMIC_ACQUIRE) ==
+         DMAPS_COPYING)
+    nanosleep(&ts, NULL);
+  __atomic_store_n(&dmaps_state[Channel], DMAPS_IDLE, __ATOMIC_RELEASE);
+  InstPtr->Chans[Channel].Cmd = NULL;
+  return XST_SUCCESS;
+}
+
+static void dmaps_end(XDmaPs *InstPtr, unsigned int Channel, int from) {
+  XDmaPs_ChannelData *ch = &InstPtr->Chans[Channel];
+  XDmaPs_Cmd *cmd = ch->Cmd;
+
+  if (!dmaps_set(Channel, from, DMAPS_IDLE)) return;
+  ch->Cmd = NULL;
+  cmd->DmaStatus = from == DMAPS_DONE ? 0 : -1;
+  if (from == DMAPS_DONE && ch->DoneHandler)
+    ch->DoneHandler(Channel, cmd, ch->DoneRef);
+  if (from == DMAPS_FAULT && InstPtr->FaultHandler)
+    InstPtr->FaultHandler(Channel, cmd, InstPtr->FaultRef);
+}
+
+void XDmaPs_DoneISR_0(XDmaPs *InstPtr) {
+  dmaps_end(InstPtr, 0, DMAPS_DONE);
+}
+
+void XDmaPs_FaultISR(XDmaPs *InstPtr) {
+  unsigned int c;
+  for (c = 0; c < XDMAPS_CHANNELS_PER_DEV; c++) dmaps_end(InstPtr, c, DMAPS_FAULT);
+}
+
+/* ************************************************************
+ * Accelerator
+ *
+ * A model of an HLS kernel in the PL, vadd: out[i] = a[i] + b[i] for
+ * n 32-bit integers, with the HLS register block at 0x43C00000:
+ *   0x00 control (ap_start, ap_done, ap_idle), 0x04 GIE, 0x08 IER,
+ *   0x0C ISR, 0x10 a, 0x18 b, 0x20 out, 0x28 n.
+ * The kernel takes n + ACCEL_LATENCY cycles at ZS_ACCEL_MHZ (default
+ * 100). Its ap_done interrupt is ACCEL_INTR, the first PL to PS
+ * interrupt. Like the DevCfg model the kernel is a thread that polls
+ * the control register.
+ *
+ * Example:  accel vadd 43c00000 10 18 20 28 -irq 61
+ *           run vadd @a @b @out 1024
+ * ********************************************************* */
+
+#define ACCEL_BASE    0x43C00000
+#define ACCEL_INTR    61U
+#define ACCEL_LATENCY 20
+
+#define ACCEL_REG(off) ((volatile u32 *)(UINTPTR)(ACCEL_BASE + (off)))
+
+static double accel_mhz = 100;
+
+static void *accel_thread(void *arg) {
+  struct timespec ts = { 0, 10000 };
+  XTime t0, end, now;
+  s32 *a, *b, *out;
+  u32 i, len;
+  (void)arg;
+
+  for (;;) {
+    nanosleep(&ts, NULL);
+    if (!(__atomic_load_n(ACCEL_REG(0x00), __ATOMIC_ACQUIRE) & 0x1)) continue;
+
+    XTime_GetTime(&t0);
+    __atomic_store_n(ACCEL_REG(0x00), 0, __ATOMIC_RELEASE); /* not idle */
+    a = (s32 *)(UINTPTR)*ACCEL_REG(0x10);
+    b = (s32 *)(UINTPTR)*ACCEL_REG(0x18);
+    out = (s32 *)(UINTPTR)*ACCEL_REG(0x20);
+    len = *ACCEL_REG(0x28);
+    for (i = 0; i < len; i++) out[i] = a[i] + b[i];
+
+    end = t0 + (XTime)((len + ACCEL_LATENCY) * 1000.0 / accel_mhz);
+    do XTime_GetTime(&now); while (now < end);
+
+    __atomic_store_n(ACCEL_REG(0x00), 0x6, __ATOMIC_RELEASE); /* done, idle */
+    if ((*ACCEL_REG(0x04) & 1) && (*ACCEL_REG(0x08) & 1)) {
+      __atomic_fetch_or(ACCEL_REG(0x0C), 1, __ATOMIC_SEQ_CST);
+      host_irq_raise(ACCEL_INTR);
+    }
+  }
+  return NULL;
+}
+
+static void accel_model_start(void) {
+  static int started = 0;
+  pthread_t t;
+
+  if (started) return;
+  started = 1;
+  if (getenv("ZS_ACCEL_MHZ")) accel_mhz = atof(getenv("ZS_ACCEL_MHZ"));
+  *ACCEL_REG(0x00) = 0x4; /* idle */
+  pthread_create(&t, NULL, accel_thread, NULL);
+  pthread_detach(t);
+}
+
+/* ************************************************************
+ * FatFS
+ *
+ * The card is a host directory, given by ZS_SD. Without ZS_SD there
+ * is no card and f_mount fails, as on a board with an empty slot.
+ * ZS_SD_MBPS limits the transfer rate to that of a real card (in
+ * MB/s, default 0 for no limit); every read or write call then also
+ * costs SD_CMD_US of command overhead.
+ * ********************************************************* */
+
+#define SD_CMD_US 200
+
+static char sd_root[PATH_MAX];
+static int sd_mounted = 0;
+static double sd_mbps = 0;
+
+static FRESULT sd_errno(void) {
+  switch (errno) {
+  case EEXIST: return FR_EXIST;
+  case ENOENT: return FR_NO_FILE;
+  case ENOTDIR: return FR_NO_PATH;
+  case EACCES: case EPERM: case EISDIR: return FR_DENIED;
+  case EROFS: return FR_WRITE_PROTECTED;
+  default: return FR_DISK_ERR;
+  }
+}
+
+/* "0:/dir/file" or "dir/file" below the card directory */
+static void sd_path(const TCHAR *path, char *out) {
+  if (path[0] && path[1] == ':') path += 2;
+  while (*path == '/') path++;
+  if (snprintf(out, PATH_MAX, "%s/%s", sd_root, path) >= PATH_MAX)
+    out[0] = 0; /* open fails */
+}
+
+static void sd_delay(UINT bytes) {
+  struct timespec ts;
+  double s;
+  if (sd_mbps <= 0) return;
+  s = SD_CMD_US * 1e-6 + bytes / (sd_mbps * 1e6);
+  ts.tv_sec = (time_t)s;
+  ts.tv_nsec = (long)((s - ts.tv_sec) * 1e9);
+  nanosleep(&ts, NULL);
+}
+
+static int sd_fd(FIL *fp) {
+  return fp->host ? (int)(intptr_t)fp->host - 1 : -1;
+}
+
+FRESULT f_mount(FATFS *fs, const TCHAR *path, BYTE opt) {
+  const char *root = getenv("ZS_SD");
+  struct stat st;
+  (void)path; (void)opt;
+
+  if (!root || stat(root, &st) != 0 || !S_ISDIR(st.st_mode))
+    return FR_NOT_READY;
+  snprintf(sd_root, sizeof(sd_root), "%s", root);
+  if (getenv("ZS_SD_MBPS")) sd_mbps = atof(getenv("ZS_SD_MBPS"));
+  sd_mounted = 1;
+  fs->mounted = 1;
+  return FR_OK;
+}
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode) {
+  char full[PATH_MAX];
+  struct stat st;
+  int flags, fd;
+
+  fp->host = NULL;
+  if (!sd_mounted) return FR_NOT_READY;
+  sd_path(path, full);
+
+  flags = (mode & FA_WRITE) ? ((mode & FA_READ) ? O_RDWR : O_WRONLY)
+                            : O_RDONLY;
+  if (mode & FA_CREATE_NEW) flags |= O_CREAT | O_EXCL;
+  else if (mode & FA_CREATE_ALWAYS) flags |= O_CREAT | O_TRUNC;
+  else if (mode & FA_OPEN_ALWAYS) flags |= O_CREAT;
+
+  fd = open(full, flags, 0644);
+  if (fd < 0) return sd_errno();
+  if (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+    close(fd);
+    return FR_DENIED;
+  }
+  fp->host = (void *)(intptr_t)(fd + 1);
+  fp->fsize = st.st_size;
+  fp->fptr = (mode & FA_OPEN_APPEND) == FA_OPEN_APPEND ? fp->fsize : 0;
+  sd_delay(0);
+  return FR_OK;
+}
+
+FRESULT f_close(FIL *fp) {
+  int fd = sd_fd(fp);
+  if (fd < 0) return FR_INVALID_OBJECT;
+  fp->host = NULL;
+  return close(fd) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br) {
+  int fd = sd_fd(fp);
+  ssize_t n;
+
+  *br = 0;
+  if (fd < 0) return FR_INVALID_OBJECT;
+  while (*br < btr) {
+    n = pread(fd, (char *)buff + *br, btr - *br, fp->fptr);
+    if (n < 0) return FR_DISK_ERR;
+    if (n == 0) break;
+    *br += n;
+    fp->fptr += n;
+  }
+  sd_delay(*br);
+  return FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw) {
+  int fd = sd_fd(fp);
+  ssize_t n;
+
+  *bw = 0;
+  if (fd < 0) return FR_INVALID_OBJECT;
+  while (*bw < btw) {
+    n = pwrite(fd, (const char *)buff + *bw, btw - *bw, fp->fptr);
+    if (n <= 0) return FR_DISK_ERR; /* card full */
+    *bw += n;
+    fp->fptr += n;
+  }
+  if (fp->fptr > fp->fsize) fp->fsize = fp->fptr;
+  sd_delay(*bw);
+  return FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs) {
+  if (sd_fd(fp) < 0) return FR_INVALID_OBJECT;
+  fp->fptr = ofs;
+  return FR_OK;
+}
+
+FRESULT f_truncate(FIL *fp) {
+  int fd = sd_fd(fp);
+  if (fd < 0) return FR_INVALID_OBJECT;
+  if (ftruncate(fd, fp->fptr) != 0) return FR_DISK_ERR;
+  fp->fsize = fp->fptr;
+  return FR_OK;
+}
+
+FRESULT f_sync(FIL *fp) {
+  int fd = sd_fd(fp);
+  if (fd < 0) return FR_INVALID_OBJECT;
+  return fsync(fd) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+/* Like FatFS, only an empty file can be expanded, and the file size
+   becomes fsz */
+FRESULT f_expand(FIL *fp, FSIZE_t fsz, BYTE opt) {
+  int fd = sd_fd(fp);
+  if (fd < 0) return FR_INVALID_OBJECT;
+  if (fp->fsize != 0) return FR_DENIED;
+  if (opt) {
+    if (posix_fallocate(fd, 0, fsz) != 0) return FR_DENIED;
+    fp->fsize = fsz;
+  }
+  return FR_OK;
+}
+
+FRESULT f_opendir(FF_DIR *dp, const TCHAR *path) {
+  char full[PATH_MAX];
+  if (!sd_mounted) return FR_NOT_READY;
+  sd_path(path, full);
+  dp->host = opendir(full);
+  return dp->host ? FR_OK : sd_errno();
+}
+
+FRESULT f_closedir(FF_DIR *dp) {
+  if (!dp->host) return FR_INVALID_OBJECT;
+  closedir(dp->host);
+  dp->host = NULL;
+  return FR_OK;
+}
+
+FRESULT f_readdir(FF_DIR *dp, FILINFO *fno) {
+  struct dirent *e;
+
+  fno->fname[0] = 0;
+  if (!dp->host) return FR_INVALID_OBJECT;
+  while ((e = readdir(dp->host)) != NULL) {
+    if (strcmp(e->d_name, ".") && strcmp(e->d_name, "..")) break;
+  }
+  if (e) {
+    struct stat st;
+    snprintf(fno->fname, sizeof(fno->fname), "%s", e->d_name);
+    fno->fsize = fstatat(dirfd(dp->host), e->d_name, &st, 0) == 0
+                 ? st.st_size : 0;
+  }
+  return FR_OK;
+}
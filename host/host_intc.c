@@ -0,0 +1,213 @@
+/*
+    Copyright 2018 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ Host stand-in for the GIC and the CPU IRQ exception.
+
+ The shell runs on one thread, the "CPU". Device models run on their
+ own threads and call host_irq_raise(). That sends SIGUSR1 to the CPU
+ thread, and the signal handler runs the registered IRQ exception
+ handler (normally XScuGic_InterruptHandler), just like an interrupt
+ preempting the single Cortex-A9 core. Xil_ExceptionDisable() blocks
+ the signal, which is the host version of masking IRQs in the CPSR.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "xparameters.h"
+#include "xscugic.h"
+#include "xil_exception.h"
+#include "xpseudo_asm.h"
+
+#define HOST_IRQ_SIGNAL SIGUSR1
+#define NUM_IRQS (XSCUGIC_MAX_NUM_INTR_INPUTS + 1)
+
+void host_uart_idle_poll(void);
+
+static pthread_t cpu_thread;
+
+static Xil_ExceptionHandler irq_handler = NULL;
+static void *irq_data = NULL;
+
+static struct {
+  Xil_InterruptHandler handler;
+  void *ref;
+  atomic_int enabled;
+} gic_table[NUM_IRQS];
+
+static atomic_uint pending[(NUM_IRQS + 31) / 32];
+static atomic_int signal_in_flight = 0;
+static atomic_int irqs_masked = 1; /* by the CPU thread, out of reset */
+static u32 current_irq = 0;
+
+static XScuGic_Config gic_config = {
+  XPAR_SCUGIC_SINGLE_DEVICE_ID,
+  XPAR_SCUGIC_CPU_BASEADDR,
+  XPAR_SCUGIC_DIST_BASEADDR
+};
+
+/* ************************************************************
+ * CPU side
+ * ********************************************************* */
+
+static void irq_signal(int sig) {
+  int i, b;
+  (void)sig;
+
+  atomic_store(&signal_in_flight, 0);
+  for (i = 0; i < (int)(sizeof(pending) / sizeof(pending[0])); i ++) {
+    unsigned int bits = atomic_exchange(&pending[i], 0);
+    for (b = 0; bits; b ++, bits >>= 1) {
+      if ((bits & 1) && irq_handler) {
+        current_irq = i * 32 + b;
+        irq_handler(irq_data);
+      }
+    }
+  }
+}
+
+static void set_irq_mask(int how) {
+  sigset_t s;
+  sigemptyset(&s);
+  sigaddset(&s, HOST_IRQ_SIGNAL);
+  pthread_sigmask(how, &s, NULL);
+}
+
+/* Called from init_platform on the CPU thread before any device
+   model thread is started, so those threads inherit a blocked mask. */
+void host_intc_init(void) {
+  struct sigaction sa;
+
+  cpu_thread = pthread_self();
+  set_irq_mask(SIG_BLOCK); /* IRQs are masked out of reset */
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = irq_signal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(HOST_IRQ_SIGNAL, &sa, NULL);
+}
+
+void Xil_ExceptionInit(void) { }
+
+void Xil_ExceptionRegisterHandler(u32 Exception_id,
+                                  Xil_ExceptionHandler Handler, void *Data) {
+  if (Exception_id == XIL_EXCEPTION_ID_INT) {
+    irq_handler = Handler;
+    irq_data = Data;
+  }
+}
+
+void Xil_ExceptionEnable(void) {
+  atomic_store(&irqs_masked, 0);
+  set_irq_mask(SIG_UNBLOCK);
+}
+
+void Xil_ExceptionDisable(void) {
+  set_irq_mask(SIG_BLOCK);
+  atomic_store(&irqs_masked, 1);
+}
+
+/* SVC mode, with the I bit set while the IRQ signal is blocked in
+   the calling thread (as it also is in the handler) */
+u32 host_mfcpsr(void) {
+  sigset_t s;
+  pthread_sigmask(SIG_BLOCK, NULL, &s);
+  return 0x13 | (sigismember(&s, HOST_IRQ_SIGNAL) ? XIL_EXCEPTION_IRQ : 0);
+}
+
+/* An IRQ that is raised (and masked) while sleeping ends the sleep
+   once it is unmasked, so a short sleep stands in for WFI. */
+void host_wfi(void) {
+  struct timespec ts = { 0, 20000 };
+  host_uart_idle_poll();
+  nanosleep(&ts, NULL);
+}
+
+/* ************************************************************
+ * GIC
+ * ********************************************************* */
+
+XScuGic_Config *XScuGic_LookupConfig(u16 DeviceId) {
+  return DeviceId == gic_config.DeviceId ? &gic_config : NULL;
+}
+
+s32 XScuGic_CfgInitialize(XScuGic *InstancePtr, XScuGic_Config *ConfigPtr,
+                          u32 EffectiveAddr) {
+  (void)EffectiveAddr;
+  InstancePtr->Config = ConfigPtr;
+  InstancePtr->IsReady = 1;
+  return XST_SUCCESS;
+}
+
+s32 XScuGic_Connect(XScuGic *InstancePtr, u32 Int_Id,
+                    Xil_InterruptHandler Handler, void *CallBackRef) {
+  (void)InstancePtr;
+  if (Int_Id >= NUM_IRQS) return XST_FAILURE;
+  gic_table[Int_Id].handler = Handler;
+  gic_table[Int_Id].ref = CallBackRef;
+  return XST_SUCCESS;
+}
+
+void XScuGic_Disconnect(XScuGic *InstancePtr, u32 Int_Id) {
+  XScuGic_Disable(InstancePtr, Int_Id);
+  gic_table[Int_Id].handler = NULL;
+}
+
+void XScuGic_Enable(XScuGic *InstancePtr, u32 Int_Id) {
+  (void)InstancePtr;
+  if (Int_Id < NUM_IRQS) atomic_store(&gic_table[Int_Id].enabled, 1);
+}
+
+void XScuGic_Disable(XScuGic *InstancePtr, u32 Int_Id) {
+  (void)InstancePtr;
+  if (Int_Id < NUM_IRQS) atomic_store(&gic_table[Int_Id].enabled, 0);
+}
+
+void XScuGic_InterruptHandler(XScuGic *InstancePtr) {
+  u32 id = current_irq;
+  (void)InstancePtr;
+  if (id < NUM_IRQS && gic_table[id].handler)
+    gic_table[id].handler(gic_table[id].ref);
+}
+
+/* ************************************************************
+ * Device side
+ * ********************************************************* */
+
+/* An interrupt has been raised but the CPU thread has not run the
+   handler yet (it may simply not have been scheduled). Not while the
+   CPU has IRQs masked: then it is not going to take it, and devices
+   carry on as they would on the board. */
+int host_irq_in_flight(void) {
+  return atomic_load(&signal_in_flight) && !atomic_load(&irqs_masked);
+}
+
+/* Assert interrupt Int_Id. Level sensitive sources call this again
+   for as long as their condition holds. */
+void host_irq_raise(u32 Int_Id) {
+  if (Int_Id >= NUM_IRQS || !atomic_load(&gic_table[Int_Id].enabled))
+    return;
+  atomic_fetch_or(&pending[Int_Id / 32], 1U << (Int_Id % 32));
+  if (!atomic_exchange(&signal_in_flight, 1))
+    pthread_kill(cpu_thread, HOST_IRQ_SIGNAL);
+}
@@ -0,0 +1,365 @@
+/*
+    Copyright 2018 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ Host model of the Zynq PS UART.
+
+ The model has the 64 byte TX and RX FIFOs, the status register and
+ the interrupt status/mask registers of the real UART. A thread plays
+ the role of the serial line: it moves bytes between the FIFOs and a
+ file descriptor at the rate given by ZS_BAUD (default 115200, 10 bits
+ per character, 0 means no rate limit) and raises the UART interrupt.
+ Like on the board, a byte that arrives while the RX FIFO is full is
+ lost and flagged as an overrun. With ZS_BAUD=0 the line instead
+ waits for room in the FIFO.
+
+ The sender on the other end of the line honours XON/XOFF when
+ ZS_IXON=1 and the RTS output when ZS_CRTSCTS=1, like a terminal
+ with the corresponding flow control turned on.
+
+ At the end of input (stdin closed) the shell exits once it is
+ waiting for input that will never arrive.
+
+ ZS_UART_STATS=1 prints line statistics on stderr at exit.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xparameters.h"
+#include "xil_printf.h"
+#include "xuartps_hw.h"
+
+#define FIFO_SIZE 64
+#define TICK_NS   20000
+
+void host_irq_raise(u32 Int_Id);
+int host_irq_in_flight(void);
+void host_uart_idle_poll(void);
+
+typedef struct {
+  u8 data[FIFO_SIZE];
+  atomic_uint head; /* written by the producer */
+  atomic_uint tail; /* written by the consumer */
+} fifo;
+
+static fifo tx_fifo;
+static fifo rx_fifo;
+
+static atomic_uint isr = 0;
+static atomic_uint imr = 0;
+static atomic_uint rxwm = 32;
+static atomic_uint rxtout = 0;
+static atomic_uint modemcr = 0;
+static atomic_int tx_active = 0;
+
+static int in_fd = 0;
+static int out_fd = 1;
+static long baud = 115200;
+
+static atomic_int input_eof = 0;
+static int honour_xon = 0;
+static int honour_rts = 0;
+static int sender_stopped = 0; /* XOFF seen */
+
+/* Line statistics */
+static atomic_ulong line_tx_bytes = 0;
+static atomic_ulong line_rx_bytes = 0;
+static atomic_ulong line_rx_overruns = 0;
+static double line_start;
+
+static pthread_t line_thread;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned fifo_count(fifo *f) {
+  return atomic_load(&f->head) - atomic_load(&f->tail);
+}
+
+/* ************************************************************
+ * Registers (CPU side)
+ * ********************************************************* */
+
+static u32 status(void) {
+  u32 sr = 0;
+  unsigned tx = fifo_count(&tx_fifo);
+  unsigned rx = fifo_count(&rx_fifo);
+
+  if (rx == 0) sr |= XUARTPS_SR_RXEMPTY;
+  if (rx == FIFO_SIZE) sr |= XUARTPS_SR_RXFULL;
+  if (rx >= atomic_load(&rxwm)) sr |= XUARTPS_SR_RXOVR;
+  if (tx == FIFO_SIZE) sr |= XUARTPS_SR_TXFULL;
+  if (tx == 0 && !atomic_load(&tx_active)) sr |= XUARTPS_SR_TXEMPTY;
+  if (tx > 0 || atomic_load(&tx_active)) sr |= XUARTPS_SR_TACTIVE;
+  return sr;
+}
+
+u32 host_uart_read(UINTPTR base, u32 offset) {
+  u32 v;
+  (void)base;
+
+  switch (offset) {
+  case XUARTPS_SR_OFFSET:     return status();
+  case XUARTPS_ISR_OFFSET:     return atomic_load(&isr);
+  case XUARTPS_IMR_OFFSET:     return atomic_load(&imr);
+  case XUARTPS_RXWM_OFFSET:    return atomic_load(&rxwm);
+  case XUARTPS_RXTOUT_OFFSET:  return atomic_load(&rxtout);
+  case XUARTPS_MODEMCR_OFFSET: return atomic_load(&modemcr);
+  case XUARTPS_FIFO_OFFSET:
+    if (fifo_count(&rx_fifo) == 0) return 0;
+    v = rx_fifo.data[atomic_load(&rx_fifo.tail) % FIFO_SIZE];
+    atomic_fetch_add(&rx_fifo.tail, 1);
+    return v;
+  default:
+    return 0;
+  }
+}
+
+void host_uart_write(UINTPTR base, u32 offset, u32 value) {
+  (void)base;
+
+  switch (offset) {
+  case XUARTPS_IER_OFFSET:     atomic_fetch_or(&imr, value); break;
+  case XUARTPS_IDR_OFFSET:     atomic_fetch_and(&imr, ~value); break;
+  case XUARTPS_ISR_OFFSET:     atomic_fetch_and(&isr, ~value); break;
+  case XUARTPS_RXWM_OFFSET:    atomic_store(&rxwm, value & 0x3F); break;
+  case XUARTPS_RXTOUT_OFFSET:  atomic_store(&rxtout, value & 0xFF); break;
+  case XUARTPS_MODEMCR_OFFSET: atomic_store(&modemcr, value); break;
+  case XUARTPS_FIFO_OFFSET:
+    if (fifo_count(&tx_fifo) == FIFO_SIZE) {
+      atomic_fetch_or(&isr, XUARTPS_IXR_TOVR);
+      break;
+    }
+    tx_fifo.data[atomic_load(&tx_fifo.head) % FIFO_SIZE] = value;
+    atomic_fetch_add(&tx_fifo.head, 1);
+    break;
+  default:
+    break;
+  }
+}
+
+void XUartPs_SendByte(UINTPTR BaseAddress, u8 Data) {
+  struct timespec ts = { 0, TICK_NS };
+  while (XUartPs_IsTransmitFull(BaseAddress)) nanosleep(&ts, NULL);
+  XUartPs_WriteReg(BaseAddress, XUARTPS_FIFO_OFFSET, Data);
+}
+
+u8 XUartPs_RecvByte(UINTPTR BaseAddress) {
+  struct timespec ts = { 0, TICK_NS };
+  while (!XUartPs_IsReceiveData(BaseAddress)) {
+    host_uart_idle_poll();
+    nanosleep(&ts, NULL);
+  }
+  return XUartPs_ReadReg(BaseAddress, XUARTPS_FIFO_OFFSET);
+}
+
+/* The BSP versions, zynqshell.c may replace them */
+__attribute__((weak)) void outbyte(char c) {
+  XUartPs_SendByte(STDOUT_BASEADDRESS, c);
+}
+
+__attribute__((weak)) char inbyte(void) {
+  return XUartPs_RecvByte(STDIN_BASEADDRESS);
+}
+
+/* Called whenever the CPU sleeps waiting for something. After the end
+   of input has been reached and everything is sent, 0.2 s of nothing
+   but waiting means the shell waits for input that will not come. */
+void host_uart_idle_poll(void) {
+  static double idle_since = 0;
+  static double last_poll = 0;
+  double t;
+
+  if (!atomic_load(&input_eof) || fifo_count(&rx_fifo) ||
+      fifo_count(&tx_fifo) || atomic_load(&tx_active)) {
+    idle_since = 0;
+    return;
+  }
+  t = now_s();
+  if (idle_since == 0 || t - last_poll > 0.01) {
+    idle_since = t;
+  } else if (t - idle_since > 0.2) {
+    exit(0);
+  }
+  last_poll = t;
+}
+
+/* ************************************************************
+ * Serial line (line thread)
+ * ********************************************************* */
+
+static void *line_main(void *arg) {
+  struct timespec tick = { 0, TICK_NS };
+  double last = now_s();
+  double tx_credit = 0, rx_credit = 0;
+  double last_rx = last;
+  u8 out[FIFO_SIZE];
+  (void)arg;
+
+  for (;;) {
+    double t = now_s();
+    unsigned n, i, room;
+    int busy = 0;
+
+    if (baud && host_irq_in_flight()) {
+      /* The host scheduler has not run the CPU thread since the last
+         interrupt. Hold the line rather than overrun the model FIFO
+         for a reason the board would not have. */
+    } else if (baud) {
+      double chars = (t - last) * baud / 10.0;
+      tx_credit += chars;
+      rx_credit += chars;
+      if (tx_credit > FIFO_SIZE) tx_credit = FIFO_SIZE;
+      if (rx_credit > FIFO_SIZE) rx_credit = FIFO_SIZE;
+    } else {
+      tx_credit = rx_credit = FIFO_SIZE;
+    }
+    last = t;
+
+    /* Transmit */
+    n = fifo_count(&tx_fifo);
+    if (n > (unsigned)tx_credit) n = (unsigned)tx_credit;
+    if (n) atomic_store(&tx_active, 1);
+    for (i = 0; i < n; i ++) {
+      out[i] = tx_fifo.data[atomic_load(&tx_fifo.tail) % FIFO_SIZE];
+      atomic_fetch_add(&tx_fifo.tail, 1);
+    }
+    if (n) {
+      unsigned off = 0;
+      if (honour_xon) {
+        for (i = 0; i < n; i ++) {
+          if (out[i] == 0x13) sender_stopped = 1;
+          if (out[i] == 0x11) sender_stopped = 0;
+        }
+      }
+      while (off < n) {
+        ssize_t r = write(out_fd, out + off, n - off);
+        if (r < 0 && errno != EINTR && errno != EAGAIN) break;
+        if (r > 0) off += r;
+      }
+      tx_credit -= n;
+      atomic_fetch_add(&line_tx_bytes, n);
+      busy = 1;
+      if (fifo_count(&tx_fifo) == 0)
+        atomic_fetch_or(&isr, XUARTPS_IXR_TXEMPTY);
+    } else if (fifo_count(&tx_fifo) == 0) {
+      atomic_store(&tx_active, 0);
+    }
+
+    /* Receive */
+    room = FIFO_SIZE - fifo_count(&rx_fifo);
+    n = (unsigned)rx_credit;
+    if (!baud && n > room) n = room;
+    /* Do not let the line run past the point where the trigger level
+       interrupt would have been taken. On the board the CPU sees that
+       interrupt after a few microseconds; here the CPU thread may not
+       be scheduled for milliseconds. */
+    if ((atomic_load(&imr) & XUARTPS_IXR_RXOVR) &&
+        fifo_count(&rx_fifo) < atomic_load(&rxwm) &&
+        n > atomic_load(&rxwm) - fifo_count(&rx_fifo))
+      n = atomic_load(&rxwm) - fifo_count(&rx_fifo);
+    if (sender_stopped ||
+        (honour_rts && !(atomic_load(&modemcr) & XUARTPS_MODEMCR_RTS)))
+      n = 0;
+    if (n && !atomic_load(&input_eof)) {
+      struct pollfd p = { in_fd, POLLIN, 0 };
+      if (poll(&p, 1, 0) > 0) {
+        u8 in[FIFO_SIZE];
+        ssize_t r = read(in_fd, in, n);
+        if (r == 0 || (r < 0 && errno != EINTR && errno != EAGAIN)) {
+          atomic_store(&input_eof, 1);
+        }
+        for (i = 0; r > 0 && i < (unsigned)r; i ++) {
+          if (fifo_count(&rx_fifo) == FIFO_SIZE) {
+            atomic_fetch_add(&line_rx_overruns, 1);
+            atomic_fetch_or(&isr, XUARTPS_IXR_OVER);
+            continue;
+          }
+          rx_fifo.data[atomic_load(&rx_fifo.head) % FIFO_SIZE] = in[i];
+          atomic_fetch_add(&rx_fifo.head, 1);
+        }
+        if (r > 0) {
+          rx_credit -= r;
+          last_rx = t;
+          busy = 1;
+          atomic_fetch_add(&line_rx_bytes, r);
+          if (fifo_count(&rx_fifo) >= atomic_load(&rxwm))
+            atomic_fetch_or(&isr, XUARTPS_IXR_RXOVR);
+          if (fifo_count(&rx_fifo) == FIFO_SIZE)
+            atomic_fetch_or(&isr, XUARTPS_IXR_RXFULL);
+        }
+      }
+    }
+
+    /* Receiver timeout: rxtout counts 4 bit periods without new data */
+    if (atomic_load(&rxtout) && fifo_count(&rx_fifo) &&
+        (t - last_rx) * (baud ? baud : 115200) > 4.0 * atomic_load(&rxtout)) {
+      atomic_fetch_or(&isr, XUARTPS_IXR_TOUT);
+      last_rx = t;
+    }
+
+    if (atomic_load(&isr) & atomic_load(&imr)) {
+      host_irq_raise(XPAR_XUARTPS_1_INTR);
+      sched_yield();
+    }
+
+    if (!busy || baud) nanosleep(&tick, NULL);
+  }
+  return NULL;
+}
+
+static void line_stats(void) {
+  double t = now_s() - line_start;
+  fprintf(stderr,
+          "zynqshell: line %.3f s, tx %lu bytes (%.1f KB/s), "
+          "rx %lu bytes, %lu overruns\n",
+          t, atomic_load(&line_tx_bytes),
+          atomic_load(&line_tx_bytes) / 1024.0 / t,
+          atomic_load(&line_rx_bytes), atomic_load(&line_rx_overruns));
+}
+
+void host_uart_start(int fd_in, int fd_out) {
+  const char *b = getenv("ZS_BAUD");
+
+  in_fd = fd_in;
+  out_fd = fd_out;
+  if (b) baud = atol(b);
+  honour_xon = getenv("ZS_IXON") != NULL;
+  honour_rts = getenv("ZS_CRTSCTS") != NULL;
+  line_start = now_s();
+  if (getenv("ZS_UART_STATS")) atexit(line_stats);
+  pthread_create(&line_thread, NULL, line_main, NULL);
+}
+
+/* Wait until everything in the TX FIFO has been put on the line */
+void host_uart_drain(void) {
+  struct timespec ts = { 0, TICK_NS };
+  while (fifo_count(&tx_fifo) || atomic_load(&tx_active))
+    nanosleep(&ts, NULL);
+}
@@ -0,0 +1,76 @@
+/* Host stand-in for the xilffs FatFS interface (ff.h) */
+#ifndef FF_H
+#define FF_H
+
+#include "xil_types.h"
+
+typedef unsigned int UINT;
+typedef u8  BYTE;
+typedef u32 DWORD;
+typedef u32 FSIZE_t;
+typedef char TCHAR;
+
+typedef enum {
+  FR_OK = 0,
+  FR_DISK_ERR,
+  FR_INT_ERR,
+  FR_NOT_READY,
+  FR_NO_FILE,
+  FR_NO_PATH,
+  FR_INVALID_NAME,
+  FR_DENIED,
+  FR_EXIST,
+  FR_INVALID_OBJECT,
+  FR_WRITE_PROTECTED,
+  FR_INVALID_DRIVE,
+  FR_NOT_ENABLED,
+  FR_NO_FILESYSTEM
+} FRESULT;
+
+#define FA_READ          0x01
+#define FA_WRITE         0x02
+#define FA_OPEN_EXISTING 0x00
+#define FA_CREATE_NEW    0x04
+#define FA_CREATE_ALWAYS 0x08
+#define FA_OPEN_ALWAYS   0x10
+#define FA_OPEN_APPEND   0x30
+
+typedef struct {
+  int mounted;
+} FATFS;
+
+typedef struct {
+  void *host;
+  FSIZE_t fptr;
+  FSIZE_t fsize;
+} FIL;
+
+typedef struct {
+  void *host;
+} DIR;
+
+typedef struct {
+  FSIZE_t fsize;
+  TCHAR fname[256];
+} FILINFO;
+
+#define FF_USE_EXPAND 1
+
+#define f_size(fp) ((fp)->fsize)
+#define f_tell(fp) ((fp)->fptr)
+#define file_size(fp) f_size(fp)
+
+FRESULT f_mount(FATFS *fs, const TCHAR *path, BYTE opt);
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+FRESULT f_truncate(FIL *fp);
+FRESULT f_sync(FIL *fp);
+FRESULT f_expand(FIL *fp, FSIZE_t fsz, BYTE opt);
+FRESULT f_opendir(DIR *dp, const TCHAR *path);
+FRESULT f_closedir(DIR *dp);
+FRESULT f_readdir(DIR *dp, FILINFO *fno);
+
+#endif
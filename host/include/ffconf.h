@@ -0,0 +1,7 @@
+/* Host stand-in for the xilffs ffconf.h */
+#ifndef FFCONF_H
+#define FFCONF_H
+
+#define _USE_EXPAND 1
+
+#endif
@@ -0,0 +1,8 @@
+/* Host stand-in for the SDK template platform.h */
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+void init_platform(void);
+void cleanup_platform(void);
+
+#endif
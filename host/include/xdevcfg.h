@@ -0,0 +1,51 @@
+/* Host stand-in for the Xilinx DevCfg driver (xdevcfg.h) */
+#ifndef XDEVCFG_H
+#define XDEVCFG_H
+
+#include "xil_types.h"
+#include "xstatus.h"
+#include "xparameters.h"
+
+#define XDCFG_IXR_PCFG_DONE_MASK   0x00000004U
+#define XDCFG_IXR_D_P_DONE_MASK    0x00001000U
+#define XDCFG_IXR_DMA_DONE_MASK    0x00002000U
+#define XDCFG_IXR_ERROR_FLAGS_MASK 0x00F0C860U
+#define XDCFG_IXR_ALL_MASK         0xF8F7F87FU
+
+#define XDCFG_CTRL_PCFG_PROG_B_MASK 0x40000000U
+
+#define XDCFG_DMA_INVALID_ADDRESS 0xFFFFFFFFU
+
+#define XDCFG_NON_SECURE_PCAP_WRITE 1
+#define XDCFG_SECURE_PCAP_WRITE     2
+#define XDCFG_PCAP_READBACK         3
+#define XDCFG_CONCURRENT_SECURE_READ_WRITE    4
+#define XDCFG_CONCURRENT_NONSEC_READ_WRITE    5
+
+typedef struct {
+  u16 DeviceId;
+  u32 BaseAddr;
+} XDcfg_Config;
+
+typedef struct {
+  XDcfg_Config Config;
+  u32 IsReady;
+  volatile u32 IntrStatus; /* also written by the model thread */
+  volatile u32 IntrEnabled;
+  u32 Control;
+} XDcfg;
+
+XDcfg_Config *XDcfg_LookupConfig(u16 DeviceId);
+int XDcfg_CfgInitialize(XDcfg *InstancePtr, XDcfg_Config *ConfigPtr,
+                        u32 EffectiveAddress);
+int XDcfg_SelfTest(XDcfg *InstancePtr);
+void XDcfg_IntrClear(XDcfg *InstancePtr, u32 Mask);
+u32 XDcfg_IntrGetStatus(XDcfg *InstancePtr);
+void XDcfg_IntrEnable(XDcfg *InstancePtr, u32 Mask);
+void XDcfg_IntrDisable(XDcfg *InstancePtr, u32 Mask);
+void XDcfg_SetControlRegister(XDcfg *InstancePtr, u32 Mask);
+void XDcfg_ClearControlRegister(XDcfg *InstancePtr, u32 Mask);
+u32 XDcfg_Transfer(XDcfg *InstancePtr, void *SourcePtr, u32 SrcWordLength,
+                   void *DestPtr, u32 DestWordLength, u32 TransferType);
+
+#endif
@@ -0,0 +1,80 @@
+/* Host stand-in for the Xilinx PS DMA (PL330) driver (xdmaps.h) */
+#ifndef XDMAPS_H
+#define XDMAPS_H
+
+#include "xil_types.h"
+#include "xstatus.h"
+#include "xparameters.h"
+
+#define XDMAPS_CHANNELS_PER_DEV 8
+
+typedef struct {
+  unsigned int EndianSwapSize;
+  unsigned int DstCacheCtrl;
+  unsigned int DstProtCtrl;
+  unsigned int DstBurstLen;
+  unsigned int DstBurstSize;
+  unsigned int DstInc;
+  unsigned int SwapSize;
+  unsigned int SrcCacheCtrl;
+  unsigned int SrcProtCtrl;
+  unsigned int SrcBurstLen;
+  unsigned int SrcBurstSize;
+  unsigned int SrcInc;
+} XDmaPs_ChanCtrl;
+
+typedef struct {
+  u32 SrcAddr;
+  u32 DstAddr;
+  unsigned int Length;
+} XDmaPs_BD;
+
+typedef struct {
+  XDmaPs_ChanCtrl ChanCtrl;
+  XDmaPs_BD BD;
+  void *UserDmaProg;
+  int UserDmaProgLength;
+  void *GeneratedDmaProg;
+  int GeneratedDmaProgLength;
+  int DmaStatus;
+} XDmaPs_Cmd;
+
+typedef void (*XDmaPsDoneHandler)(unsigned int Channel, XDmaPs_Cmd *DmaCmd,
+                                  void *CallbackRef);
+typedef void (*XDmaPsFaultHandler)(unsigned int Channel, XDmaPs_Cmd *DmaCmd,
+                                   void *CallbackRef);
+
+typedef struct {
+  u16 DeviceId;
+  u32 BaseAddress;
+} XDmaPs_Config;
+
+typedef struct {
+  XDmaPsDoneHandler DoneHandler;
+  void *DoneRef;
+  XDmaPs_Cmd *volatile Cmd; /* in flight, set until the done interrupt */
+} XDmaPs_ChannelData;
+
+typedef struct {
+  XDmaPs_Config Config;
+  u32 IsReady;
+  XDmaPs_ChannelData Chans[XDMAPS_CHANNELS_PER_DEV];
+  XDmaPsFaultHandler FaultHandler;
+  void *FaultRef;
+} XDmaPs;
+
+XDmaPs_Config *XDmaPs_LookupConfig(u16 DeviceId);
+int XDmaPs_CfgInitialize(XDmaPs *InstPtr, XDmaPs_Config *Config,
+                         u32 EffectiveAddr);
+int XDmaPs_Start(XDmaPs *InstPtr, unsigned int Channel, XDmaPs_Cmd *Cmd,
+                 int HoldDmaProg);
+int XDmaPs_IsActive(XDmaPs *InstPtr, unsigned int Channel);
+int XDmaPs_SetDoneHandler(XDmaPs *InstPtr, unsigned Channel,
+                          XDmaPsDoneHandler DoneHandler, void *CallbackRef);
+int XDmaPs_SetFaultHandler(XDmaPs *InstPtr, XDmaPsFaultHandler FaultHandler,
+                           void *CallbackRef);
+int XDmaPs_ResetChannel(XDmaPs *InstPtr, unsigned int Channel);
+void XDmaPs_DoneISR_0(XDmaPs *InstPtr);
+void XDmaPs_FaultISR(XDmaPs *InstPtr);
+
+#endif
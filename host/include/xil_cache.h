@@ -0,0 +1,13 @@
+/* Host stand-in for the Xilinx BSP xil_cache.h */
+#ifndef XIL_CACHE_H
+#define XIL_CACHE_H
+
+#include "xil_types.h"
+#include "xpseudo_asm.h"
+
+void Xil_DCacheFlush(void);
+void Xil_DCacheInvalidate(void);
+void Xil_DCacheFlushRange(INTPTR adr, u32 len);
+void Xil_DCacheInvalidateRange(INTPTR adr, u32 len);
+
+#endif
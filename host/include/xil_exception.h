@@ -0,0 +1,22 @@
+/* Host stand-in for the Xilinx BSP xil_exception.h.
+ * Masking IRQs blocks the signal that host_intc.c uses as IRQ line. */
+#ifndef XIL_EXCEPTION_H
+#define XIL_EXCEPTION_H
+
+#include "xil_types.h"
+
+typedef void (*Xil_ExceptionHandler)(void *data);
+typedef void (*Xil_InterruptHandler)(void *data);
+
+#define XIL_EXCEPTION_ID_IRQ_INT 5U
+#define XIL_EXCEPTION_ID_INT     XIL_EXCEPTION_ID_IRQ_INT
+
+#define XIL_EXCEPTION_IRQ 0x80U /* CPSR I bit, set while IRQs are masked */
+
+void Xil_ExceptionInit(void);
+void Xil_ExceptionRegisterHandler(u32 Exception_id,
+                                  Xil_ExceptionHandler Handler, void *Data);
+void Xil_ExceptionEnable(void);
+void Xil_ExceptionDisable(void);
+
+#endif
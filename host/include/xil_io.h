@@ -0,0 +1,11 @@
+/* Host stand-in for the Xilinx BSP xil_io.h */
+#ifndef XIL_IO_H
+#define XIL_IO_H
+
+#include "xil_types.h"
+#include "xpseudo_asm.h"
+
+static inline u32 Xil_In32(UINTPTR addr) { return *(volatile u32 *)addr; }
+static inline void Xil_Out32(UINTPTR addr, u32 val) { *(volatile u32 *)addr = val; }
+
+#endif
@@ -0,0 +1,15 @@
+/* Host stand-in for the Xilinx BSP xil_mmu.h */
+#ifndef XIL_MMU_H
+#define XIL_MMU_H
+
+#include "xil_types.h"
+
+#define DEVICE_SHARED  0x00000C06U
+#define DEVICE_MEMORY  0x00000C06U
+#define NORM_NONCACHE  0x00011DE2U
+#define STRONG_ORDERED 0x00000C02U
+#define NORM_WB_CACHE  0x00015DE6U
+
+void Xil_SetTlbAttributes(INTPTR addr, u32 attrib);
+
+#endif
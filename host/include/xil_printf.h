@@ -0,0 +1,12 @@
+/* Host stand-in for the Xilinx BSP xil_printf.h */
+#ifndef XIL_PRINTF_H
+#define XIL_PRINTF_H
+
+#include "xil_types.h"
+#include "xparameters.h"
+
+void xil_printf(const char *fmt, ...);
+void outbyte(char c);
+char inbyte(void);
+
+#endif
@@ -0,0 +1,24 @@
+/* Host stand-in for the generated xparameters.h */
+#ifndef XPARAMETERS_H
+#define XPARAMETERS_H
+
+#define XPAR_XDCFG_0_DEVICE_ID 0
+#define XPAR_XDCFG_0_BASEADDR  0xF8007000
+#define XPAR_XDCFG_0_INTR      40U
+
+#define XPAR_XDMAPS_1_DEVICE_ID   1 /* non-secure PS DMA */
+#define XPAR_XDMAPS_1_BASEADDR    0xF8004000
+#define XPAR_XDMAPS_0_FAULT_INTR  45U
+#define XPAR_XDMAPS_0_DONE_INTR_0 46U
+
+#define XPAR_SCUGIC_SINGLE_DEVICE_ID 0U
+#define XPAR_SCUGIC_CPU_BASEADDR     0xF8F00100U
+#define XPAR_SCUGIC_DIST_BASEADDR    0xF8F01000U
+
+#define XPAR_PS7_UART_1_BASEADDR 0xE0001000
+#define XPAR_XUARTPS_1_INTR      82U
+#define XPAR_PS7_UART_1_INTR     XPAR_XUARTPS_1_INTR
+#define STDIN_BASEADDRESS  XPAR_PS7_UART_1_BASEADDR
+#define STDOUT_BASEADDRESS XPAR_PS7_UART_1_BASEADDR
+
+#endif
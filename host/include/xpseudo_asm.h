@@ -0,0 +1,16 @@
+/* Host stand-in for the Xilinx BSP xpseudo_asm.h */
+#ifndef XPSEUDO_ASM_H
+#define XPSEUDO_ASM_H
+
+#include "xil_types.h"
+
+void host_wfi(void);
+u32 host_mfcpsr(void);
+
+#define dsb() __sync_synchronize()
+#define dmb() __sync_synchronize()
+#define isb() __sync_synchronize()
+#define wfi() host_wfi()
+#define mfcpsr() host_mfcpsr()
+
+#endif
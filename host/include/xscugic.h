@@ -0,0 +1,33 @@
+/* Host stand-in for the Xilinx GIC driver (xscugic.h).
+ * Interrupts are delivered to the CPU thread by host_intc.c. */
+#ifndef XSCUGIC_H
+#define XSCUGIC_H
+
+#include "xil_types.h"
+#include "xstatus.h"
+#include "xil_exception.h"
+
+#define XSCUGIC_MAX_NUM_INTR_INPUTS 95
+
+typedef struct {
+  u16 DeviceId;
+  u32 CpuBaseAddress;
+  u32 DistBaseAddress;
+} XScuGic_Config;
+
+typedef struct {
+  XScuGic_Config *Config;
+  u32 IsReady;
+} XScuGic;
+
+XScuGic_Config *XScuGic_LookupConfig(u16 DeviceId);
+s32 XScuGic_CfgInitialize(XScuGic *InstancePtr, XScuGic_Config *ConfigPtr,
+                          u32 EffectiveAddr);
+s32 XScuGic_Connect(XScuGic *InstancePtr, u32 Int_Id,
+                    Xil_InterruptHandler Handler, void *CallBackRef);
+void XScuGic_Disconnect(XScuGic *InstancePtr, u32 Int_Id);
+void XScuGic_Enable(XScuGic *InstancePtr, u32 Int_Id);
+void XScuGic_Disable(XScuGic *InstancePtr, u32 Int_Id);
+void XScuGic_InterruptHandler(XScuGic *InstancePtr);
+
+#endif
@@ -0,0 +1,9 @@
+/* Host stand-in for the Xilinx BSP xstatus.h */
+#ifndef XSTATUS_H
+#define XSTATUS_H
+
+#define XST_SUCCESS 0L
+#define XST_FAILURE 1L
+#define XST_DEVICE_BUSY 21L
+
+#endif
@@ -0,0 +1,14 @@
+/* Host stand-in for the Xilinx BSP xtime_l.h.
+ * The global timer is replaced by CLOCK_MONOTONIC in nanoseconds. */
+#ifndef XTIME_L_H
+#define XTIME_L_H
+
+#include "xil_types.h"
+
+typedef u64 XTime;
+
+#define COUNTS_PER_SECOND 1000000000ULL
+
+void XTime_GetTime(XTime *Xtime_Global);
+
+#endif
@@ -0,0 +1,73 @@
+/* Host stand-in for the Xilinx BSP xuartps_hw.h.
+ * Register accesses go to the UART model in host_uart.c. */
+#ifndef XUARTPS_HW_H
+#define XUARTPS_HW_H
+
+#include "xil_types.h"
+
+#define XUARTPS_CR_OFFSET      0x0000U
+#define XUARTPS_MR_OFFSET      0x0004U
+#define XUARTPS_IER_OFFSET     0x0008U
+#define XUARTPS_IDR_OFFSET     0x000CU
+#define XUARTPS_IMR_OFFSET     0x0010U
+#define XUARTPS_ISR_OFFSET     0x0014U
+#define XUARTPS_BAUDGEN_OFFSET 0x0018U
+#define XUARTPS_RXTOUT_OFFSET  0x001CU
+#define XUARTPS_RXWM_OFFSET    0x0020U
+#define XUARTPS_MODEMCR_OFFSET 0x0024U
+#define XUARTPS_MODEMSR_OFFSET 0x0028U
+#define XUARTPS_SR_OFFSET      0x002CU
+#define XUARTPS_FIFO_OFFSET    0x0030U
+#define XUARTPS_TXWM_OFFSET    0x0044U
+
+#define XUARTPS_CR_TORST       0x00000040U
+
+#define XUARTPS_IXR_RBRK    0x00002000U
+#define XUARTPS_IXR_TOVR    0x00001000U
+#define XUARTPS_IXR_TNFUL   0x00000800U
+#define XUARTPS_IXR_TTRIG   0x00000400U
+#define XUARTPS_IXR_DMS     0x00000200U
+#define XUARTPS_IXR_TOUT    0x00000100U
+#define XUARTPS_IXR_PARITY  0x00000080U
+#define XUARTPS_IXR_FRAMING 0x00000040U
+#define XUARTPS_IXR_OVER    0x00000020U
+#define XUARTPS_IXR_TXFULL  0x00000010U
+#define XUARTPS_IXR_TXEMPTY 0x00000008U
+#define XUARTPS_IXR_RXFULL  0x00000004U
+#define XUARTPS_IXR_RXEMPTY 0x00000002U
+#define XUARTPS_IXR_RXOVR   0x00000001U
+#define XUARTPS_IXR_MASK    0x00003FFFU
+
+#define XUARTPS_SR_TNFUL    0x00004000U
+#define XUARTPS_SR_TTRIG    0x00002000U
+#define XUARTPS_SR_FLOWDEL  0x00001000U
+#define XUARTPS_SR_TACTIVE  0x00000800U
+#define XUARTPS_SR_RACTIVE  0x00000400U
+#define XUARTPS_SR_TXFULL   0x00000010U
+#define XUARTPS_SR_TXEMPTY  0x00000008U
+#define XUARTPS_SR_RXFULL   0x00000004U
+#define XUARTPS_SR_RXEMPTY  0x00000002U
+#define XUARTPS_SR_RXOVR    0x00000001U
+
+#define XUARTPS_MODEMCR_RTS 0x00000002U
+#define XUARTPS_MODEMCR_DTR 0x00000001U
+
+u32 host_uart_read(UINTPTR base, u32 offset);
+void host_uart_write(UINTPTR base, u32 offset, u32 value);
+
+#define XUartPs_ReadReg(BaseAddress, RegOffset) \
+  host_uart_read((BaseAddress), (RegOffset))
+#define XUartPs_WriteReg(BaseAddress, RegOffset, RegisterValue) \
+  host_uart_write((BaseAddress), (RegOffset), (RegisterValue))
+
+#define XUartPs_IsReceiveData(BaseAddress) \
+  (!((XUartPs_ReadReg((BaseAddress), XUARTPS_SR_OFFSET) & \
+      XUARTPS_SR_RXEMPTY) == XUARTPS_SR_RXEMPTY))
+#define XUartPs_IsTransmitFull(BaseAddress) \
+  ((XUartPs_ReadReg((BaseAddress), XUARTPS_SR_OFFSET) & \
+    XUARTPS_SR_TXFULL) == XUARTPS_SR_TXFULL)
+
+void XUartPs_SendByte(UINTPTR BaseAddress, u8 Data);
+u8 XUartPs_RecvByte(UINTPTR BaseAddress);
+
+#endif
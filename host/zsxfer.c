@@ -0,0 +1,701 @@
+/*
+    Copyright 2018 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ zsxfer - host side of the ZynqShell binary transfer protocol.
+
+ Talks to ZynqShell over a serial device (or the pty of the host build):
+
+   zsxfer <tty> upload <type> <file> [ID] [-z]
+   zsxfer <tty> download <array_id> <file> [raw|hex|base64] [offset count] [-z]
+   zsxfer <tty> mread <address> <num_bytes> <file> [raw|hex|base64]
+
+ -z sends the data as an LZ4 frame, packed on one side and unpacked
+ on the other, which makes data with many zeros or repeats go over
+ the line several times faster.
+
+ The protocols are described next to bin_receive() and dump_bytes()
+ in zynqshell.c.
+ The baud rate of a real serial device is taken from ZS_BAUD
+ (default 115200).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BIN_BLOCK_SIZE  1024
+#define BIN_MAX_RETRIES 10
+#define BIN_TIMEOUT_MS  5000
+
+#define BIN_SOH 0x01
+#define BIN_EOT 0x04
+#define BIN_ACK 0x06
+#define BIN_NAK 0x15
+#define BIN_CAN 0x18
+
+/* Must match the types table in zynqshell.c */
+static const char *type_str[] = { "byte", "int", "uint", "float",
+                                  "int8", "int16", "uint16", "fp16",
+                                  "q7", "q15", "q16", "double" };
+static const int  type_size[] = { 1, 4, 4, 4, 1, 2, 2, 2, 1, 2, 4, 8 };
+
+static int tty = -1;
+
+/* ************************************************************
+ * Helpers
+ * ********************************************************* */
+
+static uint32_t crc32_table[256];
+
+static void crc32_init(void) {
+  uint32_t i, j, c;
+  for (i = 0; i < 256; i ++) {
+    c = i;
+    for (j = 0; j < 8; j ++)
+      c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+    crc32_table[i] = c;
+  }
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+  size_t i;
+  crc = ~crc;
+  for (i = 0; i < len; i ++)
+    crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static void put_le16(uint8_t *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static speed_t baud_flag(int baud) {
+  switch (baud) {
+  case 9600:    return B9600;
+  case 57600:   return B57600;
+  case 230400:  return B230400;
+  case 460800:  return B460800;
+  case 921600:  return B921600;
+  case 1000000: return B1000000;
+  case 2000000: return B2000000;
+  case 3000000: return B3000000;
+  default:      return B115200;
+  }
+}
+
+static int open_tty(const char *path) {
+  struct termios t;
+  const char *baud = getenv("ZS_BAUD");
+
+  tty = open(path, O_RDWR | O_NOCTTY);
+  if (tty < 0) {
+    perror(path);
+    return -1;
+  }
+  if (tcgetattr(tty, &t) == 0) {
+    cfmakeraw(&t);
+    cfsetspeed(&t, baud_flag(baud ? atoi(baud) : 115200));
+    tcsetattr(tty, TCSANOW, &t);
+  }
+  return 0;
+}
+
+static int send_all(const void *buf, size_t len) {
+  const uint8_t *p = buf;
+  while (len) {
+    ssize_t r = write(tty, p, len);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    p += r;
+    len -= r;
+  }
+  return 0;
+}
+
+/* Returns a byte, or -1 on timeout */
+static int recv_byte(int timeout_ms) {
+  struct pollfd p;
+  uint8_t c;
+
+  p.fd = tty;
+  p.events = POLLIN;
+  if (poll(&p, 1, timeout_ms) <= 0) return -1;
+  if (read(tty, &c, 1) != 1) return -1;
+  return c;
+}
+
+/* Read shell output until the string key has been seen.
+   Everything before key is copied to stdout when echo is set. */
+static int wait_for(const char *key, int timeout_ms, int echo) {
+  size_t matched = 0, klen = strlen(key);
+  int c;
+
+  while (matched < klen) {
+    if ((c = recv_byte(timeout_ms)) < 0) return -1;
+    if (c == key[matched]) {
+      matched++;
+    } else {
+      if (echo) fwrite(key, 1, matched, stdout);
+      matched = (c == key[0]);
+      if (!matched && echo) putchar(c);
+    }
+  }
+  return 0;
+}
+
+/* Read one "\n\r" terminated line of shell output */
+static int read_line(char *buf, size_t size, int timeout_ms) {
+  size_t n = 0;
+  int c;
+  while (n < size - 1) {
+    if ((c = recv_byte(timeout_ms)) < 0) return -1;
+    if (c == '\n') {
+      if (recv_byte(timeout_ms) != '\r') return -1;
+      break;
+    }
+    buf[n++] = c;
+  }
+  buf[n] = 0;
+  return 0;
+}
+
+/* Print whatever the shell says until it is back at its prompt */
+static void drain_to_prompt(void) {
+  if (wait_for("> ", 2000, 1) < 0)
+    fprintf(stderr, "zsxfer: no prompt from shell\n");
+  fflush(stdout);
+}
+
+/* ************************************************************
+ * LZ4 frames, for upload -z and download -z
+ *
+ * The same frames as the -z options of the shell make and take (see
+ * "Compression" in zynqshell.c): linked 1 MB blocks, with the content
+ * size and checksum. Packing is greedy with one hash table.
+ * ********************************************************* */
+
+#define LZ4_MAGIC      0x184D2204
+#define LZ4_BLOCK_SIZE (1024 * 1024)
+#define LZ4_HASH_BITS  12
+#define LZ4_MAX_OFFSET 65535
+
+static uint32_t get_le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t rotl32(uint32_t x, int r) {
+  return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxh32(const uint8_t *p, size_t len) {
+  static const uint32_t P1 = 2654435761U, P2 = 2246822519U,
+    P3 = 3266489917U, P4 = 668265263U, P5 = 374761393U;
+  const uint8_t *end = p + len;
+  uint32_t h, v[4], i;
+
+  if (len >= 16) {
+    v[0] = P1 + P2;
+    v[1] = P2;
+    v[2] = 0;
+    v[3] = -P1;
+    do {
+      for (i = 0; i < 4; i ++, p += 4)
+        v[i] = rotl32(v[i] + get_le32(p) * P2, 13) * P1;
+    } while (p + 16 <= end);
+    h = rotl32(v[0], 1) + rotl32(v[1], 7) + rotl32(v[2], 12) + rotl32(v[3], 18);
+  } else {
+    h = P5;
+  }
+  h += len;
+  for (; p + 4 <= end; p += 4) h = rotl32(h + get_le32(p) * P3, 17) * P4;
+  for (; p < end; p ++) h = rotl32(h + *p * P5, 11) * P1;
+  h ^= h >> 15;
+  h *= P2;
+  h ^= h >> 13;
+  h *= P3;
+  return h ^ (h >> 16);
+}
+
+static uint8_t *lz4_put_len(uint8_t *op, size_t len) {
+  for (; len >= 255; len -= 255) *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+static uint8_t *lz4_sequence(uint8_t *op, const uint8_t *lit, size_t nlit,
+                             size_t off, size_t ml) {
+  uint8_t *token = op++;
+
+  *token = (nlit < 15 ? nlit : 15) << 4;
+  if (nlit >= 15) op = lz4_put_len(op, nlit - 15);
+  memcpy(op, lit, nlit);
+  op += nlit;
+  if (ml) {
+    *op++ = off;
+    *op++ = off >> 8;
+    ml -= 4;
+    *token |= ml < 15 ? ml : 15;
+    if (ml >= 15) op = lz4_put_len(op, ml - 15);
+  }
+  return op;
+}
+
+/* Block of base[start, end), matches may reach into earlier blocks */
+static size_t lz4_encode_block(const uint8_t *base, size_t start, size_t end,
+                               uint8_t *dst, uint32_t *table) {
+  size_t i = start, anchor = start, misses = 0, m, len;
+  uint32_t h, v;
+  uint8_t *op = dst;
+
+  while (end - start > 12 && i <= end - 12) {
+    memcpy(&v, base + i, 4);
+    h = (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+    m = table[h];
+    table[h] = i + 1;
+    if (m == 0 || i - (m - 1) > LZ4_MAX_OFFSET ||
+        memcmp(base + m - 1, base + i, 4) != 0) {
+      i += 1 + (misses++ >> 6);
+      continue;
+    }
+    for (m--; i > anchor && m > 0 && base[i - 1] == base[m - 1]; i--, m--);
+    for (len = 4; i + len + 5 < end && base[i + len] == base[m + len]; len++);
+    op = lz4_sequence(op, base + anchor, i - anchor, i - m, len);
+    i += len;
+    anchor = i;
+    misses = 0;
+  }
+  return lz4_sequence(op, base + anchor, end - anchor, 0, 0) - dst;
+}
+
+/* data as an LZ4 frame, in a buffer to free */
+static uint8_t *lz4_pack(const uint8_t *data, size_t size, size_t *packed) {
+  static uint32_t table[1 << LZ4_HASH_BITS];
+  uint8_t *out = malloc(size + size / 255 + (size / LZ4_BLOCK_SIZE + 1) * 24 + 32);
+  size_t off, end, len, n = 15;
+
+  memset(table, 0, sizeof(table));
+  put_le32(out, LZ4_MAGIC);
+  out[4] = 0x4C; /* version 1, content size and checksum, linked blocks */
+  out[5] = 6 << 4; /* 1 MB blocks */
+  put_le32(out + 6, size);
+  put_le32(out + 10, (uint64_t)size >> 32);
+  out[14] = xxh32(out + 4, 10) >> 8;
+  for (off = 0; off < size; off = end) {
+    end = size - off > LZ4_BLOCK_SIZE ? off + LZ4_BLOCK_SIZE : size;
+    len = lz4_encode_block(data, off, end, out + n + 4, table);
+    if (len >= end - off) {
+      len = end - off;
+      memcpy(out + n + 4, data + off, len);
+      put_le32(out + n, len | 0x80000000);
+    } else {
+      put_le32(out + n, len);
+    }
+    n += 4 + len;
+  }
+  put_le32(out + n, 0);
+  put_le32(out + n + 4, xxh32(data, size));
+  *packed = n + 8;
+  return out;
+}
+
+static int lz4_decode_block(const uint8_t *ip, const uint8_t *iend,
+                            uint8_t *dst, size_t *out, size_t cap) {
+  size_t lit, ml, off;
+  int b;
+
+  for (;;) {
+    if (ip == iend) return -1;
+    lit = *ip >> 4;
+    ml = (*ip++ & 15) + 4;
+    if (lit == 15) do {
+        if (ip == iend) return -1;
+        lit += b = *ip++;
+      } while (b == 255);
+    if (lit > (size_t)(iend - ip) || lit > cap - *out) return -1;
+    memcpy(dst + *out, ip, lit);
+    *out += lit;
+    ip += lit;
+    if (ip == iend) return 0;
+    if (iend - ip < 2) return -1;
+    off = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (ml == 19) do {
+        if (ip == iend) return -1;
+        ml += b = *ip++;
+      } while (b == 255);
+    if (off == 0 || off > *out || ml > cap - *out) return -1;
+    for (; ml; ml--, (*out)++) dst[*out] = dst[*out - off];
+  }
+}
+
+/* Unpack an LZ4 frame with a content size, into a buffer to free */
+static uint8_t *lz4_unpack(const uint8_t *in, size_t len, size_t *size) {
+  const uint8_t *end = in + len;
+  uint8_t *out;
+  size_t n, cap, done = 0;
+  uint32_t word = 1;
+  int flags;
+
+  if (len < 15 || get_le32(in) != LZ4_MAGIC || (in[4] & 0xC9) != 0x48) {
+    fprintf(stderr, "zsxfer: not an LZ4 frame with a content size\n");
+    return NULL;
+  }
+  flags = in[4];
+  cap = get_le32(in + 6) | (size_t)get_le32(in + 10) << 32;
+  out = malloc(cap ? cap : 1);
+  for (in += 15; in + 4 <= end; in += n) {
+    word = get_le32(in);
+    in += 4;
+    if (word == 0) break;
+    n = (word & 0x7FFFFFFF) + (flags & 0x10 ? 4 : 0);
+    if (n > (size_t)(end - in)) goto corrupt;
+    if (word & 0x80000000) {
+      if ((word & 0x7FFFFFFF) > cap - done) goto corrupt;
+      memcpy(out + done, in, word & 0x7FFFFFFF);
+      done += word & 0x7FFFFFFF;
+    } else if (lz4_decode_block(in, in + (word & 0x7FFFFFFF), out, &done, cap) < 0) {
+      goto corrupt;
+    }
+  }
+  if (word != 0 || done != cap ||
+      ((flags & 0x04) && (in + 4 > end || get_le32(in) != xxh32(out, done))))
+    goto corrupt;
+  *size = done;
+  return out;
+
+ corrupt:
+  fprintf(stderr, "zsxfer: corrupt LZ4 frame\n");
+  free(out);
+  return NULL;
+}
+
+/* ************************************************************
+ * Upload
+ * ********************************************************* */
+
+static int send_frame(const uint8_t *frame, size_t len) {
+  int tries, c;
+
+  for (tries = 0; tries < BIN_MAX_RETRIES; tries ++) {
+    if (send_all(frame, len) < 0) return -1;
+    c = recv_byte(BIN_TIMEOUT_MS);
+    if (c == BIN_ACK) return 0;
+    if (c == BIN_CAN) {
+      fprintf(stderr, "zsxfer: transfer cancelled by shell\n");
+      return -1;
+    }
+  }
+  fprintf(stderr, "zsxfer: too many retries\n");
+  return -1;
+}
+
+static int upload(const char *type, const char *file, const char *id, int z) {
+  int i, esize = 0;
+  FILE *f;
+  struct stat st;
+  uint8_t *payload, *data;
+  size_t size;
+  uint8_t hdr[16];
+  uint8_t frame[BIN_BLOCK_SIZE + 9];
+  char cmd[256], line[256];
+  size_t bytes, off;
+  unsigned int ready_bytes = 0, ready_block = 0;
+  uint32_t seq;
+  double t0, t1;
+  int r = 1;
+
+  for (i = 0; i < (int)(sizeof(type_str) / sizeof(type_str[0])); i ++)
+    if (strcmp(type, type_str[i]) == 0) esize = type_size[i];
+  if (!esize) {
+    fprintf(stderr, "zsxfer: unknown type %s\n", type);
+    return 1;
+  }
+
+  if (stat(file, &st) != 0 || !(f = fopen(file, "rb"))) {
+    perror(file);
+    return 1;
+  }
+  bytes = st.st_size;
+  if (bytes == 0 || bytes % esize) {
+    fprintf(stderr, "zsxfer: %s is not a whole number of %s elements\n",
+            file, type);
+    fclose(f);
+    return 1;
+  }
+  payload = malloc(bytes);
+  if (fread(payload, 1, bytes, f) != bytes) {
+    perror(file);
+    fclose(f);
+    free(payload);
+    return 1;
+  }
+  fclose(f);
+
+  /* Send the frame in place of the data, the shell unpacks it */
+  size = bytes;
+  data = payload;
+  if (z) payload = lz4_pack(data, size, &bytes);
+
+  snprintf(cmd, sizeof(cmd), "loadArrayBin %s %zu%s%s",
+           type, size / esize, id ? " " : "", id ? id : "");
+  if (z) snprintf(cmd + strlen(cmd), sizeof(cmd) - strlen(cmd), " -z %zu", bytes);
+  strcat(cmd, "\r");
+  send_all(cmd, strlen(cmd));
+
+  if (wait_for("ZSB READY ", 2000, 0) < 0 ||
+      read_line(line, sizeof(line), 2000) < 0 ||
+      sscanf(line, "%u %u", &ready_bytes, &ready_block) != 2 ||
+      ready_bytes != bytes || ready_block != BIN_BLOCK_SIZE) {
+    fprintf(stderr, "zsxfer: shell did not accept the upload\n");
+    drain_to_prompt();
+    goto done;
+  }
+
+  t0 = now_s();
+
+  memcpy(hdr, "ZSB1", 4);
+  put_le32(hdr + 4, bytes);
+  put_le32(hdr + 8, crc32_update(0, payload, bytes));
+  put_le32(hdr + 12, crc32_update(0, hdr, 12));
+  if (send_frame(hdr, sizeof(hdr)) < 0) goto fail;
+
+  for (off = 0, seq = 0; off < bytes; off += BIN_BLOCK_SIZE, seq ++) {
+    size_t len = bytes - off < BIN_BLOCK_SIZE ? bytes - off : BIN_BLOCK_SIZE;
+    frame[0] = BIN_SOH;
+    put_le16(frame + 1, seq & 0xFFFF);
+    put_le16(frame + 3, len);
+    memcpy(frame + 5, payload + off, len);
+    put_le32(frame + 5 + len, crc32_update(0, frame + 1, len + 4));
+    if (send_frame(frame, len + 9) < 0) goto fail;
+  }
+
+  frame[0] = BIN_EOT;
+  if (send_frame(frame, 1) < 0) goto fail;
+
+  t1 = now_s();
+  drain_to_prompt();
+  if (z)
+    fprintf(stderr, "zsxfer: %zu bytes (%zu packed, %.2f:1) in %.3f s (%.1f KB/s)\n",
+            size, bytes, (double)size / bytes, t1 - t0, size / 1024.0 / (t1 - t0));
+  else
+    fprintf(stderr, "zsxfer: %zu bytes in %.3f s (%.1f KB/s)\n",
+            bytes, t1 - t0, bytes / 1024.0 / (t1 - t0));
+  r = 0;
+  goto done;
+
+ fail:
+  frame[0] = BIN_CAN;
+  send_all(frame, 1);
+  drain_to_prompt();
+ done:
+  if (payload != data) free(payload);
+  free(data);
+  return r;
+}
+
+/* ************************************************************
+ * Download
+ * ********************************************************* */
+
+/* Next non white space character of the dump, or -1 */
+static int recv_text(void) {
+  int c;
+  do {
+    c = recv_byte(BIN_TIMEOUT_MS);
+  } while (c == '\n' || c == '\r' || c == ' ');
+  return c;
+}
+
+static int hex_value(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static int base64_value(int c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  if (c == '=') return 0;
+  return -1;
+}
+
+static int recv_dump(uint8_t *data, size_t bytes, const char *fmt) {
+  size_t i, j;
+  int c, v[4];
+
+  if (strcmp(fmt, "raw") == 0) {
+    for (i = 0; i < bytes; i ++) {
+      if ((c = recv_byte(BIN_TIMEOUT_MS)) < 0) return -1;
+      data[i] = c;
+    }
+  } else if (strcmp(fmt, "hex") == 0) {
+    for (i = 0; i < bytes; i ++) {
+      v[0] = hex_value(recv_text());
+      v[1] = hex_value(recv_text());
+      if (v[0] < 0 || v[1] < 0) return -1;
+      data[i] = (v[0] << 4) | v[1];
+    }
+  } else {
+    for (i = 0; i < bytes; i += 3) {
+      uint32_t q;
+      for (j = 0; j < 4; j ++) {
+        if ((v[j] = base64_value(recv_text())) < 0) return -1;
+      }
+      q = (v[0] << 18) | (v[1] << 12) | (v[2] << 6) | v[3];
+      for (j = 0; j < 3 && i + j < bytes; j ++)
+        data[i + j] = q >> (16 - 8 * j);
+    }
+  }
+  return 0;
+}
+
+/* Send cmd and store the framed dump it answers with in file */
+static int download(const char *cmd, const char *file) {
+  char line[256], fmt[16], enc[16] = "";
+  unsigned int bytes = 0, crc = 0;
+  uint8_t *data, *packed;
+  size_t size;
+  FILE *f;
+  double t0, t1;
+
+  send_all(cmd, strlen(cmd));
+  if (wait_for("ZSD ", 2000, 0) < 0 ||
+      read_line(line, sizeof(line), 2000) < 0 ||
+      sscanf(line, "%15s %u %15s", fmt, &bytes, enc) < 2) {
+    fprintf(stderr, "zsxfer: shell did not start a dump\n");
+    drain_to_prompt();
+    return 1;
+  }
+
+  t0 = now_s();
+  data = malloc(bytes ? bytes : 1);
+  if (recv_dump(data, bytes, fmt) < 0 ||
+      wait_for("ZSD END ", 2000, 0) < 0 ||
+      read_line(line, sizeof(line), 2000) < 0 ||
+      sscanf(line, "%x", &crc) != 1) {
+    fprintf(stderr, "zsxfer: dump was cut short\n");
+    drain_to_prompt();
+    free(data);
+    return 1;
+  }
+  t1 = now_s();
+  drain_to_prompt();
+
+  if (crc32_update(0, data, bytes) != crc) {
+    fprintf(stderr, "zsxfer: checksum mismatch\n");
+    free(data);
+    return 1;
+  }
+  size = bytes;
+  if (strcmp(enc, "lz4") == 0) {
+    packed = data;
+    data = lz4_unpack(packed, bytes, &size);
+    free(packed);
+    if (!data) return 1;
+  }
+  if (!(f = fopen(file, "wb")) || fwrite(data, 1, size, f) != size) {
+    perror(file);
+    if (f) fclose(f);
+    free(data);
+    return 1;
+  }
+  fclose(f);
+  free(data);
+  if (strcmp(enc, "lz4") == 0)
+    fprintf(stderr, "zsxfer: %zu bytes (%s, %u packed, %.2f:1) in %.3f s (%.1f KB/s)\n",
+            size, fmt, bytes, (double)size / bytes, t1 - t0,
+            size / 1024.0 / (t1 - t0));
+  else
+    fprintf(stderr, "zsxfer: %u bytes (%s) in %.3f s (%.1f KB/s)\n",
+            bytes, fmt, t1 - t0, bytes / 1024.0 / (t1 - t0));
+  return 0;
+}
+
+/* ************************************************************
+ * Main
+ * ********************************************************* */
+
+static void usage(void) {
+  fprintf(stderr,
+          "Usage: zsxfer <tty> upload <type> <file> [ID] [-z]\n"
+          "       zsxfer <tty> download <array_id> <file> [raw|hex|base64] [offset count] [-z]\n"
+          "       zsxfer <tty> mread <address> <num_bytes> <file> [raw|hex|base64]\n");
+}
+
+int main(int argc, char **argv) {
+  int r = 1, i, z = 0;
+  char cmd[256];
+
+  for (i = 3; i < argc; i ++) {
+    if (strcmp(argv[i], "-z") != 0) continue;
+    for (z = 1; i + 1 < argc; i ++) argv[i] = argv[i + 1];
+    argc--;
+    break;
+  }
+  if (argc < 3) {
+    usage();
+    return 1;
+  }
+  crc32_init();
+  if (open_tty(argv[1]) < 0) return 1;
+
+  if (strcmp(argv[2], "upload") == 0 && (argc == 5 || argc == 6)) {
+    r = upload(argv[3], argv[4], argc == 6 ? argv[5] : NULL, z);
+  } else if (strcmp(argv[2], "download") == 0 &&
+             (argc == 5 || argc == 6 || argc == 8)) {
+    snprintf(cmd, sizeof(cmd), "dumpArray %s %s%s%s%s%s%s\r",
+             argv[3], argc > 5 ? argv[5] : "raw",
+             argc == 8 ? " " : "", argc == 8 ? argv[6] : "",
+             argc == 8 ? " " : "", argc == 8 ? argv[7] : "",
+             z ? " -z" : "");
+    r = download(cmd, argv[4]);
+  } else if (strcmp(argv[2], "mread") == 0 && (argc == 6 || argc == 7)) {
+    snprintf(cmd, sizeof(cmd), "mread %s %s %s\r",
+             argc == 7 ? argv[6] : "raw", argv[3], argv[4]);
+    r = download(cmd, argv[5]);
+  } else {
+    usage();
+  }
+  close(tty);
+  return r;
+}
@@ -27,12 +27,26 @@
 #include "xil_cache.h"
 #include "xil_cache_l.h"
 #include "xil_io.h"
+#include "xtime_l.h"
+#include "xuartps_hw.h"
 
 #include "xdevcfg.h"
+#include "xdmaps.h"
+#include "xscugic.h"
+#include "xil_exception.h"
 
 #include <malloc.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define USE_NEON
+#endif
 
 #include "ff.h"
 #include "ffconf.h"
@@ -48,33 +62,48 @@ int inputline(char *buffer, int size);
 
 #define DCFG_DEVICE_ID  XPAR_XDCFG_0_DEVICE_ID
 
-/* ************************************************************
- * Application specific (To be removed)
- * ********************************************************* */
-
-#define CONTROL    (0x43c00000)
-#define INPUT_REG  (0x43c00010)
-#define OUTPUT_REG (0x43c00018)
-
-void init_app() {
-  /* There are attributes defined in xil_mmu.h now.
-   * I've been setting this far from correct in the past, it seems
-   */
-  Xil_SetTlbAttributes(CONTROL, NORM_NONCACHE);
-}
+/* On-chip memory, when all four 64 KB banks are mapped high. The last
+   512 bytes are left alone, CPU1 takes its start address from there. */
+#define OCM_BASE        0xFFFC0000
+#define OCM_ARENA_SIZE  (0x40000 - 0x200)
 
+#define SLCR_LOCK          0xF8000004
+#define SLCR_UNLOCK        0xF8000008
+#define SLCR_OCM_CFG       0xF8000910
+#define SLCR_LOCK_KEY      0x767B
+#define SLCR_UNLOCK_KEY    0xDF0D
+#define OCM_CFG_RAM_HI_ALL 0xF
 
 /* ************************************************************
  * CONFIGURATION
  * ********************************************************* */
 #define USE_SD
+#define USE_UART_IRQ /* interrupt driven UART through ring buffers */
+#define USE_OCM      /* arrays can be placed in on-chip memory */
+
+#define DDR_ARENA_SIZE (64 * 1024 * 1024) /* DDR reserved for array data */
+
+/* The interrupt of the UART at STDOUT_BASEADDRESS */
+#define UART_INT_IRQ_ID XPAR_XUARTPS_1_INTR
+/* The DevC (PCAP) interrupt, used by background FPGA programming */
+#define DCFG_INT_IRQ_ID XPAR_XDCFG_0_INTR
+#define INTC_DEVICE_ID  XPAR_SCUGIC_SINGLE_DEVICE_ID
+
+#define DMA_DEVICE_ID    XPAR_XDMAPS_1_DEVICE_ID /* the non-secure PL330 */
+#define DMA_DONE_IRQ_ID  XPAR_XDMAPS_0_DONE_INTR_0
+#define DMA_FAULT_IRQ_ID XPAR_XDMAPS_0_FAULT_INTR
+#define DMA_CHANNEL      0
 
 /* ************************************************************
  * Globals
  * ********************************************************* */
 int running = 1; /* Start out in running state */
+int echo = 1; /* echo input characters back to the terminal */
 
 XDcfg DcfgInstance; /* Device configuration "instance" */
+XScuGic IntcInstance; /* Interrupt controller "instance" */
+XDmaPs DmaInstance; /* PS DMA controller (PL330) "instance" */
+int intc_ok = 0;
 
 #ifdef USE_SD
 #define MAX_PATH 256
@@ -83,24 +112,74 @@ int sd_ok = 0; /* assume not ok to begin with */
 char pwd[MAX_PATH] = "";
 #endif
 
-#define BYTE_TYPE 0
-#define INT_TYPE 1
-#define UINT_TYPE 2
-#define FLOAT_TYPE 3
-
-const char *type_str[] = { "byte", "int", "uint", "float" };
-const int  type_size[] = { 1, 4, 4, 4 };
+/* Element types. The first four are the original ones and keep their
+   numbers. Everything that depends on the type (size, parsing,
+   printing) goes through the types table. */
+#define BYTE_TYPE   0
+#define INT_TYPE    1
+#define UINT_TYPE   2
+#define FLOAT_TYPE  3
+#define INT8_TYPE   4
+#define INT16_TYPE  5
+#define UINT16_TYPE 6
+#define FP16_TYPE   7
+#define Q7_TYPE     8
+#define Q15_TYPE    9
+#define Q16_TYPE    10
+#define DOUBLE_TYPE 11
+#define NUM_TYPES   12
+
+#define TK_INT   0 /* two's complement integer */
+#define TK_UINT  1 /* unsigned integer */
+#define TK_FLOAT 2 /* IEEE 754 binary16, binary32 or binary64 */
+#define TK_FIXED 3 /* signed fixed point with frac fraction bits */
 
-#define MAX_ALLOCATED_ARRAYS 20
 typedef struct {
-  int available;
+  const char *name;
+  int size; /* bytes per element */
+  int kind;
+  int frac;
+} type_info;
+
+const type_info types[NUM_TYPES] = {
+  { "byte",   1, TK_UINT,  0 },
+  { "int",    4, TK_INT,   0 },
+  { "uint",   4, TK_UINT,  0 },
+  { "float",  4, TK_FLOAT, 0 },
+  { "int8",   1, TK_INT,   0 },
+  { "int16",  2, TK_INT,   0 },
+  { "uint16", 2, TK_UINT,  0 },
+  { "fp16",   2, TK_FLOAT, 0 },
+  { "q7",     1, TK_FIXED, 7 },  /* Q0.7,   [-1, 1)         */
+  { "q15",    2, TK_FIXED, 15 }, /* Q0.15,  [-1, 1)         */
+  { "q16",    4, TK_FIXED, 16 }, /* Q15.16, [-32768, 32768) */
+  { "double", 8, TK_FLOAT, 0 },
+};
+
+#define MAX_ARRAY_ID   65535
+#define MAX_ARRAY_NAME 32
+
+#define OWNER_CPU 0
+#define OWNER_PL  1
+
+struct arena_block;
+
+typedef struct array {
+  int id;
+  char name[MAX_ARRAY_NAME]; /* empty if the array has no name */
   char *data;
   int type;
   int size; /* in elements of type type */
+  struct arena_block *mem; /* where data lives, see "Array memory",
+                              NULL for a view (mapArray, sliceArray) */
+  struct array *base; /* for a slice, the array it is cut from */
+  int views; /* slices cut from this array */
+  int pinned; /* > 0 while a background transfer uses the data */
+  int owner; /* OWNER_CPU or OWNER_PL, see "Array cache coherency" */
+  u32 dirty_lo, dirty_hi; /* bytes the CPU may hold dirty in the cache */
+  struct array *next_name; /* hash chain */
 } array;
 
-array arrays[MAX_ALLOCATED_ARRAYS];
-
 #define MAX_PROMPT_SIZE 256
 char prompt[MAX_PROMPT_SIZE] = "> ";
 
@@ -117,14 +196,44 @@ const char *cmds[] = {"help"
                       ,"show"
                       ,"loadArray"
                       ,"mkArray"
+                      ,"rmArray"
+                      ,"mapArray"
+                      ,"sliceArray"
+                      ,"loadArrayBin"
+                      ,"dumpArray"
+                      ,"echo"
+                      ,"flow"
+                      ,"stats"
+                      ,"time"
+                      ,"bench"
+                      ,"membw"
+                      ,"watch"
+                      ,"pulseAndWatch"
+                      ,"arrayOp"
+                      ,"checksum"
                       ,"cf"
                       ,"ci"
+                      ,"set"
 #ifdef USE_SD
                       ,"ls"
                       ,"sdLoad"
                       ,"sdStore"
 #endif
                       ,"programFPGA"
+                      ,"cacheBitstream"
+                      ,"useBitstream"
+                      ,"rmBitstream"
+                      ,"fpgaStatus"
+                      ,"fpgaWait"
+                      ,"copyArray"
+                      ,"dmaWait"
+                      ,"accel"
+                      ,"rmAccel"
+                      ,"run"
+#ifdef USE_SD
+                      ,"programFPGAFile"
+                      ,"source"
+#endif
                       };
 
 const char *hlp_str =
@@ -135,659 +244,7214 @@ const char *hlp_str =
   "mread <type> <address> [num_elements] - \n\r"\
   "      Read data from memory location <address> and interpret it as\n\r"\
   "      type <type>.\n\r"\
-  "      Valid types: int - 32bit signed integer.\n\r"\
-  "                   uint - 32bit unsigned integer.\n\r"\
-  "                   float - 32bit floating point.\n\r"\
-  "mwrite <type> <address> <value>\n\r"\
+  "      Valid types: byte, int8 - 8bit unsigned, signed integer.\n\r"\
+  "                   uint16, int16 - 16bit unsigned, signed integer.\n\r"\
+  "                   uint, int - 32bit unsigned, signed integer.\n\r"\
+  "                   fp16, float, double - 16, 32, 64bit floating point.\n\r"\
+  "                   q7, q15 - 8, 16bit fixed point in [-1, 1).\n\r"\
+  "                   q16 - 32bit fixed point, 16 fraction bits.\n\r"\
+  "      All commands that take a <type> accept these.\n\r"\
+  "mread <raw|hex|base64> <address> <num_bytes> - \n\r"\
+  "      Dump a memory range in the same framing as dumpArray.\n\r"\
+  "mwrite <type> <address> <value> [value ...] - Write values to\n\r"\
+  "      consecutive elements starting at <address> (hex).\n\r"\
   "show <what> - \n\r"\
   "     show information about <what>. \n\r"\
   "     Valid whats: arrays -  show information about allocated arrays.\n\r"\
-  "                  array <id> - show array <id>.\n\r"\
-  "loadArray <type> <num_elements> [ID] - Load elements into an array.\n\r"\
-  "     Will expext <num_elements> lines of input containing\n\r"\
-  "     data that is parseable as <type>.\n\r"\
-  "mkArray <type> <num_elements> [ID] - Allocate an array.\n\r"\
-  "sdLoad <filename> <array_id> - Load a file from sd card into array of given id.\n\r"\
-  "sdStore <filename> <array_id> - Store array of given id into file.\n\r"\
-  "programFPGA <array_id> - Program FPGA using data stored in array.\n\r"\
-  "     Contents of array should be a valid FPGA configuration bitstream."\
-  "cf - Cache flush.\n\r"\
-  "ci - Cache invalidate.\n\r"\
+  "                  array <array> - show array <array>.\n\r"\
+  "                  uart - show UART statistics.\n\r"\
+  "                  heap - show use and fragmentation of array memory.\n\r"\
+  "                  bitstreams - show the bitstream cache.\n\r"\
+  "                  accels - show accelerators and their run times.\n\r"\
+  "Arrays are referred to by ID or by name. Where a command creates an\n\r"\
+  "     array, [ID|name] picks the ID or name (default: first free ID).\n\r"\
+  "loadArray <type> <num_elements> [ID|name] - Load elements into an array.\n\r"\
+  "     Will expect <num_elements> values of <type>, any number per\n\r"\
+  "     line, separated by spaces or commas. Integers can be hex (0x).\n\r"\
+  "mkArray <type> <num_elements> [ID|name] - Allocate an array.\n\r"\
+  "     mkArray, loadArray, loadArrayBin and sdLoad take the options\n\r"\
+  "     -mem <ddr|ocm> (where to put the array, default ddr) and\n\r"\
+  "     -align <bytes> (a power of two, default and minimum 32).\n\r"\
+  "loadArrayBin <type> <num_elements> [ID|name] - Load elements into an array\n\r"\
+  "     using the framed binary protocol (see host/zsxfer.c).\n\r"\
+  "     Payload is sent in CRC32 checked blocks of 1024 bytes.\n\r"\
+  "     -z <packed_bytes>: the payload is an LZ4 frame of that size,\n\r"\
+  "     unpacked into the array as it comes in (zsxfer upload -z).\n\r"\
+  "dumpArray <array> [raw|hex|base64] [offset] [count] - \n\r"\
+  "     Dump (part of) an array for a host tool. Offset and count are in\n\r"\
+  "     elements, format defaults to hex. Output is framed by a\n\r"\
+  "     \"ZSD <format> <bytes>\" line and a \"ZSD END <crc32>\" line.\n\r"\
+  "     -z sends an LZ4 frame of the data instead (\"ZSD <format>\n\r"\
+  "     <bytes> lz4\").\n\r"\
+  "rmArray <array> [array ...] - Free arrays.\n\r"\
+  "mapArray <address> <type> <num_elements> [ID|name] - Make an array of\n\r"\
+  "     the memory at <address> (hex), without copying it, e.g. a\n\r"\
+  "     buffer the FPGA writes. Removing it leaves the memory alone.\n\r"\
+  "sliceArray <array> <offset> <count> [ID|name] - Make an array of\n\r"\
+  "     count elements of <array> from offset, sharing its memory.\n\r"\
+  "     <array> cannot be removed or reallocated while it has slices.\n\r"\
+  "sdLoad <filename> <array> [-type <type>] [-z] [-sum alg] - Load a\n\r"\
+  "     file from sd card into an array. An existing array that is large\n\r"\
+  "     enough is filled in place, otherwise a new one (of bytes, or\n\r"\
+  "     <type>) is made. With -z the file is an LZ4 frame (as made by\n\r"\
+  "     lz4 --content-size), unpacked while it is read.\n\r"\
+  "sdStore <filename> <array> [-o|-a] [-z] - Store array into a new file,\n\r"\
+  "     or overwrite (-o) or append to (-a) an existing one. -z packs\n\r"\
+  "     it as an LZ4 frame (lz4 -d unpacks it).\n\r"\
+  "programFPGA <array> [&] - Program FPGA using data stored in array.\n\r"\
+  "     Contents of array should be a valid FPGA configuration bitstream.\n\r"\
+  "     With & the shell returns at once and the transfer continues,\n\r"\
+  "     driven by the DevC interrupt. The array cannot be freed or\n\r"\
+  "     reloaded until it is done.\n\r"\
+  "cacheBitstream <name> <array> - Keep a copy of the bitstream in array\n\r"\
+  "     in the bitstream cache, under <name>.\n\r"\
+  "useBitstream <name> [&] - Program FPGA with a cached bitstream, unless\n\r"\
+  "     it is already the active configuration. Prints the switch time.\n\r"\
+  "     & programs in the background, as for programFPGA.\n\r"\
+  "fpgaStatus - Show state and progress of background programming.\n\r"\
+  "fpgaWait [timeout_ms] - Wait for background programming to end.\n\r"\
+  "     A transfer still running after timeout_ms is stopped.\n\r"\
+  "copyArray <dst> <src> [<offset> <count> ...] [&] - Copy src, or the\n\r"\
+  "     pieces of it given by offset and count (elements), one after\n\r"\
+  "     the other into dst with the PS DMA. dst is made if it does not\n\r"\
+  "     exist or is too small; a slice of an array copies into the\n\r"\
+  "     middle of it. With & the shell returns at once and both arrays\n\r"\
+  "     are in use until the copy is done.\n\r"\
+  "dmaWait [timeout_ms] - Wait for a background copy to end. A copy\n\r"\
+  "     still running after timeout_ms is stopped.\n\r"\
+  "accel <name> <base> [arg_offset ...] - Describe an accelerator with\n\r"\
+  "     an HLS style register block at <base> (in the PL, 40000000 to\n\r"\
+  "     bfffffff), with its arguments at base + arg_offset (all hex).\n\r"\
+  "     Options: -ctrl <offset> of the control register (default 0),\n\r"\
+  "     -bits <start> <done> <idle> (default 0 1 2), -irq <id> to wait\n\r"\
+  "     for ap_done by interrupt, -mhz <clock> of the kernel for cycle\n\r"\
+  "     counts (default 100).\n\r"\
+  "rmAccel <name> - Forget an accelerator.\n\r"\
+  "run <accel> [arg ...] [-timeout <ms>] - Set the argument registers,\n\r"\
+  "     start the kernel and time it until ap_done. @<array> passes\n\r"\
+  "     the address of an array, other arguments are integers or\n\r"\
+  "     floats (with a point). Default timeout is 1000 ms.\n\r"\
+  "rmBitstream <name> - Drop a bitstream from the cache.\n\r"\
+  "programFPGAFile <filename> - Program FPGA with a bitstream file on the\n\r"\
+  "     sd card. The file is streamed, reading from the card overlaps the\n\r"\
+  "     transfer into the FPGA.\n\r"\
+  "echo [on|off] - Turn echo of typed (or pasted) input on or off.\n\r"\
+  "flow [none|xonxoff|rtscts] - Select how the sender is held back when\n\r"\
+  "     the input buffer fills up. Default is xonxoff.\n\r"\
+  "stats [reset] - Show (or clear) call count, time and bytes moved for\n\r"\
+  "     every command that has been run.\n\r"\
+  "time <command ...> - Run a command and print how long it took.\n\r"\
+  "bench [-a <array>] [-f <file>] <N> [warmup] <command ...> - Run a\n\r"\
+  "     command warmup + N times with its output discarded and show\n\r"\
+  "     min, median, p99, max and mean time of the last N runs, and\n\r"\
+  "     MB/s for commands that move data. -a keeps the times (ns) in a\n\r"\
+  "     uint array, -f appends a line (build, command, runs, min,\n\r"\
+  "     median, p99, max us, MB/s) to a file on the sd card.\n\r"\
+  "membw <array> | <address> <bytes> [-min <bytes>] [-attr <attr>] -\n\r"\
+  "     Measure read, write (memset) and copy bandwidth (GB/s, copy\n\r"\
+  "     counts bytes copied) and load latency (pointer chase, ns) for\n\r"\
+  "     block sizes from -min (default 1024) up to the whole range.\n\r"\
+  "     The range is overwritten. -attr cached, nocache or device\n\r"\
+  "     maps it that way for the test (whole 1 MB sections only).\n\r"\
+  "watch [-mhz <clock>] <address> <mask> <value> [timeout_ms] - Spin on\n\r"\
+  "     the 32-bit word at <address> (hex) until (word & mask) == value\n\r"\
+  "     and show the time in ns and in cycles of a clock (default 100\n\r"\
+  "     MHz). Cached memory is read non-cacheable. Default timeout is\n\r"\
+  "     1000 ms, at most 4000.\n\r"\
+  "pulseAndWatch [-n <N>] [-a <array>] [-mhz <clock>] <waddr> <wval>\n\r"\
+  "     <raddr> <mask> <value> [timeout_ms] - Write wval to waddr, then\n\r"\
+  "     watch raddr, timing from the write. -n repeats it N times and\n\r"\
+  "     shows min, median, p99, max, mean and a histogram, -a keeps the\n\r"\
+  "     latencies (ns) in a uint array.\n\r"\
+  "arrayOp add|sub|mul <dst> <x> <y> - Element-wise x + y, x - y, x * y.\n\r"\
+  "arrayOp axpy <dst> <alpha> <x> <y> - alpha * x + y.\n\r"\
+  "arrayOp scale <dst> <alpha> <x> - alpha * x.\n\r"\
+  "arrayOp convert <dst> <type> <x> - x converted to <type>, rounded to\n\r"\
+  "     nearest and saturated.\n\r"\
+  "     x and y must have the same type and size. dst gets that type\n\r"\
+  "     (and is remade if it has another one) and can be x or y.\n\r"\
+  "     Integer and fixed point results saturate, alpha is a value of\n\r"\
+  "     the type of x. int, uint and float use NEON.\n\r"\
+  "checksum <array> | <address> <bytes> [crc32|xxh64] - CRC-32 (as\n\r"\
+  "     zlib, the default) or XXH64 of an array or memory range, read\n\r"\
+  "     from memory past the cache, with the time and MB/s.\n\r"\
+  "     loadArray, loadArrayBin, sdLoad and sdStore take -sum alg or\n\r"\
+  "     -sum alg=<hex> to print the checksum of the data moved or\n\r"\
+  "     fail if it is not <hex>.\n\r"\
+  "cf [array ...] - Hand arrays (default all) to the FPGA: write back\n\r"\
+  "     from the cache what the CPU has changed since it last had them.\n\r"\
+  "ci [array [offset count]] - The FPGA has written the array (default\n\r"\
+  "     all), or count elements from offset: drop cached copies.\n\r"\
+  "     Commands of the shell do this themselves, only the lines\n\r"\
+  "     needed, cf and ci are for designs driven by hand (mwrite).\n\r"\
+  "set [<name> [<value> | <a> <op> <b>]] - Set a variable, list them\n\r"\
+  "     (no arguments) or remove one (only a name). $name or ${name}\n\r"\
+  "     in a command is replaced by the value. op is + - * / or % on\n\r"\
+  "     integers.\n\r"\
+  "source [-k] <file> - Run the commands in a file on the sd card.\n\r"\
+  "     Lines starting with # are comments. \"repeat <N> [<var>] {\" runs\n\r"\
+  "     the lines up to a line with only } N times, with $var counting\n\r"\
+  "     from 0. Stops at the first failing command (unless -k) or on\n\r"\
+  "     Ctrl-C. autoexec.zs is run at boot.\n\r"\
   "----------------------------------------------------------------------\n\r";
 
 /* ************************************************************
- * Array management helper functions
+ * Interrupts
  * ********************************************************* */
 
-int freeArray(int id) {
-  if (id >= 0 && id < MAX_ALLOCATED_ARRAYS) {
-    if (!arrays[id].available) {
-      free(arrays[id].data);
-      arrays[id].data = NULL;
-      arrays[id].available = 1;
-      arrays[id].size = 0;
-      arrays[id].type = BYTE_TYPE;
-    }
-    return SUCCESS;
+int init_interrupts() {
+  XScuGic_Config *IntcConfig;
+  int status;
+
+  IntcConfig = XScuGic_LookupConfig(INTC_DEVICE_ID);
+  if (!IntcConfig) return FAILURE;
+
+  status = XScuGic_CfgInitialize(&IntcInstance, IntcConfig,
+                                 IntcConfig->CpuBaseAddress);
+  if (status != XST_SUCCESS) return FAILURE;
+
+  Xil_ExceptionInit();
+  Xil_ExceptionRegisterHandler(XIL_EXCEPTION_ID_INT,
+                               (Xil_ExceptionHandler)XScuGic_InterruptHandler,
+                               &IntcInstance);
+  Xil_ExceptionEnable();
+  intc_ok = 1;
+  return SUCCESS;
+}
+
+/* ************************************************************
+ * UART
+ *
+ * With USE_UART_IRQ, outbyte (and so xil_printf) only appends to
+ * tx_ring. The TX FIFO empty interrupt moves the ring into the
+ * UART FIFO, so commands return as soon as their output is queued.
+ * uart_flush() waits for everything queued to be sent and is
+ * called before the prompt waits for input.
+ *
+ * Received bytes are moved from the RX FIFO into rx_ring by the
+ * interrupt handler (RX trigger level and receiver timeout) and
+ * inbyte takes them from there. When rx_ring fills above
+ * RX_HIGH_WATER the sender is stopped with XOFF (or by releasing
+ * RTS) until the shell has caught up to RX_LOW_WATER.
+ *
+ * While out_quiet is set (bench) outbyte throws output away.
+ * ********************************************************* */
+
+int out_quiet = 0;
+
+#ifdef USE_UART_IRQ
+
+#define UART_BASEADDR   STDOUT_BASEADDRESS
+#define UART_FIFO_SIZE  64
+#define TX_RING_SIZE    16384 /* must be a power of two */
+#define RX_RING_SIZE    32768 /* must be a power of two */
+#define RX_HIGH_WATER   (RX_RING_SIZE - 4096)
+#define RX_LOW_WATER    (RX_RING_SIZE / 4)
+#define RX_TRIGGER      32    /* RX FIFO level that raises an interrupt */
+#define RX_TIMEOUT      10    /* receiver timeout, in units of 4 bit periods */
+
+#define XON  0x11
+#define XOFF 0x13
+
+#define FLOW_NONE   0
+#define FLOW_XONXOFF 1
+#define FLOW_RTSCTS 2
+
+const char *flow_str[] = { "none", "xonxoff", "rtscts" };
+
+char tx_ring[TX_RING_SIZE];
+volatile u32 tx_head = 0; /* only written by outbyte */
+volatile u32 tx_tail = 0; /* only written with interrupts off or in the handler */
+volatile int tx_running = 0; /* TX empty interrupt is enabled */
+volatile char tx_ctrl = 0; /* XON/XOFF to send ahead of the ring */
+
+char rx_ring[RX_RING_SIZE];
+volatile u32 rx_head = 0; /* only written by the interrupt handler */
+volatile u32 rx_tail = 0; /* only written by inbyte */
+volatile int rx_stopped = 0; /* sender has been told to stop */
+
+int uart_irq_ok = 0;
+int flow_mode = FLOW_XONXOFF;
+
+/* Statistics, see "show uart" */
+u32 tx_bytes = 0;
+u32 rx_bytes = 0;
+u32 rx_dropped = 0; /* rx_ring was full */
+u32 rx_overruns = 0; /* RX FIFO was full */
+u32 rx_stops = 0;
+u32 rx_max = 0;     /* highest rx_ring fill level */
+u32 uart_irqs = 0;
+XTime tx_stall_ticks = 0; /* time outbyte waited for room in the ring */
+XTime tx_flush_ticks = 0; /* time uart_flush waited for the ring to drain */
+
+/* Move as much as fits from the ring into the TX FIFO. Runs in the
+   interrupt handler or with interrupts disabled. */
+void tx_fill_fifo() {
+  u32 tail = tx_tail;
+
+  if (tx_ctrl &&
+      !(XUartPs_ReadReg(UART_BASEADDR, XUARTPS_SR_OFFSET) & XUARTPS_SR_TXFULL)) {
+    XUartPs_WriteReg(UART_BASEADDR, XUARTPS_FIFO_OFFSET, (u8)tx_ctrl);
+    tx_ctrl = 0;
+  }
+
+  while (tail != tx_head &&
+         !(XUartPs_ReadReg(UART_BASEADDR, XUARTPS_SR_OFFSET) & XUARTPS_SR_TXFULL)) {
+    XUartPs_WriteReg(UART_BASEADDR, XUARTPS_FIFO_OFFSET,
+                     (u8)tx_ring[tail & (TX_RING_SIZE - 1)]);
+    tail++;
+  }
+  tx_tail = tail;
+
+  if (tail != tx_head || tx_ctrl) {
+    tx_running = 1;
+    XUartPs_WriteReg(UART_BASEADDR, XUARTPS_IER_OFFSET, XUARTPS_IXR_TXEMPTY);
+  } else {
+    tx_running = 0;
+    XUartPs_WriteReg(UART_BASEADDR, XUARTPS_IDR_OFFSET, XUARTPS_IXR_TXEMPTY);
   }
-  return FAILURE;
 }
 
-/* TODO: Some kind of success/failure checking, maybe? */
-void freeArrays() {
-  int i = 0;
-  for (i = 0; i < MAX_ALLOCATED_ARRAYS; i ++) {
-    freeArray(i);
+/* Tell the sender to stop (stop = 1) or go on (stop = 0).
+   Runs in the interrupt handler or with interrupts disabled. */
+void rx_flow(int stop) {
+  u32 mcr;
+
+  rx_stopped = stop;
+  if (stop) rx_stops++;
+
+  if (flow_mode == FLOW_XONXOFF) {
+    tx_ctrl = stop ? XOFF : XON;
+    tx_fill_fifo();
+  } else if (flow_mode == FLOW_RTSCTS) {
+    mcr = XUartPs_ReadReg(UART_BASEADDR, XUARTPS_MODEMCR_OFFSET);
+    if (stop) mcr &= ~XUARTPS_MODEMCR_RTS;
+    else      mcr |= XUARTPS_MODEMCR_RTS;
+    XUartPs_WriteReg(UART_BASEADDR, XUARTPS_MODEMCR_OFFSET, mcr);
   }
 }
 
+void rx_drain_fifo() {
+  u32 head = rx_head;
+  u32 used;
+  u8 c;
 
-/* ************************************************************
- * Implementation of commands
- * ********************************************************* */
+  while (!(XUartPs_ReadReg(UART_BASEADDR, XUARTPS_SR_OFFSET) & XUARTPS_SR_RXEMPTY)) {
+    c = XUartPs_ReadReg(UART_BASEADDR, XUARTPS_FIFO_OFFSET);
+    if (head - rx_tail == RX_RING_SIZE) {
+      rx_dropped++;
+      continue;
+    }
+    rx_ring[head & (RX_RING_SIZE - 1)] = c;
+    head++;
+    rx_bytes++;
+  }
+  rx_head = head;
 
-int exit_cmd(int n, char **args) {
-  running = 0;
-  return SUCCESS;
+  used = head - rx_tail;
+  if (used > rx_max) rx_max = used;
+  if (used >= RX_HIGH_WATER && !rx_stopped && flow_mode != FLOW_NONE) {
+    rx_flow(1);
+  }
 }
 
-/* prints help message. Always returns success */
-int help_cmd(int n, char **args) {
+void uart_isr(void *CallBackRef) {
+  u32 isr;
 
-  if (n < 1 || n > 2) {
-      xil_printf("Wrong number of arguments!\n\rUsage: help [about]\n\r");
+  isr = XUartPs_ReadReg(UART_BASEADDR, XUARTPS_ISR_OFFSET) &
+        XUartPs_ReadReg(UART_BASEADDR, XUARTPS_IMR_OFFSET);
+  XUartPs_WriteReg(UART_BASEADDR, XUARTPS_ISR_OFFSET, isr);
+  uart_irqs++;
+
+  if (isr & XUARTPS_IXR_OVER) {
+    rx_overruns++;
   }
-  if (n == 2) {
-    xil_printf("Currently no valid abouts.\n\r");
-  } else {
-    xil_printf("%s", hlp_str);
+  if (isr & (XUARTPS_IXR_RXOVR | XUARTPS_IXR_RXFULL | XUARTPS_IXR_TOUT)) {
+    rx_drain_fifo();
+    if (isr & XUARTPS_IXR_TOUT) {
+      XUartPs_WriteReg(UART_BASEADDR, XUARTPS_CR_OFFSET,
+                       XUartPs_ReadReg(UART_BASEADDR, XUARTPS_CR_OFFSET) |
+                       XUARTPS_CR_TORST);
+    }
   }
+  if (isr & XUARTPS_IXR_TXEMPTY) {
+    tx_fill_fifo();
+  }
+}
+
+int init_uart_irq() {
+  int status;
+
+  XUartPs_WriteReg(UART_BASEADDR, XUARTPS_IDR_OFFSET, XUARTPS_IXR_MASK);
+  XUartPs_WriteReg(UART_BASEADDR, XUARTPS_ISR_OFFSET, XUARTPS_IXR_MASK);
+  XUartPs_WriteReg(UART_BASEADDR, XUARTPS_RXWM_OFFSET, RX_TRIGGER);
+  XUartPs_WriteReg(UART_BASEADDR, XUARTPS_RXTOUT_OFFSET, RX_TIMEOUT);
+
+  status = XScuGic_Connect(&IntcInstance, UART_INT_IRQ_ID,
+                           (Xil_InterruptHandler)uart_isr, NULL);
+  if (status != XST_SUCCESS) return FAILURE;
+  XScuGic_Enable(&IntcInstance, UART_INT_IRQ_ID);
+
+  uart_irq_ok = 1;
+  Xil_ExceptionDisable();
+  if (flow_mode == FLOW_RTSCTS) rx_flow(0); /* assert RTS */
+  XUartPs_WriteReg(UART_BASEADDR, XUARTPS_IER_OFFSET,
+                   XUARTPS_IXR_RXOVR | XUARTPS_IXR_RXFULL |
+                   XUARTPS_IXR_TOUT | XUARTPS_IXR_OVER);
+  Xil_ExceptionEnable();
   return SUCCESS;
 }
 
-int mread_cmd(int n, char **args) {
+/* Mask interrupts, returning whether they were on. irq_restore only
+   turns them back on if so, so printing from an ISR or from inside
+   an Xil_ExceptionDisable section does not unmask them. */
+u32 irq_save() {
+  u32 on = !(mfcpsr() & XIL_EXCEPTION_IRQ);
+  Xil_ExceptionDisable();
+  return on;
+}
 
-  unsigned int address;
-  unsigned int num_elts = 1; /* 1 element by default */
-  int i = 0;
+void irq_restore(u32 on) {
+  if (on) Xil_ExceptionEnable();
+}
 
-  if (n < 3 || n > 4) {
-    xil_printf(
-        "Wrong number of arguments!\n\rUsage: mread <type> <address>\n\r");
-    return FAILURE;
+/* Sleep until the next interrupt if cond still holds once
+   interrupts are off, so a wakeup cannot be missed. Interrupts are
+   left alone when there is nothing to wait for. With interrupts
+   already masked the ISR cannot run, so this spins doing its work
+   (poll) instead. */
+#define WAIT_WHILE(cond, poll)          \
+  do {                                  \
+    if (mfcpsr() & XIL_EXCEPTION_IRQ) { \
+      while (cond) poll;                \
+    } else {                            \
+      while (cond) {                    \
+        Xil_ExceptionDisable();         \
+        if (cond) wfi();                \
+        Xil_ExceptionEnable();          \
+      }                                 \
+    }                                   \
+  } while (0)
+
+/* Replaces the BSP outbyte used by xil_printf */
+void outbyte(char c) {
+  XTime t0, t1;
+
+  if (out_quiet) return;
+  if (!uart_irq_ok) {
+    XUartPs_SendByte(UART_BASEADDR, c);
+    return;
+  }
+
+  if (tx_head - tx_tail == TX_RING_SIZE) {
+    XTime_GetTime(&t0);
+    WAIT_WHILE(tx_head - tx_tail == TX_RING_SIZE, tx_fill_fifo());
+    XTime_GetTime(&t1);
+    tx_stall_ticks += t1 - t0;
   }
 
-  sscanf(args[2], "%x", &address);
-  /* xil_printf("%x - %u\n\r", address, address); */
+  tx_ring[tx_head & (TX_RING_SIZE - 1)] = c;
+  dmb();
+  tx_head++;
+  tx_bytes++;
 
-  if (n == 4) {
-    num_elts = atoi(args[3]);
-    if (num_elts < 1)
-      return FAILURE;
+  if (!tx_running) {
+    u32 irq = irq_save();
+    tx_fill_fifo();
+    irq_restore(irq);
   }
+}
 
-  Xil_DCacheFlushRange(address, num_elts * 4); /* TODO fix */
+int uart_rx_ready() {
+  if (!uart_irq_ok) return XUartPs_IsReceiveData(UART_BASEADDR);
+  return rx_head != rx_tail;
+}
 
+/* Replaces the BSP inbyte */
+char inbyte(void) {
+  char c;
 
-  for (i = 0; i < num_elts; i++) {
+  if (!uart_irq_ok) return XUartPs_RecvByte(UART_BASEADDR);
 
-    if (strcmp(args[1], "int") == 0) {
-      xil_printf("%d\n\r", *(int*) (address + i * sizeof(int)));
-    } else if (strcmp(args[1], "uint") == 0) {
-      xil_printf("%u\n\r",
-          *(unsigned int*) (address + i * sizeof(unsigned int)));
-    } else if (strcmp(args[1], "float") == 0) {
-      char tmp[128];
-      snprintf(tmp, 128, "%f", *(float*) (address + i * sizeof(float)));
-      xil_printf("%s\n\r", tmp);
-    } else if (strcmp(args[1], "byte") == 0) {
-      xil_printf("%d\n\r", *(unsigned char*) (address + i));
-    } else {
-      xil_printf("Incorrect type specifier\n\r");
-      return FAILURE;
-    }
+  WAIT_WHILE(rx_head == rx_tail, rx_drain_fifo());
+  c = rx_ring[rx_tail & (RX_RING_SIZE - 1)];
+  dmb();
+  rx_tail++;
+
+  if (rx_stopped && rx_head - rx_tail <= RX_LOW_WATER) {
+    u32 irq = irq_save();
+    rx_flow(0);
+    irq_restore(irq);
   }
-  return SUCCESS;
+  return c;
 }
 
-int mwrite_cmd(int n, char **args) {
+/* Wait until all queued output has left the UART */
+void uart_flush() {
+  XTime t0, t1;
 
-  unsigned int address;
+  if (!uart_irq_ok) return;
 
-  if (n < 4 || n > 4) {
-    xil_printf(
-        "Wrong number of arguments!\n\rUsage: mwrite <type> <address> <value>\n\r");
-    return FAILURE;
+  XTime_GetTime(&t0);
+  WAIT_WHILE(tx_tail != tx_head || tx_ctrl, tx_fill_fifo());
+  while (!(XUartPs_ReadReg(UART_BASEADDR, XUARTPS_SR_OFFSET) & XUARTPS_SR_TXEMPTY));
+  XTime_GetTime(&t1);
+  tx_flush_ticks += t1 - t0;
+}
+
+/* Select flow control, returns the previous mode */
+int uart_set_flow(int mode) {
+  int old = flow_mode;
+
+  if (!uart_irq_ok || mode == old) return old;
+
+  Xil_ExceptionDisable();
+  if (rx_stopped) rx_flow(0);
+  flow_mode = mode;
+  if (mode == FLOW_RTSCTS) rx_flow(0); /* assert RTS */
+  Xil_ExceptionEnable();
+  return old;
+}
+
+void show_uart() {
+  xil_printf("Flow control: %s\n\r", flow_str[flow_mode]);
+  xil_printf("TX ring:  %u bytes, %u queued\n\r",
+             TX_RING_SIZE, tx_head - tx_tail);
+  xil_printf("TX bytes: %u\n\r", tx_bytes);
+  xil_printf("RX ring:  %u bytes, %u queued, %u at most\n\r",
+             RX_RING_SIZE, rx_head - rx_tail, rx_max);
+  xil_printf("RX bytes: %u (%u dropped, %u FIFO overruns, %u stops)\n\r",
+             rx_bytes, rx_dropped, rx_overruns, rx_stops);
+  xil_printf("IRQs:     %u\n\r", uart_irqs);
+  xil_printf("Stalled:  %u us (ring full)\n\r",
+             (u32)(tx_stall_ticks / (COUNTS_PER_SECOND / 1000000)));
+  xil_printf("Flushing: %u us (waiting at prompt)\n\r",
+             (u32)(tx_flush_ticks / (COUNTS_PER_SECOND / 1000000)));
+}
+
+#else
+
+#define FLOW_NONE 0
+
+void uart_flush() { }
+
+int uart_rx_ready() {
+  return XUartPs_IsReceiveData(STDIN_BASEADDRESS);
+}
+
+int uart_set_flow(int mode) {
+  return FLOW_NONE;
+}
+
+void show_uart() {
+  xil_printf("UART is polled (USE_UART_IRQ not set)\n\r");
+}
+
+#endif
+
+/* ************************************************************
+ * Command statistics
+ *
+ * dispatch() times every command with the global timer, which is
+ * 64 bits wide and counts COUNTS_PER_SECOND ticks per second, so
+ * long running commands (sdLoad, programFPGA) do not wrap. The host
+ * build implements XTime_GetTime with a monotonic clock.
+ * Commands that move data add the number of bytes to cmd_bytes.
+ * ********************************************************* */
+
+#define NUM_CMDS (sizeof(cmds) / sizeof(char *))
+
+typedef struct {
+  u32 calls;
+  XTime total;
+  XTime min;
+  XTime max;
+  u64 bytes;
+} cmd_stat;
+
+cmd_stat cmd_stats[NUM_CMDS];
+u32 cmd_bytes = 0; /* bytes moved by the command being dispatched */
+
+u32 ticks_to_us(XTime ticks) {
+  return (u32)(ticks / COUNTS_PER_SECOND * 1000000 +
+               ticks % COUNTS_PER_SECOND * 1000000 / COUNTS_PER_SECOND);
+}
+
+void cmd_stats_reset() {
+  memset(cmd_stats, 0, sizeof(cmd_stats));
+}
+
+void cmd_stats_add(int cmd, XTime ticks, u32 bytes) {
+  cmd_stat *s = &cmd_stats[cmd];
+
+  if (s->calls == 0 || ticks < s->min) s->min = ticks;
+  if (ticks > s->max) s->max = ticks;
+  s->total += ticks;
+  s->bytes += bytes;
+  s->calls++;
+}
+
+/* MB/s for bytes moved in ticks, as a string */
+void rate_str(char *buf, int size, u64 bytes, XTime ticks) {
+  if (bytes == 0 || ticks == 0) {
+    snprintf(buf, size, "-");
+  } else {
+    snprintf(buf, size, "%.2f",
+             (double)bytes * COUNTS_PER_SECOND / ticks / 1000000.0);
   }
+}
 
-  sscanf(args[2], "%x", &address);
-  /* xil_printf("%x - %u\n\r", address, address); */
+/* ************************************************************
+ * Checksums
+ *
+ * CRC-32 (IEEE 802.3, as zlib) is used by the binary protocol, the
+ * bulk download, the bitstream cache and checksum. It goes through
+ * the data 8 bytes at a time with eight tables ("slice-by-8"), so a
+ * check runs at a good part of memory speed rather than at the one
+ * table lookup per byte of the simple version.
+ *
+ * XXH64 (xxHash, 64 bit) is an alternative for checksum and the
+ * -sum option where only a match is needed, not CRC compatibility;
+ * it is several times faster again. XXH32 is only there for LZ4
+ * frames (see "Compression").
+ * ********************************************************* */
 
-  if (strcmp(args[1], "int") == 0) {
-    int val;
-    if (strncmp(args[3],"0x", 2) == 0) { /* Inteprete as hex */
-      sscanf(args[3],"%x", &val);
-    } else {
-      val = atoi(args[3]);
-    }
-    *(volatile int*) address = val;
-    Xil_DCacheFlushRange(address, sizeof(int));
+u32 crc32_table[8][256];
 
-  } else if (strcmp(args[1], "uint") == 0) {
-    unsigned int val;
-    if (strncmp(args[3],"0x", 2) == 0) { /* Inteprete as hex */
-      sscanf(args[3],"%x", &val);
-    } else {
-      val = atoi(args[3]);
+void crc32_init() {
+  u32 i, j, c;
+  for (i = 0; i < 256; i ++) {
+    c = i;
+    for (j = 0; j < 8; j ++) {
+      c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
     }
-    *(volatile unsigned int*) address = val;
-    Xil_DCacheFlushRange(address, sizeof(unsigned int));
-  } else if (strcmp(args[1], "float") == 0) {
-    *(volatile float*) address = atof(args[3]);
-    Xil_DCacheFlushRange(address, sizeof(float));
-  } else {
-    xil_printf("Incorrect type specifier\n\r");
-    return FAILURE;
+    crc32_table[0][i] = c;
   }
+  /* crc32_table[k][i]: the CRC of byte i followed by k zero bytes */
+  for (i = 0; i < 256; i ++) {
+    for (j = 1; j < 8; j ++) {
+      c = crc32_table[j - 1][i];
+      crc32_table[j][i] = crc32_table[0][c & 0xFF] ^ (c >> 8);
+    }
+  }
+}
 
-  return SUCCESS;
+/* crc32_update(0, data, len) gives the CRC of data.
+   Passing the result of a previous call continues the CRC. */
+u32 crc32_update(u32 crc, const u8 *data, u32 len) {
+  u32 a, b;
+
+  crc = ~crc;
+  while (len && ((UINTPTR)data & 3)) {
+    crc = crc32_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    len--;
+  }
+  while (len >= 8) {
+    memcpy(&a, data, 4); /* little endian */
+    memcpy(&b, data + 4, 4);
+    a ^= crc;
+    crc = crc32_table[7][a & 0xFF] ^ crc32_table[6][(a >> 8) & 0xFF] ^
+          crc32_table[5][(a >> 16) & 0xFF] ^ crc32_table[4][a >> 24] ^
+          crc32_table[3][b & 0xFF] ^ crc32_table[2][(b >> 8) & 0xFF] ^
+          crc32_table[1][(b >> 16) & 0xFF] ^ crc32_table[0][b >> 24];
+    data += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = crc32_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
 }
 
-void printByte(char *ptr, int i) {
-  xil_printf("%d", ((char*)ptr)[i]);
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+u64 rotl64(u64 x, int r) {
+  return (x << r) | (x >> (64 - r));
 }
-void printInt(char *ptr, int i) {
-  xil_printf("%d", ((int*)ptr)[i]);
+
+u64 xxh64_round(u64 acc, u64 in) {
+  acc += in * XXH_P2;
+  return rotl64(acc, 31) * XXH_P1;
 }
-void printUInt(char *ptr, int i) {
-  xil_printf("%u", ((unsigned int *)ptr)[i]);
+
+u64 xxh64_merge(u64 h, u64 v) {
+  h ^= xxh64_round(0, v);
+  return h * XXH_P1 + XXH_P4;
 }
-void printFloat(char *ptr, int i) {
-  char buffer[256];
-  snprintf(buffer,256,"%f",((float*)ptr)[i]);
-  xil_printf("%s", buffer);
+
+u64 xxh64(const u8 *p, u32 len, u64 seed) {
+  const u8 *end = p + len;
+  u64 h, v1, v2, v3, v4, k;
+  u32 w;
+
+  if (len >= 32) {
+    v1 = seed + XXH_P1 + XXH_P2;
+    v2 = seed + XXH_P2;
+    v3 = seed;
+    v4 = seed - XXH_P1;
+    do {
+      memcpy(&k, p, 8);      v1 = xxh64_round(v1, k);
+      memcpy(&k, p + 8, 8);  v2 = xxh64_round(v2, k);
+      memcpy(&k, p + 16, 8); v3 = xxh64_round(v3, k);
+      memcpy(&k, p + 24, 8); v4 = xxh64_round(v4, k);
+      p += 32;
+    } while (p + 32 <= end);
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxh64_merge(h, v1);
+    h = xxh64_merge(h, v2);
+    h = xxh64_merge(h, v3);
+    h = xxh64_merge(h, v4);
+  } else {
+    h = seed + XXH_P5;
+  }
+  h += len;
+
+  while (p + 8 <= end) {
+    memcpy(&k, p, 8);
+    h ^= xxh64_round(0, k);
+    h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    memcpy(&w, p, 4);
+    h ^= (u64)w * XXH_P1;
+    h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= *p++ * XXH_P5;
+    h = rotl64(h, 11) * XXH_P1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_P2;
+  h ^= h >> 29;
+  h *= XXH_P3;
+  h ^= h >> 32;
+  return h;
 }
 
-int printArray(int id) {
-  int i = 0;
-  int bytes = arrays[id].size;
+#define XXH32_P1 2654435761U
+#define XXH32_P2 2246822519U
+#define XXH32_P3 3266489917U
+#define XXH32_P4 668265263U
+#define XXH32_P5 374761393U
 
-  void (*printer)(char *, int) = NULL;
+u32 rotl32(u32 x, int r) {
+  return (x << r) | (x >> (32 - r));
+}
 
-  switch (arrays[id].type) {
-  case INT_TYPE:
-    printer = printInt;
-    bytes *= sizeof(int);
-    break;
-  case FLOAT_TYPE:
-    printer = printFloat;
-    bytes = sizeof(float);
-    break;
-  case BYTE_TYPE:
-    printer = printByte;
-    break;
-  case UINT_TYPE:
-    printer = printUInt;
-    bytes *= sizeof(unsigned int);
-    break;
-  default:
-    xil_printf("Unsupported type\n\r");
-    return FAILURE;
+u32 xxh32_round(u32 acc, const u8 *p) {
+  u32 in;
+  memcpy(&in, p, 4);
+  acc += in * XXH32_P2;
+  return rotl32(acc, 13) * XXH32_P1;
+}
+
+/* XXH32, the checksum of LZ4 frames */
+u32 xxh32(const u8 *p, u32 len, u32 seed) {
+  const u8 *end = p + len;
+  u32 h, v1, v2, v3, v4, w;
+
+  if (len >= 16) {
+    v1 = seed + XXH32_P1 + XXH32_P2;
+    v2 = seed + XXH32_P2;
+    v3 = seed;
+    v4 = seed - XXH32_P1;
+    do {
+      v1 = xxh32_round(v1, p);
+      v2 = xxh32_round(v2, p + 4);
+      v3 = xxh32_round(v3, p + 8);
+      v4 = xxh32_round(v4, p + 12);
+      p += 16;
+    } while (p + 16 <= end);
+    h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+  } else {
+    h = seed + XXH32_P5;
   }
+  h += len;
 
-  Xil_DCacheInvalidateRange((unsigned int)arrays[id].data, bytes);
-  for (i = 0; i < arrays[id].size; i ++) {
-    printer(arrays[id].data, i);
-    xil_printf("\n\r");
+  while (p + 4 <= end) {
+    memcpy(&w, p, 4);
+    h += w * XXH32_P3;
+    h = rotl32(h, 17) * XXH32_P4;
+    p += 4;
   }
-  return SUCCESS;
+  while (p < end) {
+    h += *p++ * XXH32_P5;
+    h = rotl32(h, 11) * XXH32_P1;
+  }
+
+  h ^= h >> 15;
+  h *= XXH32_P2;
+  h ^= h >> 13;
+  h *= XXH32_P3;
+  h ^= h >> 16;
+  return h;
 }
 
-int show_cmd(int n, char **args) {
+#define SUM_CRC32 0
+#define SUM_XXH64 1
+#define NUM_SUMS  2
 
-  int i;
+const char *sum_str[NUM_SUMS] = { "crc32", "xxh64" };
 
-  if (n < 2 ) {
-    xil_printf("Wrong number of arguments!\n\rUsage: show <what>\n\r");
-    return FAILURE;
+int sumFromString(const char *str) {
+  int i;
+  for (i = 0; i < NUM_SUMS; i++) {
+    if (strcmp(str, sum_str[i]) == 0) return i;
   }
+  return -1;
+}
 
-  if (strcmp(args[1], "arrays") == 0) {
-    xil_printf("ID\t Status\t Addr\t Type\t Size\n\r");
-    for (i = 0; i < MAX_ALLOCATED_ARRAYS; i++) {
-      xil_printf("%d\t %s\t %x\t %s\t %d\n\r", i,
-          arrays[i].available ? "Free" : "Used", (unsigned int) arrays[i].data,
-          type_str[arrays[i].type], arrays[i].size);
-    }
-  } else if (strcmp (args[1], "array") == 0) {
+u64 checksum(int alg, const u8 *data, u32 len) {
+  return alg == SUM_CRC32 ? crc32_update(0, data, len) : xxh64(data, len, 0);
+}
 
-    if (n < 3) {
-      xil_printf("Requires an ArrayID argument!\n\r");
+/* Checksum as text, 8 or 16 hex digits */
+void sum_hex(char *buf, int alg, u64 sum) {
+  if (alg == SUM_CRC32) snprintf(buf, 17, "%08x", (u32)sum);
+  else snprintf(buf, 17, "%08x%08x", (u32)(sum >> 32), (u32)sum);
+}
+
+/* The -sum option of load and store commands */
+typedef struct {
+  int alg;    /* -1 for none */
+  int check;  /* compare with expect */
+  u64 expect;
+} sum_opt;
+
+/* Take "-sum <alg>[=<hex>]" out of args */
+int sumOption(int *n, char **args, sum_opt *s) {
+  int i, j;
+  char *eq;
+
+  s->alg = -1;
+  s->check = 0;
+  for (i = 1; i + 1 < *n; i++) {
+    if (strcmp(args[i], "-sum") != 0) continue;
+    eq = strchr(args[i + 1], '=');
+    if (eq) *eq = 0;
+    s->alg = sumFromString(args[i + 1]);
+    if (s->alg < 0) {
+      xil_printf("Unknown checksum %s, use crc32 or xxh64\n\r", args[i + 1]);
       return FAILURE;
     }
-    int id = atoi(args[2]);
-    if (arrays[id].available) {
-      xil_printf("Available\n\r",id);
-    } else {
-      printArray(id);
+    if (eq) {
+      char *end;
+      s->expect = strtoull(eq + 1, &end, 16);
+      if (*end || end == eq + 1) {
+        xil_printf("Bad checksum %s\n\r", eq + 1);
+        return FAILURE;
+      }
+      s->check = 1;
     }
+    for (j = i; j + 2 < *n; j++) args[j] = args[j + 2];
+    *n -= 2;
+    break;
+  }
+  return SUCCESS;
+}
 
-  } else {
-    xil_printf("No information available on %s\n\r", args[1]);
+/* Print the -sum checksum of data, and compare it if asked to */
+int sum_report(sum_opt *s, const u8 *data, u32 len) {
+  char buf[17];
+  u64 sum;
+
+  if (s->alg < 0) return SUCCESS;
+  sum = checksum(s->alg, data, len);
+  sum_hex(buf, s->alg, sum);
+  xil_printf("%s %s", sum_str[s->alg], buf);
+  if (s->check && sum != s->expect) {
+    xil_printf(" does not match the expected value\n\r");
+    return FAILURE;
   }
+  xil_printf(s->check ? " OK\n\r" : "\n\r");
   return SUCCESS;
+}
+
+/* ************************************************************
+ * Binary transfer protocol
+ *
+ * Used by loadArrayBin. After the command is accepted the shell
+ * prints "ZSB READY <bytes> <block_size>" and then expects:
+ *
+ *   header: 'Z' 'S' 'B' '1' | u32 length | u32 payload crc | u32 header crc
+ *   blocks: SOH | u16 seq | u16 len | data[len] | u32 crc (of seq, len, data)
+ *   end:    EOT
+ *
+ * All integers are little endian and CRCs are CRC-32 (IEEE 802.3).
+ * Every block but the last carries exactly BIN_BLOCK_SIZE bytes.
+ * The header, each block and the EOT are answered with ACK or NAK,
+ * a NAK means "send it again". CAN from either side aborts.
+ * ********************************************************* */
+
+#define BIN_BLOCK_SIZE  1024
+#define BIN_MAX_RETRIES 10
+#define BIN_TIMEOUT_MS  2000
+#define BIN_PURGE_MS    50
+
+#define BIN_SOH 0x01
+#define BIN_EOT 0x04
+#define BIN_ACK 0x06
+#define BIN_NAK 0x15
+#define BIN_CAN 0x18
 
+#define BIN_HEADER_SIZE 16
+
+
+u32 get_le16(const u8 *p) {
+  return p[0] | (p[1] << 8);
 }
 
-int loadArray_cmd(int n, char **args) {
+u32 get_le32(const u8 *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
 
-  int num = 0;
-  int use_id = -1; // initialise to -1 for check if available was found
-  int i = 0;
-  char buffer[256];
-  int bytes = 0;
+void put_le32(u8 *p, u32 v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
 
-  if (n < 3 || n > 4) {
-    xil_printf(
-        "Wrong number of arguments!\n\rUsage: loadArray <type> <num_elements> [ID]\n\r");
-    return FAILURE;
+/* Wait at most timeout_ms for a byte to arrive */
+int inbyte_timeout(u8 *c, u32 timeout_ms) {
+  XTime start, now;
+
+  XTime_GetTime(&start);
+  while (!uart_rx_ready()) {
+    XTime_GetTime(&now);
+    if (now - start > (XTime)timeout_ms * (COUNTS_PER_SECOND / 1000))
+      return FAILURE;
   }
+  *c = inbyte();
+  return SUCCESS;
+}
 
-  num = atoi(args[2]);
-  if (n == 4) {
-    use_id = atoi(args[3]);
+int recv_bytes(u8 *buffer, u32 len, u32 timeout_ms) {
+  u32 i;
+  for (i = 0; i < len; i ++) {
+    if (!inbyte_timeout(&buffer[i], timeout_ms)) return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/* Throw away input until the line has been quiet for a while,
+   so that a NAK is not answered mid-block. */
+void bin_purge() {
+  u8 c;
+  while (inbyte_timeout(&c, BIN_PURGE_MS));
+}
+
+/* Wait for the byte start, skipping anything else.
+   Returns the byte that was found or -1 on timeout. */
+int bin_sync(u8 start) {
+  u8 c;
+  do {
+    if (!inbyte_timeout(&c, BIN_TIMEOUT_MS)) return -1;
+    if (c == BIN_CAN) return BIN_CAN;
+  } while (c != start);
+  return c;
+}
+
+int bin_receive_blocks(u8 *dest, u32 bytes, int (*sink)(u32)) {
+  u8 hdr[BIN_HEADER_SIZE];
+  u8 blk_hdr[4];
+  u8 crc_bytes[4];
+  static u8 scratch[BIN_BLOCK_SIZE];
+  u32 payload_crc = 0;
+  u32 expected_crc = 0;
+  u32 received = 0;
+  u32 seq = 0;
+  int retries = 0;
+  int r;
 
-    if (use_id < 0 || use_id > MAX_ALLOCATED_ARRAYS) {
-      xil_printf("Incorrect array id!\n\r");
+  xil_printf("ZSB READY %u %u\n\r", bytes, BIN_BLOCK_SIZE);
+
+  /* Header */
+  for (;;) {
+    if (retries++ == BIN_MAX_RETRIES) goto abort;
+
+    r = bin_sync('Z');
+    if (r == BIN_CAN) return FAILURE;
+    hdr[0] = 'Z';
+    if (r < 0 || !recv_bytes(hdr + 1, BIN_HEADER_SIZE - 1, BIN_TIMEOUT_MS) ||
+        memcmp(hdr, "ZSB1", 4) != 0 ||
+        crc32_update(0, hdr, 12) != get_le32(hdr + 12)) {
+      bin_purge();
+      outbyte(BIN_NAK);
+      continue;
+    }
+    if (get_le32(hdr + 4) != bytes) {
+      outbyte(BIN_CAN);
       return FAILURE;
     }
-  } else { /* find free array slot */
-    for (i = 0; i < MAX_ALLOCATED_ARRAYS; i++) {
-      if (arrays[i].available) {
-        use_id = i;
-        break;
-      }
+    expected_crc = get_le32(hdr + 8);
+    outbyte(BIN_ACK);
+    break;
+  }
+
+  /* Blocks */
+  retries = 0;
+  while (received < bytes) {
+    u32 blk_seq, blk_len;
+    u32 want_len;
+    u8 *dst;
+
+    if (retries == BIN_MAX_RETRIES) goto abort;
+
+    r = bin_sync(BIN_SOH);
+    if (r == BIN_CAN) return FAILURE;
+    if (r < 0 || !recv_bytes(blk_hdr, 4, BIN_TIMEOUT_MS)) {
+      retries++;
+      bin_purge();
+      outbyte(BIN_NAK);
+      continue;
+    }
+
+    blk_seq = get_le16(blk_hdr);
+    blk_len = get_le16(blk_hdr + 2);
+    want_len = bytes - received;
+    if (want_len > BIN_BLOCK_SIZE) want_len = BIN_BLOCK_SIZE;
+
+    if (blk_seq == (seq & 0xFFFF) && blk_len == want_len) {
+      dst = dest + received;       /* new data goes straight into place */
+    } else if (blk_seq == ((seq - 1) & 0xFFFF) && seq > 0 &&
+               blk_len == BIN_BLOCK_SIZE) {
+      dst = scratch;               /* our ACK got lost, block is resent */
+    } else {
+      retries++;
+      bin_purge();
+      outbyte(BIN_NAK);
+      continue;
+    }
+
+    if (!recv_bytes(dst, blk_len, BIN_TIMEOUT_MS) ||
+        !recv_bytes(crc_bytes, 4, BIN_TIMEOUT_MS) ||
+        crc32_update(crc32_update(0, blk_hdr, 4), dst, blk_len) !=
+        get_le32(crc_bytes)) {
+      retries++;
+      bin_purge();
+      outbyte(BIN_NAK);
+      continue;
+    }
+
+    if (dst != scratch) {
+      payload_crc = crc32_update(payload_crc, dst, blk_len);
+      received += blk_len;
+      seq++;
+      if (sink && !sink(received)) goto abort;
+    }
+    retries = 0;
+    outbyte(BIN_ACK);
+  }
+
+  /* End of transfer */
+  for (;;) {
+    if (retries++ == BIN_MAX_RETRIES) goto abort;
+
+    if (!inbyte_timeout(&hdr[0], BIN_TIMEOUT_MS)) {
+      outbyte(BIN_NAK);
+      continue;
+    }
+    if (hdr[0] == BIN_EOT) break;
+    if (hdr[0] == BIN_CAN) return FAILURE;
+    if (hdr[0] == BIN_SOH) {
+      /* Last block resent because the ACK was lost */
+      bin_purge();
+      outbyte(BIN_ACK);
     }
   }
-  if (use_id == -1) {
-    xil_printf("No available array slot\n\r");
+
+  if (payload_crc != expected_crc) {
+    outbyte(BIN_CAN);
     return FAILURE;
   }
+  outbyte(BIN_ACK);
+  return SUCCESS;
+
+ abort:
+  outbyte(BIN_CAN);
+  return FAILURE;
+}
+
+/* Receive exactly bytes bytes of payload straight into dest.
+   Blocks are acknowledged one at a time so the input never runs
+   ahead, and XON/XOFF would only get mixed up with the ACKs.
+   sink, if not NULL, is called with the number of bytes in dest
+   after each new block, and aborts the transfer by failing. */
+int bin_receive(u8 *dest, u32 bytes, int (*sink)(u32)) {
+  int flow = uart_set_flow(FLOW_NONE);
+  int r = bin_receive_blocks(dest, bytes, sink);
+  uart_set_flow(flow);
+  return r;
+}
+
+/* ************************************************************
+ * Compression
+ *
+ * The -z options of loadArrayBin, sdLoad, sdStore and dumpArray move
+ * data as an LZ4 frame, the format of the lz4 command line tool, so
+ * files can be packed and unpacked on the host with it. Bitstreams
+ * and test vectors that are mostly zeros or repeats shrink several
+ * times, and unpacking runs near memory speed, far above the serial
+ * line or the card.
+ *
+ * The decoder writes straight into the array and takes whole blocks
+ * as they arrive, so a transfer is unpacked while it comes in.
+ * Blocks may refer back into the ones before them (linked blocks),
+ * which costs nothing when all the output is in one place. The
+ * encoder is the greedy single hash table kind: a run is a match one
+ * byte back, so it does what run-length coding would, and it is quick
+ * rather than the best at packing.
+ * ********************************************************* */
+
+#define LZ4_MAGIC         0x184D2204
+#define LZ4_BLOCK_SIZE    (1024 * 1024) /* blocks we write */
+#define LZ4_BLOCK_CODE    6             /* ... as the BD byte has it */
+#define LZ4_HEADER_MAX    19
+#define LZ4_HASH_BITS     12
+#define LZ4_MIN_MATCH     4
+#define LZ4_MFLIMIT       12 /* no match starts in the last 12 bytes */
+#define LZ4_LAST_LITERALS 5  /* and the last 5 are literals */
+#define LZ4_MAX_OFFSET    65535
+
+/* Room for n bytes as one block, or as a frame of LZ4_BLOCK_SIZE
+   blocks, whatever they hold */
+#define LZ4_BOUND(n)       ((n) + (n) / 255 + 16)
+#define LZ4_FRAME_BOUND(n) (LZ4_BOUND(n) + ((n) / LZ4_BLOCK_SIZE + 1) * 8 + 32)
+
+/* Frame descriptor flags */
+#define LZ4F_VERSION     0x40
+#define LZ4F_BLOCK_SUM   0x10
+#define LZ4F_SIZE        0x08
+#define LZ4F_CONTENT_SUM 0x04
+#define LZ4F_DICT_ID     0x01
+
+#define LZ4_BLOCKS 0 /* decoder states */
+#define LZ4_SUM    1 /* end mark seen, content checksum to come */
+#define LZ4_DONE   2
+
+typedef struct {
+  u8 flags;
+  u32 max_block;
+  u64 size;      /* content size, with LZ4F_SIZE */
+  int state;
+  u8 *dst;       /* output, set by the caller */
+  u32 cap;
+  u32 out;       /* bytes unpacked */
+} lz4_frame;
+
+const char *lz4_msg = ""; /* why the last frame failed */
+
+u32 lz4_table[1 << LZ4_HASH_BITS]; /* position + 1 of the last 4 bytes
+                                      with each hash, 0 for none */
+
+/* Unpack the block src[0, len) at dst + *out, with room up to cap.
+   Matches may reach back to dst[0]. */
+int lz4_decode_block(const u8 *src, u32 len, u8 *dst, u32 *out, u32 cap) {
+  const u8 *ip = src, *iend = src + len;
+  u8 *op = dst + *out, *oend = dst + cap;
+  u32 token, lit, ml, off, b;
+
+  for (;;) {
+    if (ip == iend) goto corrupt;
+    token = *ip++;
+    lit = token >> 4;
+    if (lit == 15) {
+      do {
+        if (ip == iend) goto corrupt;
+        lit += b = *ip++;
+      } while (b == 255);
+    }
+    if (lit > (u32)(iend - ip)) goto corrupt;
+    if (lit > (u32)(oend - op)) goto full;
+    memcpy(op, ip, lit);
+    op += lit;
+    ip += lit;
+    if (ip == iend) break; /* the last sequence has no match */
+
+    if (iend - ip < 2) goto corrupt;
+    off = ip[0] | (ip[1] << 8);
+    ip += 2;
+    ml = (token & 15) + LZ4_MIN_MATCH;
+    if ((token & 15) == 15) {
+      do {
+        if (ip == iend) goto corrupt;
+        ml += b = *ip++;
+      } while (b == 255);
+    }
+    if (off == 0 || off > (u32)(op - dst)) goto corrupt;
+    if (ml > (u32)(oend - op)) goto full;
+    /* A match closer than its length repeats the last off bytes. It
+       is copied in pieces that double, each from a whole number of
+       periods back, so a long run takes a few memcpy calls. */
+    while (ml > 0) {
+      b = off < ml ? off : ml;
+      memcpy(op, op - off, b);
+      op += b;
+      ml -= b;
+      off += off;
+    }
+  }
+  *out = op - dst;
+  return SUCCESS;
 
-  /* If we arrive here, we have selected a slot */
+ corrupt:
+  lz4_msg = "corrupt LZ4 block";
+  return FAILURE;
+ full:
+  lz4_msg = "data does not fit the array";
+  return FAILURE;
+}
+
+/* Read a frame header from in[0, len). Returns its length, 0 if it
+   needs more bytes, or -1. */
+int lz4_frame_header(lz4_frame *f, const u8 *in, u32 len) {
+  u32 n = 7;
+
+  if (len < n) return 0;
+  if (get_le32(in) != LZ4_MAGIC) {
+    lz4_msg = "not an LZ4 frame";
+    return -1;
+  }
+  f->flags = in[4];
+  if ((f->flags & 0xC2) != LZ4F_VERSION || (in[5] & 0x8F) ||
+      ((in[5] >> 4) & 7) < 4) {
+    lz4_msg = "unknown LZ4 frame format";
+    return -1;
+  }
+  if (f->flags & LZ4F_DICT_ID) {
+    lz4_msg = "LZ4 dictionaries are not supported";
+    return -1;
+  }
+  f->max_block = 1 << (8 + 2 * ((in[5] >> 4) & 7));
+  if (f->flags & LZ4F_SIZE) n += 8;
+  if (len < n) return 0;
+  if (((xxh32(in + 4, n - 5, 0) >> 8) & 0xFF) != in[n - 1]) {
+    lz4_msg = "LZ4 header checksum mismatch";
+    return -1;
+  }
+  f->size = 0;
+  if (f->flags & LZ4F_SIZE)
+    f->size = get_le32(in + 6) | (u64)get_le32(in + 10) << 32;
+  f->state = LZ4_BLOCKS;
+  f->out = 0;
+  return n;
+}
+
+/* Unpack what can be of in[0, len): whole blocks, the end mark and
+   the content checksum. Returns the number of bytes used, the rest
+   must be given again with more after it, or -1. */
+int lz4_frame_feed(lz4_frame *f, const u8 *in, u32 len) {
+  u32 used = 0, word, size, n;
+  const u8 *blk;
+
+  while (f->state != LZ4_DONE && len - used >= 4) {
+    word = get_le32(in + used);
+    if (f->state == LZ4_SUM) {
+      if (xxh32(f->dst, f->out, 0) != word) {
+        lz4_msg = "LZ4 content checksum mismatch";
+        return -1;
+      }
+      used += 4;
+      f->state = LZ4_DONE;
+      break;
+    }
+    if (word == 0) { /* end mark */
+      used += 4;
+      if ((f->flags & LZ4F_SIZE) && f->out != f->size) {
+        lz4_msg = "LZ4 frame is shorter than its content size";
+        return -1;
+      }
+      f->state = f->flags & LZ4F_CONTENT_SUM ? LZ4_SUM : LZ4_DONE;
+      continue;
+    }
+
+    size = word & 0x7FFFFFFF;
+    if (size > f->max_block) {
+      lz4_msg = "corrupt LZ4 block";
+      return -1;
+    }
+    n = 4 + size + (f->flags & LZ4F_BLOCK_SUM ? 4 : 0);
+    if (len - used < n) break;
+    blk = in + used + 4;
+    if ((f->flags & LZ4F_BLOCK_SUM) &&
+        xxh32(blk, size, 0) != get_le32(blk + size)) {
+      lz4_msg = "LZ4 block checksum mismatch";
+      return -1;
+    }
+    if (word & 0x80000000) { /* stored as it is */
+      if (size > f->cap - f->out) {
+        lz4_msg = "data does not fit the array";
+        return -1;
+      }
+      memcpy(f->dst + f->out, blk, size);
+      f->out += size;
+    } else if (!lz4_decode_block(blk, size, f->dst, &f->out, f->cap)) {
+      return -1;
+    }
+    used += n;
+  }
+  return used;
+}
+
+u32 lz4_hash(const u8 *p) {
+  u32 v;
+  memcpy(&v, p, 4);
+  return (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+u8 *lz4_put_len(u8 *op, u32 len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = len;
+  return op;
+}
+
+/* A sequence: nlit literals, then a match of ml bytes off back
+   (none if ml is 0, as in the last sequence of a block) */
+u8 *lz4_sequence(u8 *op, const u8 *lit, u32 nlit, u32 off, u32 ml) {
+  u8 *token = op++;
+
+  *token = (nlit < 15 ? nlit : 15) << 4;
+  if (nlit >= 15) op = lz4_put_len(op, nlit - 15);
+  memcpy(op, lit, nlit);
+  op += nlit;
+  if (ml) {
+    *op++ = off;
+    *op++ = off >> 8;
+    ml -= LZ4_MIN_MATCH;
+    *token |= ml < 15 ? ml : 15;
+    if (ml >= 15) op = lz4_put_len(op, ml - 15);
+  }
+  return op;
+}
+
+/* Pack base[start, end) as one block at dst, which has room for
+   LZ4_BOUND(end - start). Matches may reach back before start, into
+   the blocks before it. Returns the packed length. */
+u32 lz4_encode_block(const u8 *base, u32 start, u32 end, u8 *dst) {
+  u32 i = start, anchor = start, misses = 0;
+  u32 h, m, len;
+  u8 *op = dst;
+
+  while (end - start > LZ4_MFLIMIT && i <= end - LZ4_MFLIMIT) {
+    h = lz4_hash(base + i);
+    m = lz4_table[h];
+    lz4_table[h] = i + 1;
+    if (m == 0 || i - (m - 1) > LZ4_MAX_OFFSET ||
+        memcmp(base + m - 1, base + i, LZ4_MIN_MATCH) != 0) {
+      /* Look less often in data that does not repeat */
+      i += 1 + (misses++ >> 6);
+      continue;
+    }
+    m--;
+    while (i > anchor && m > 0 && base[i - 1] == base[m - 1]) {
+      i--;
+      m--;
+    }
+    len = LZ4_MIN_MATCH;
+    while (i + len + LZ4_LAST_LITERALS < end && base[i + len] == base[m + len])
+      len++;
+    op = lz4_sequence(op, base + anchor, i - anchor, i - m, len);
+    i += len;
+    anchor = i;
+    misses = 0;
+  }
+  return lz4_sequence(op, base + anchor, end - anchor, 0, 0) - dst;
+}
+
+/* Start a frame of size bytes: its header at dst (LZ4_HEADER_MAX
+   bytes of room). Returns the header length. */
+u32 lz4_frame_begin(u8 *dst, u32 size) {
+  memset(lz4_table, 0, sizeof(lz4_table));
+  put_le32(dst, LZ4_MAGIC);
+  dst[4] = LZ4F_VERSION | LZ4F_SIZE | LZ4F_CONTENT_SUM;
+  dst[5] = LZ4_BLOCK_CODE << 4;
+  put_le32(dst + 6, size);
+  put_le32(dst + 10, 0);
+  dst[14] = xxh32(dst + 4, 10, 0) >> 8;
+  return 15;
+}
+
+/* The block of base[start, end) at dst (LZ4_BOUND + 4 bytes of room),
+   stored as it is if packing does not make it smaller */
+u32 lz4_frame_block(u8 *dst, const u8 *base, u32 start, u32 end) {
+  u32 len = lz4_encode_block(base, start, end, dst + 4);
+
+  if (len >= end - start) {
+    len = end - start;
+    memcpy(dst + 4, base + start, len);
+    put_le32(dst, len | 0x80000000);
+  } else {
+    put_le32(dst, len);
+  }
+  return len + 4;
+}
+
+/* End mark and content checksum of the frame of data */
+u32 lz4_frame_end(u8 *dst, const u8 *data, u32 size) {
+  put_le32(dst, 0);
+  put_le32(dst + 4, xxh32(data, size, 0));
+  return 8;
+}
+
+/* data as a whole frame at dst, LZ4_FRAME_BOUND(size) bytes of room */
+u32 lz4_frame_encode(u8 *dst, const u8 *data, u32 size) {
+  u32 len = lz4_frame_begin(dst, size);
+  u32 off, end;
+
+  for (off = 0; off < size; off = end) {
+    end = size - off > LZ4_BLOCK_SIZE ? off + LZ4_BLOCK_SIZE : size;
+    len += lz4_frame_block(dst + len, data, off, end);
+  }
+  return len + lz4_frame_end(dst + len, data, size);
+}
+
+/* How many times bytes is packed, as in "7.50" (to 1) */
+void ratio_str(char *buf, int size, u32 bytes, u32 packed) {
+  snprintf(buf, size, "%.2f", packed ? (double)bytes / packed : 0.0);
+}
+
+/* "<what> <bytes> bytes (<packed> packed, <ratio>:1) in <t> us
+   (<rate> MB/s)", the rate in unpacked bytes */
+void lz4_report(const char *what, u32 bytes, u32 packed, XTime ticks) {
+  char rate[16], ratio[16];
+
+  rate_str(rate, sizeof(rate), bytes, ticks);
+  ratio_str(ratio, sizeof(ratio), bytes, packed);
+  xil_printf("%s %u bytes (%u packed, %s:1) in %u us (%s MB/s)\n\r",
+             what, bytes, packed, ratio, ticks_to_us(ticks), rate);
+}
+
+
+/* ************************************************************
+ * Bulk download
+ *
+ * Used by dumpArray and the range form of mread. Output is:
+ *
+ *   ZSD <format> <bytes>[ lz4]\n\r
+ *   <bytes bytes, encoded according to format>
+ *   \n\rZSD END <crc32 of the unencoded bytes, 8 hex digits>\n\r
+ *
+ * raw sends the bytes as they are, hex and base64 are split into
+ * lines that a terminal can show. With lz4 (dumpArray -z) the bytes
+ * are an LZ4 frame of the data (see "Compression").
+ * ********************************************************* */
+
+#define DUMP_BUFFER_SIZE 4096
+
+#define DUMP_RAW    0
+#define DUMP_HEX    1
+#define DUMP_BASE64 2
+
+const char *dump_fmt_str[] = { "raw", "hex", "base64" };
+
+#define DUMP_HEX_LINE    32  /* bytes per line, 64 characters */
+#define DUMP_BASE64_LINE 57  /* bytes per line, 76 characters */
+
+char dump_buffer[DUMP_BUFFER_SIZE];
+int dump_pos = 0;
+
+const char *hex_digits = "0123456789abcdef";
+const char *base64_digits =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void dump_flush() {
+  int i;
+  for (i = 0; i < dump_pos; i ++) {
+    outbyte(dump_buffer[i]);
+  }
+  dump_pos = 0;
+}
+
+/* Make sure there is room for len more characters */
+void dump_reserve(int len) {
+  if (dump_pos + len > DUMP_BUFFER_SIZE) dump_flush();
+}
+
+/* Returns the dump format of str or -1 */
+int dumpFmtFromString(char *str) {
+  int i;
+  for (i = 0; i < sizeof(dump_fmt_str) / sizeof(char *); i ++) {
+    if (strcmp(str, dump_fmt_str[i]) == 0) return i;
+  }
+  return -1;
+}
+
+void dump_hex_line(const u8 *data, u32 len) {
+  u32 i;
+  char *p;
+
+  dump_reserve(2 * len + 2);
+  p = &dump_buffer[dump_pos];
+  for (i = 0; i < len; i ++) {
+    *p++ = hex_digits[data[i] >> 4];
+    *p++ = hex_digits[data[i] & 0xF];
+  }
+  *p++ = '\n';
+  *p++ = '\r';
+  dump_pos = p - dump_buffer;
+}
+
+void dump_base64_line(const u8 *data, u32 len) {
+  u32 i;
+  u32 v;
+  char *p;
+
+  dump_reserve(4 * ((len + 2) / 3) + 2);
+  p = &dump_buffer[dump_pos];
+  for (i = 0; i + 3 <= len; i += 3) {
+    v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    *p++ = base64_digits[(v >> 18) & 0x3F];
+    *p++ = base64_digits[(v >> 12) & 0x3F];
+    *p++ = base64_digits[(v >> 6) & 0x3F];
+    *p++ = base64_digits[v & 0x3F];
+  }
+  if (i < len) {
+    v = data[i] << 16;
+    if (i + 1 < len) v |= data[i + 1] << 8;
+    *p++ = base64_digits[(v >> 18) & 0x3F];
+    *p++ = base64_digits[(v >> 12) & 0x3F];
+    *p++ = (i + 1 < len) ? base64_digits[(v >> 6) & 0x3F] : '=';
+    *p++ = '=';
+  }
+  *p++ = '\n';
+  *p++ = '\r';
+  dump_pos = p - dump_buffer;
+}
+
+void dump_bytes(const u8 *data, u32 bytes, int fmt, int lz4) {
+  u32 off = 0;
+  u32 len;
+  u32 crc = 0;
+
+  xil_printf("ZSD %s %u%s\n\r", dump_fmt_str[fmt], bytes, lz4 ? " lz4" : "");
+
+  while (off < bytes) {
+    switch (fmt) {
+    case DUMP_RAW:
+      len = bytes - off;
+      if (len > DUMP_BUFFER_SIZE) len = DUMP_BUFFER_SIZE;
+      dump_reserve(len);
+      memcpy(&dump_buffer[dump_pos], data + off, len);
+      dump_pos += len;
+      break;
+    case DUMP_HEX:
+      len = bytes - off;
+      if (len > DUMP_HEX_LINE) len = DUMP_HEX_LINE;
+      dump_hex_line(data + off, len);
+      break;
+    default:
+      len = bytes - off;
+      if (len > DUMP_BASE64_LINE) len = DUMP_BASE64_LINE;
+      dump_base64_line(data + off, len);
+      break;
+    }
+    crc = crc32_update(crc, data + off, len);
+    off += len;
+  }
+  dump_flush();
+  cmd_bytes += bytes;
+
+  xil_printf("\n\rZSD END %08x\n\r", crc);
+}
+
+
+/* ************************************************************
+ * Number parsing and formatting
+ *
+ * Used by every command that turns text into array elements or back
+ * (loadArray, mwrite, mread, show array). Values are separated by
+ * spaces, tabs or commas, so a line can hold any number of them.
+ *
+ * Integers are decimal or hex (0x), with an optional sign. Floats are
+ * decimal with an optional fraction and exponent, hex integers, or
+ * inf/nan. A value that is followed by anything but a separator, or
+ * that does not fit the element type, is an error; nothing is
+ * silently read as 0.
+ *
+ * Hex is a bit pattern for the signed integer types, so 0xFFFF is a
+ * valid int16 (-1). Fixed point values are written as real numbers
+ * and rounded to the nearest step, fp16 values are rounded to the
+ * nearest half precision float.
+ *
+ * Values are printed with the fewest digits that read back as the
+ * same element. Decimal to binary conversion is exact in double
+ * precision for up to 15 digits and powers of ten up to 1e22
+ * (Clinger's fast path), which covers nearly all values typed or
+ * printed by the shell. The rest goes to strtof/strtod.
+ * ********************************************************* */
+
+#define PARSE_OK     1
+#define PARSE_END    0  /* no more values on the line */
+#define PARSE_ERROR -1
+
+#define MAX_NUMBER_LEN 64 /* longest token handed to strtof */
+#define MAX_VALUE_LEN  32 /* longest value printed by fmt_value */
+
+const char *parse_msg = ""; /* why the last PARSE_ERROR happened */
+char parse_token[32];       /* (start of) the offending token */
+
+const double pow10_tab[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const u64 pow10_int[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+  10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+  100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL
+};
+
+const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+/* A decimal number as read from the text: m * 10^e10, or inf/nan */
+typedef struct {
+  int neg;
+  u64 m;
+  int e10;
+  int truncated; /* more than 19 significant digits, m is not exact */
+  int special;   /* 0, 'i' (inf) or 'n' (nan) */
+} decimal;
+
+int is_sep(char c) {
+  return c == ' ' || c == '\t' || c == ',';
+}
+
+int is_end(char c) {
+  return c == 0 || is_sep(c) || c == '\r' || c == '\n';
+}
+
+/* 10^k for any k, exact for 0 <= k <= 22 */
+double pow10_d(int k) {
+  double r = 1.0;
+  if (k < 0) return 1.0 / pow10_d(-k);
+  while (k > 22) {
+    r *= 1e22;
+    k -= 22;
+  }
+  return r * pow10_tab[k];
+}
+
+/* m * 10^e10 correctly rounded to double, if that can be done with
+   one exact double operation. Returns 0 when the caller has to fall
+   back to strtod. */
+int decimal_to_double(u64 m, int e10, int neg, double *out) {
+  double d;
+
+  if (m == 0) {
+    *out = neg ? -0.0 : 0.0;
+    return 1;
+  }
+  /* Move surplus powers of ten into the mantissa while it stays exact */
+  while (e10 > 22 && m < (1ULL << 53) / 10) {
+    m *= 10;
+    e10--;
+  }
+  if (m >= (1ULL << 53) || e10 > 22 || e10 < -22) return 0;
+
+  d = e10 < 0 ? (double)m / pow10_tab[-e10] : (double)m * pow10_tab[e10];
+  *out = neg ? -d : d;
+  return 1;
+}
+
+/* The same for float. Returns 0 when the caller has to fall back to
+   strtof. */
+int decimal_to_float(u64 m, int e10, int neg, float *out) {
+  double d;
+  float f;
+  u64 bits;
+
+  if (!decimal_to_double(m, e10, 0, &d)) return 0;
+
+  /* Outside the normal float range the result may need a second
+     rounding step that the check below does not cover */
+  if (d != 0.0 && (d < FLT_MIN || d > FLT_MAX)) return 0;
+
+  /* d is the correctly rounded double. Rounding it to float gives the
+     correctly rounded float unless d landed exactly half way between
+     two floats (bit 28 set and the 28 bits below it clear). */
+  memcpy(&bits, &d, sizeof(bits));
+  if ((bits & 0x1FFFFFFF) == 0x10000000) return 0;
+
+  f = (float)d;
+  *out = neg ? -f : f;
+  return 1;
+}
+
+/* Round d to the nearest (even) binary16. Too large values become
+   inf. */
+u16 double_to_half(double d) {
+  u64 bits, mant;
+  u16 sign;
+  int e, shift;
+  u64 n, rem, half;
+
+  memcpy(&bits, &d, sizeof(bits));
+  sign = (bits >> 48) & 0x8000;
+  e = (int)((bits >> 52) & 0x7FF) - 1023;
+  mant = bits & ((1ULL << 52) - 1);
+
+  if (e == 1024) return sign | (mant ? 0x7E00 : 0x7C00);
+  if (e < -25) return sign; /* also double subnormals */
+
+  /* Steps of 2^-24 below the normal range, 11 significant bits above */
+  mant |= 1ULL << 52;
+  shift = 42 + (e < -14 ? -14 - e : 0);
+  n = mant >> shift;
+  rem = mant & ((1ULL << shift) - 1);
+  half = 1ULL << (shift - 1);
+  if (rem > half || (rem == half && (n & 1))) n++;
+
+  if (e < -14) return sign | (u16)n; /* n == 1024 is the smallest normal */
+  if (n == 2048) {
+    n = 1024;
+    e++;
+  }
+  if (e > 15) return sign | 0x7C00;
+  return sign | (u16)((e + 15) << 10) | (u16)(n - 1024);
+}
+
+double half_to_double(u16 h) {
+  int e = (h >> 10) & 0x1F;
+  double d = h & 0x3FF;
+
+  if (e == 31) d = (h & 0x3FF) ? NAN : INFINITY;
+  else if (e == 0) d *= 1.0 / (1 << 24);
+  else if (e >= 25) d = (d + 1024) * (1 << (e - 25));
+  else d = (d + 1024) / (1 << (25 - e));
+  return (h & 0x8000) ? -d : d;
+}
+
+/* v in steps of 2^-frac, rounded to nearest (ties away from zero).
+   Returns 0 if it does not fit in size bytes. */
+int double_to_fixed(double v, int frac, int size, s32 *raw) {
+  double x = v * (double)(1U << frac);
+  double lim = (double)(1ULL << (size * 8 - 1));
+  s64 r;
+
+  if (!(x > -lim - 0.5 && x < lim - 0.5)) return 0; /* also nan */
+  r = x < 0 ? -(s64)(0.5 - x) : (s64)(x + 0.5);
+  *raw = (s32)r;
+  return 1;
+}
+
+void parse_fail(const char *tok, const char *msg) {
+  int i;
+  for (i = 0; i < sizeof(parse_token) - 1 && !is_end(tok[i]); i ++)
+    parse_token[i] = tok[i];
+  parse_token[i] = 0;
+  parse_msg = msg;
+}
+
+int match_word(const char *s, const char *word) {
+  while (*word) {
+    if (tolower((int)*s) != *word) return 0;
+    s++;
+    word++;
+  }
+  return is_end(*s);
+}
+
+/* Parse an integer at s. Sets *end past it. Hex is taken as a bit
+   pattern of up to 32 bits. */
+int parse_integer(const char *s, const char **end, s64 *out, int *is_hex) {
+  const char *p = s;
+  int neg = 0;
+  u64 v = 0;
+  int digits = 0;
+
+  if (*p == '-' || *p == '+') neg = *p++ == '-';
+
+  *is_hex = p[0] == '0' && (p[1] == 'x' || p[1] == 'X');
+  if (*is_hex) {
+    p += 2;
+    for (;; p++) {
+      int d;
+      if (*p >= '0' && *p <= '9') d = *p - '0';
+      else if (*p >= 'a' && *p <= 'f') d = *p - 'a' + 10;
+      else if (*p >= 'A' && *p <= 'F') d = *p - 'A' + 10;
+      else break;
+      v = v * 16 + d;
+      if (v > 0xFFFFFFFFULL) {
+        parse_fail(s, "out of range");
+        return PARSE_ERROR;
+      }
+      digits++;
+    }
+  } else {
+    for (; *p >= '0' && *p <= '9'; p++) {
+      v = v * 10 + (*p - '0');
+      if (v > 0xFFFFFFFFULL) {
+        parse_fail(s, "out of range");
+        return PARSE_ERROR;
+      }
+      digits++;
+    }
+  }
+  if (!digits || !is_end(*p)) {
+    parse_fail(s, "not an integer");
+    return PARSE_ERROR;
+  }
+  *end = p;
+  *out = neg ? -(s64)v : (s64)v;
+  return PARSE_OK;
+}
+
+/* Scan a real number at s into *dec. Sets *end past it. */
+int parse_decimal(const char *s, const char **end, decimal *dec) {
+  const char *p = s;
+  int sig = 0;      /* significant digits in m */
+  int digits = 0;
+
+  memset(dec, 0, sizeof(*dec));
+  if (*p == '-' || *p == '+') dec->neg = *p++ == '-';
+
+  if (match_word(p, "inf") || match_word(p, "infinity") ||
+      match_word(p, "nan")) {
+    dec->special = tolower((int)*p);
+    while (!is_end(*p)) p++;
+    *end = p;
+    return PARSE_OK;
+  }
+
+  /* Hex integers are read as their value, like strtof does */
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    s64 v;
+    int is_hex;
+    if (parse_integer(p, end, &v, &is_hex) != PARSE_OK) {
+      parse_fail(s, parse_msg);
+      return PARSE_ERROR;
+    }
+    dec->m = (u64)v;
+    return PARSE_OK;
+  }
+
+  for (; *p >= '0' && *p <= '9'; p++, digits++) {
+    if (sig < 19) {
+      dec->m = dec->m * 10 + (*p - '0');
+      if (dec->m) sig++;
+    } else {
+      dec->e10++;
+      dec->truncated |= *p != '0';
+    }
+  }
+  if (*p == '.') {
+    for (p++; *p >= '0' && *p <= '9'; p++, digits++) {
+      if (sig < 19) {
+        dec->m = dec->m * 10 + (*p - '0');
+        if (dec->m) sig++;
+        dec->e10--;
+      } else {
+        dec->truncated |= *p != '0';
+      }
+    }
+  }
+  if (!digits) {
+    parse_fail(s, "not a number");
+    return PARSE_ERROR;
+  }
+  if (*p == 'e' || *p == 'E') {
+    int eneg = 0, ex = 0;
+    p++;
+    if (*p == '-' || *p == '+') eneg = *p++ == '-';
+    if (!(*p >= '0' && *p <= '9')) {
+      parse_fail(s, "bad exponent");
+      return PARSE_ERROR;
+    }
+    for (; *p >= '0' && *p <= '9'; p++) {
+      if (ex < 10000) ex = ex * 10 + (*p - '0');
+    }
+    dec->e10 += eneg ? -ex : ex;
+  }
+  if (!is_end(*p)) {
+    parse_fail(s, "not a number");
+    return PARSE_ERROR;
+  }
+  *end = p;
+  return PARSE_OK;
+}
+
+/* Copy the token s..end for strtof/strtod */
+int copy_token(const char *s, const char *end, char *tmp) {
+  int len = end - s;
+  if (len > MAX_NUMBER_LEN) {
+    parse_fail(s, "too long");
+    return 0;
+  }
+  memcpy(tmp, s, len);
+  tmp[len] = 0;
+  return 1;
+}
+
+/* Parse a float at s. Sets *end past it. */
+int parse_float(const char *s, const char **end, float *out) {
+  decimal dec;
+  char tmp[MAX_NUMBER_LEN + 1];
+
+  if (parse_decimal(s, end, &dec) != PARSE_OK) return PARSE_ERROR;
+
+  if (dec.special) {
+    *out = dec.special == 'n' ? NAN : (dec.neg ? -INFINITY : INFINITY);
+    return PARSE_OK;
+  }
+  if (dec.truncated || !decimal_to_float(dec.m, dec.e10, dec.neg, out)) {
+    if (!copy_token(s, *end, tmp)) return PARSE_ERROR;
+    *out = strtof(tmp, NULL);
+  }
+  if (isinf(*out)) {
+    parse_fail(s, "out of range");
+    return PARSE_ERROR;
+  }
+  return PARSE_OK;
+}
+
+/* Parse a double at s. Sets *end past it. */
+int parse_double(const char *s, const char **end, double *out) {
+  decimal dec;
+  char tmp[MAX_NUMBER_LEN + 1];
+
+  if (parse_decimal(s, end, &dec) != PARSE_OK) return PARSE_ERROR;
+
+  if (dec.special) {
+    *out = dec.special == 'n' ? NAN : (dec.neg ? -INFINITY : INFINITY);
+    return PARSE_OK;
+  }
+  if (dec.truncated || !decimal_to_double(dec.m, dec.e10, dec.neg, out)) {
+    if (!copy_token(s, *end, tmp)) return PARSE_ERROR;
+    *out = strtod(tmp, NULL);
+  }
+  if (isinf(*out)) {
+    parse_fail(s, "out of range");
+    return PARSE_ERROR;
+  }
+  return PARSE_OK;
+}
+
+/* Store v in an integer element of size bytes */
+void store_int(void *dest, int size, s64 v) {
+  switch (size) {
+  case 1:  *(u8 *)dest = (u8)v; break;
+  case 2:  *(u16 *)dest = (u16)v; break;
+  default: *(u32 *)dest = (u32)v; break;
+  }
+}
+
+/* Element i of an integer array, sign extended if sign is set */
+s64 load_int(const void *data, int size, int sign, u32 i) {
+  switch (size) {
+  case 1:  return sign ? ((const s8 *)data)[i] : ((const u8 *)data)[i];
+  case 2:  return sign ? ((const s16 *)data)[i] : ((const u16 *)data)[i];
+  default: return sign ? (s64)((const s32 *)data)[i] : (s64)((const u32 *)data)[i];
+  }
+}
+
+/* Parse the next value on a line into dest (an element of type).
+   *pos is advanced past the value, or past the bad token on error. */
+int parse_value(const char **pos, int type, void *dest) {
+  const type_info *t = &types[type];
+  const char *p = *pos;
+  const char *end;
+  int r, is_hex;
+  int bits = t->size * 8;
+  s64 v;
+  double d;
+  s32 raw;
+
+  while (is_sep(*p)) p++;
+  if (*p == 0 || *p == '\r' || *p == '\n') {
+    *pos = p;
+    return PARSE_END;
+  }
+
+  switch (t->kind) {
+  case TK_INT:
+  case TK_UINT:
+    r = parse_integer(p, &end, &v, &is_hex);
+    if (r != PARSE_OK) break;
+    if (t->kind == TK_UINT || is_hex) {
+      if (v < (t->kind == TK_UINT ? 0 : -(1LL << (bits - 1))) ||
+          v > (s64)((1ULL << bits) - 1))
+        r = PARSE_ERROR;
+    } else if (v < -(1LL << (bits - 1)) || v > (1LL << (bits - 1)) - 1) {
+      r = PARSE_ERROR;
+    }
+    if (r == PARSE_ERROR) parse_fail(p, "out of range");
+    else store_int(dest, t->size, v);
+    break;
+  case TK_FIXED:
+    r = parse_double(p, &end, &d);
+    if (r != PARSE_OK) break;
+    if (!double_to_fixed(d, t->frac, t->size, &raw)) {
+      parse_fail(p, "out of range");
+      r = PARSE_ERROR;
+    } else {
+      store_int(dest, t->size, raw);
+    }
+    break;
+  default: /* TK_FLOAT */
+    if (t->size == 4) {
+      r = parse_float(p, &end, (float *)dest);
+    } else if (t->size == 8) {
+      r = parse_double(p, &end, (double *)dest);
+    } else {
+      r = parse_double(p, &end, &d);
+      if (r != PARSE_OK) break;
+      *(u16 *)dest = double_to_half(d);
+      if (!isinf(d) && (*(u16 *)dest & 0x7FFF) == 0x7C00) {
+        parse_fail(p, "out of range");
+        r = PARSE_ERROR;
+      }
+    }
+    break;
+  }
+
+  if (r == PARSE_ERROR) {
+    while (!is_end(*p)) p++;
+    *pos = p;
+    return PARSE_ERROR;
+  }
+  *pos = end;
+  return PARSE_OK;
+}
+
+/* Parse a whole token as a single value, for command arguments */
+int parse_arg(const char *str, int type, void *dest) {
+  const char *p = str;
+  if (parse_value(&p, type, dest) != PARSE_OK) return FAILURE;
+  while (is_sep(*p)) p++;
+  if (*p) {
+    parse_fail(p, "unexpected");
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/* Addresses are always hex, the 0x is optional */
+int parse_address(const char *str, u32 *addr) {
+  char tmp[16];
+  if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+    return parse_arg(str, UINT_TYPE, addr);
+  if (strlen(str) > 8) {
+    parse_fail(str, "out of range");
+    return FAILURE;
+  }
+  tmp[0] = '0';
+  tmp[1] = 'x';
+  strcpy(tmp + 2, str);
+  return parse_arg(tmp, UINT_TYPE, addr);
+}
+
+/* Decimal digits of v into buf, returns the length */
+int fmt_uint(char *buf, u32 v) {
+  char tmp[10];
+  int n = 0, len;
+
+  while (v >= 100) {
+    int d = (v % 100) * 2;
+    v /= 100;
+    tmp[n++] = digit_pairs[d + 1];
+    tmp[n++] = digit_pairs[d];
+  }
+  if (v >= 10) {
+    tmp[n++] = digit_pairs[v * 2 + 1];
+    tmp[n++] = digit_pairs[v * 2];
+  } else {
+    tmp[n++] = '0' + v;
+  }
+  for (len = 0; n > 0; len ++) buf[len] = tmp[--n];
+  buf[len] = 0;
+  return len;
+}
+
+int fmt_int(char *buf, s32 v) {
+  if (v < 0) {
+    buf[0] = '-';
+    return 1 + fmt_uint(buf + 1, (u32)0 - (u32)v);
+  }
+  return fmt_uint(buf, v);
+}
+
+/* fmt_uint for up to 19 digits */
+int fmt_u64(char *buf, u64 v) {
+  int n, i;
+  u32 low;
+
+  if (v <= 0xFFFFFFFFULL) return fmt_uint(buf, (u32)v);
+  low = (u32)(v % 1000000000);
+  n = fmt_u64(buf, v / 1000000000);
+  for (i = 8; i >= 0; i--) {
+    buf[n + i] = '0' + low % 10;
+    low /= 10;
+  }
+  buf[n + 9] = 0;
+  return n + 9;
+}
+
+/* m * 10^e10 as text, for strtof/strtod */
+void decimal_str(char *tmp, u64 m, int e10) {
+  int n = fmt_u64(tmp, m);
+  tmp[n++] = 'e';
+  fmt_int(tmp + n, e10);
+}
+
+/* m * 10^e10 correctly rounded to double */
+double decimal_value(u64 m, int e10) {
+  double d;
+  char tmp[32];
+
+  if (decimal_to_double(m, e10, 0, &d)) return d;
+  decimal_str(tmp, m, e10);
+  return strtod(tmp, NULL);
+}
+
+/* Does m * 10^e10 read back as the element being printed? val points
+   at the (positive) element. */
+typedef int (*roundtrip_fn)(u64 m, int e10, const void *val);
+
+int float_roundtrips(u64 m, int e10, const void *val) {
+  float g;
+  char tmp[32];
+
+  if (!decimal_to_float(m, e10, 0, &g)) {
+    decimal_str(tmp, m, e10);
+    g = strtof(tmp, NULL);
+  }
+  return g == *(const float *)val;
+}
+
+int double_roundtrips(u64 m, int e10, const void *val) {
+  return decimal_value(m, e10) == *(const double *)val;
+}
+
+int half_roundtrips(u64 m, int e10, const void *val) {
+  return double_to_half(decimal_value(m, e10)) == *(const u16 *)val;
+}
+
+/* Fixed point is not symmetric (q15 has -1 but not 1), so the sign
+   has to take part in the check */
+typedef struct {
+  s32 raw;
+  int type;
+} fixed_val;
+
+int fixed_roundtrips(u64 m, int e10, const void *val) {
+  const fixed_val *fv = val;
+  double d = decimal_value(m, e10);
+  s32 raw;
+  return double_to_fixed(fv->raw < 0 ? -d : d, types[fv->type].frac,
+                         types[fv->type].size, &raw) && raw == fv->raw;
+}
+
+/* Shortest decimal representation of d (positive, finite, not zero)
+   for which same() holds, using at most max_digits digits. Returns the
+   length. */
+int fmt_shortest(char *buf, double d, int max_digits,
+                 roundtrip_fn same, const void *val) {
+  char digits[20];
+  int n = 0, nd, e10, e, p, i;
+  u64 m = 0, bits;
+
+  /* Decimal exponent: d is in [10^e10, 10^(e10+1)) */
+  memcpy(&bits, &d, sizeof(bits));
+  e10 = (((int)((bits >> 52) & 0x7FF) - 1023) * 1233) >> 12;
+  while (e10 > -330 && d < pow10_d(e10)) e10--;
+  while (d >= pow10_d(e10 + 1)) e10++;
+
+  /* Fewest significant digits that read back. max_digits are always
+     enough, but scaling by 10^k is not exact, so check each try. */
+  for (p = 1; p <= max_digits; p++) {
+    int k = p - 1 - e10;
+    double x;
+    if (k > 300 || k < -300) {
+      p = max_digits + 1;
+      break;
+    }
+    x = k >= 0 ? d * pow10_d(k) : d / pow10_d(-k);
+    m = (u64)(x + 0.5);
+    e = -k;
+    if (m >= pow10_int[p]) { /* rounded up to 10^p */
+      m /= 10;
+      e++;
+    }
+    if (same(m, e, val)) break;
+  }
+  if (p > max_digits) { /* scaling error, let newlib do it */
+    snprintf(buf, MAX_VALUE_LEN - 1, "%.*g", max_digits, d);
+    return strlen(buf);
+  }
+
+  nd = fmt_u64(digits, m);
+  e10 = e + nd - 1; /* exponent of the leading digit */
+  while (nd > 1 && digits[nd - 1] == '0') nd--;
+
+  if (e10 >= -5 && e10 < 16) {
+    if (e10 >= 0) {
+      for (i = 0; i <= e10; i++) buf[n++] = i < nd ? digits[i] : '0';
+      buf[n++] = '.';
+      if (nd > e10 + 1) {
+        for (; i < nd; i++) buf[n++] = digits[i];
+      } else {
+        buf[n++] = '0';
+      }
+    } else {
+      buf[n++] = '0';
+      buf[n++] = '.';
+      for (i = -1; i > e10; i--) buf[n++] = '0';
+      for (i = 0; i < nd; i++) buf[n++] = digits[i];
+    }
+  } else {
+    buf[n++] = digits[0];
+    if (nd > 1) {
+      buf[n++] = '.';
+      for (i = 1; i < nd; i++) buf[n++] = digits[i];
+    }
+    buf[n++] = 'e';
+    n += fmt_int(buf + n, e10);
+  }
+  buf[n] = 0;
+  return n;
+}
+
+/* Sign, zero, inf and nan. Returns the length, or -1 if d is an
+   ordinary number (and then *n is the length of the sign). */
+int fmt_special(char *buf, double d, int *n) {
+  *n = 0;
+  if (isnan(d)) {
+    strcpy(buf, "nan");
+    return 3;
+  }
+  if (signbit(d)) buf[(*n)++] = '-';
+  if (isinf(d)) {
+    strcpy(buf + *n, "inf");
+    return *n + 3;
+  }
+  if (d == 0.0) {
+    strcpy(buf + *n, "0.0");
+    return *n + 3;
+  }
+  return -1;
+}
+
+/* Shortest decimal representation of f that reads back as f.
+   Returns the length. buf needs room for MAX_VALUE_LEN characters. */
+int fmt_float(char *buf, float f) {
+  int n, r = fmt_special(buf, f, &n);
+  if (r >= 0) return r;
+  f = fabsf(f);
+  return n + fmt_shortest(buf + n, f, 9, float_roundtrips, &f);
+}
+
+int fmt_double(char *buf, double d) {
+  int n, r = fmt_special(buf, d, &n);
+  if (r >= 0) return r;
+  d = fabs(d);
+  return n + fmt_shortest(buf + n, d, 17, double_roundtrips, &d);
+}
+
+int fmt_half(char *buf, u16 h) {
+  int n, r = fmt_special(buf, half_to_double(h), &n);
+  if (r >= 0) return r;
+  h &= 0x7FFF;
+  return n + fmt_shortest(buf + n, half_to_double(h), 5, half_roundtrips, &h);
+}
+
+int fmt_fixed(char *buf, s32 raw, int type) {
+  fixed_val fv;
+  int n = 0;
+
+  if (raw == 0) {
+    strcpy(buf, "0.0");
+    return 3;
+  }
+  if (raw < 0) buf[n++] = '-';
+  fv.raw = raw;
+  fv.type = type;
+  return n + fmt_shortest(buf + n,
+                          fabs(raw / (double)(1U << types[type].frac)),
+                          17, fixed_roundtrips, &fv);
+}
+
+/* Element i of data (of type) as text, returns the length. buf needs
+   room for MAX_VALUE_LEN characters. */
+int fmt_value(char *buf, int type, const void *data, u32 i) {
+  const type_info *t = &types[type];
+
+  switch (t->kind) {
+  case TK_INT:
+    return fmt_int(buf, (s32)load_int(data, t->size, 1, i));
+  case TK_UINT:
+    return fmt_uint(buf, (u32)load_int(data, t->size, 0, i));
+  case TK_FIXED:
+    return fmt_fixed(buf, (s32)load_int(data, t->size, 1, i), type);
+  default: /* TK_FLOAT */
+    if (t->size == 2) return fmt_half(buf, ((const u16 *)data)[i]);
+    if (t->size == 8) return fmt_double(buf, ((const double *)data)[i]);
+    return fmt_float(buf, ((const float *)data)[i]);
+  }
+}
+
+/* One value per line, through the dump buffer */
+void print_values(const void *data, int type, u32 count) {
+  u32 i;
+  for (i = 0; i < count; i++) {
+    dump_reserve(MAX_VALUE_LEN + 2);
+    dump_pos += fmt_value(&dump_buffer[dump_pos], type, data, i);
+    dump_buffer[dump_pos++] = '\n';
+    dump_buffer[dump_pos++] = '\r';
+  }
+  dump_flush();
+}
+
+/* ************************************************************
+ * Array memory
+ *
+ * Array data lives in one of two arenas: DDR (a static pool of
+ * DDR_ARENA_SIZE bytes) or the on-chip memory. Every block starts and
+ * ends on a cache line (or a larger power of two on request), so
+ * flushing or invalidating an array never touches other data, and
+ * the address can be handed to the FPGA as it is.
+ *
+ * The bookkeeping is kept outside the arenas, in arena_block records
+ * on the normal heap: an address ordered list of all blocks and a
+ * list of the free ones. A freed block is merged with free
+ * neighbours, so reloading arrays of different sizes does not cut an
+ * arena into unusable pieces. Allocation is first fit.
+ * ********************************************************* */
+
+#define MEM_DDR    0
+#define MEM_OCM    1
+#define NUM_ARENAS 2
+
+#define ARENA_ALIGN 32 /* cache line */
+
+const char *mem_str[] = { "ddr", "ocm" };
+
+typedef struct arena_block {
+  UINTPTR addr;
+  u32 size;
+  int used;
+  struct arena *owner;
+  struct arena_block *prev, *next;           /* all blocks, by address */
+  struct arena_block *prev_free, *next_free; /* free blocks */
+} arena_block;
+
+typedef struct arena {
+  UINTPTR base;
+  u32 size;
+  arena_block *blocks;
+  arena_block *free_blocks;
+  u32 used;      /* bytes in used blocks */
+  u32 used_max;  /* high water mark of used */
+  u32 top_max;   /* high water mark of the end of a used block */
+  u32 allocs;
+  u32 failures;
+} arena;
+
+arena arenas[NUM_ARENAS];
+
+u8 ddr_pool[DDR_ARENA_SIZE] __attribute__((aligned(4096)));
+
+void free_list_add(arena *a, arena_block *b) {
+  b->prev_free = NULL;
+  b->next_free = a->free_blocks;
+  if (a->free_blocks) a->free_blocks->prev_free = b;
+  a->free_blocks = b;
+}
+
+void free_list_remove(arena *a, arena_block *b) {
+  if (b->prev_free) b->prev_free->next_free = b->next_free;
+  else a->free_blocks = b->next_free;
+  if (b->next_free) b->next_free->prev_free = b->prev_free;
+}
+
+/* New free block of size bytes at addr, linked in after prev */
+arena_block *arena_insert(arena *a, arena_block *prev, UINTPTR addr, u32 size) {
+  arena_block *b = (arena_block *)malloc(sizeof(arena_block));
+  if (!b) return NULL;
+
+  b->addr = addr;
+  b->size = size;
+  b->used = 0;
+  b->owner = a;
+  b->prev = prev;
+  b->next = prev ? prev->next : a->blocks;
+  if (b->next) b->next->prev = b;
+  if (prev) prev->next = b;
+  else a->blocks = b;
+  free_list_add(a, b);
+  return b;
+}
+
+void arena_unlink(arena *a, arena_block *b) {
+  if (b->prev) b->prev->next = b->next;
+  else a->blocks = b->next;
+  if (b->next) b->next->prev = b->prev;
+  free_list_remove(a, b);
+  free(b);
+}
+
+void arena_init(arena *a, UINTPTR base, u32 size) {
+  memset(a, 0, sizeof(arena));
+  a->base = base;
+  a->size = size;
+  if (size) arena_insert(a, NULL, base, size);
+}
+
+/* A block of at least bytes bytes in arena where, aligned to align
+   (a power of two, at least ARENA_ALIGN). NULL if there is no room. */
+arena_block *arena_alloc(int where, u32 bytes, u32 align) {
+  arena *a = &arenas[where];
+  arena_block *b;
+  u32 size = (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  u32 pad = 0;
+
+  if (size == 0) size = ARENA_ALIGN;
+  if (align < ARENA_ALIGN) align = ARENA_ALIGN;
+
+  for (b = a->free_blocks; b; b = b->next_free) {
+    pad = ((b->addr + align - 1) & ~(UINTPTR)(align - 1)) - b->addr;
+    if (b->size >= pad && b->size - pad >= size) break;
+  }
+  if (!b) {
+    a->failures++;
+    return NULL;
+  }
+
+  if (pad) { /* leave the space in front of the aligned start free */
+    if (!arena_insert(a, b->prev, b->addr, pad)) return NULL;
+    b->addr += pad;
+    b->size -= pad;
+  }
+  if (b->size > size) { /* and the rest after it */
+    if (!arena_insert(a, b, b->addr + size, b->size - size)) return NULL;
+    b->size = size;
+  }
+  free_list_remove(a, b);
+  b->used = 1;
+
+  a->used += size;
+  if (a->used > a->used_max) a->used_max = a->used;
+  if (b->addr + size - a->base > a->top_max) a->top_max = b->addr + size - a->base;
+  a->allocs++;
+  return b;
+}
+
+void arena_free(arena_block *b) {
+  arena *a = b->owner;
+  arena_block *n = b->next;
+  arena_block *p = b->prev;
+
+  a->used -= b->size;
+  b->used = 0;
+  free_list_add(a, b);
+
+  if (n && !n->used) {
+    b->size += n->size;
+    arena_unlink(a, n);
+  }
+  if (p && !p->used) {
+    p->size += b->size;
+    arena_unlink(a, b);
+  }
+}
+
+/* Make all of the OCM visible at OCM_BASE, by default the lower
+   192 KB of it sit at address 0 */
+void ocm_map_high() {
+  Xil_Out32(SLCR_UNLOCK, SLCR_UNLOCK_KEY);
+  Xil_Out32(SLCR_OCM_CFG, Xil_In32(SLCR_OCM_CFG) | OCM_CFG_RAM_HI_ALL);
+  Xil_Out32(SLCR_LOCK, SLCR_LOCK_KEY);
+  dsb();
+}
+
+void init_arenas() {
+  arena_init(&arenas[MEM_DDR], (UINTPTR)ddr_pool, DDR_ARENA_SIZE);
+#ifdef USE_OCM
+  ocm_map_high();
+  arena_init(&arenas[MEM_OCM], OCM_BASE, OCM_ARENA_SIZE);
+#else
+  arena_init(&arenas[MEM_OCM], 0, 0);
+#endif
+}
+
+/* Returns the arena named by str or -1 */
+int memFromString(char *str) {
+  int i;
+  for (i = 0; i < NUM_ARENAS; i ++) {
+    if (strcmp(str, mem_str[i]) == 0) return i;
+  }
+  return -1;
+}
+
+/* Take the placement options "-mem <ddr|ocm>" and "-align <bytes>"
+   out of args, wherever they are. */
+int memOptions(int *n, char **args, int *where, u32 *align) {
+  int i = 1, j;
+
+  *where = MEM_DDR;
+  *align = ARENA_ALIGN;
+
+  while (i < *n) {
+    if (strcmp(args[i], "-mem") == 0 && i + 1 < *n) {
+      *where = memFromString(args[i + 1]);
+      if (*where < 0) {
+        xil_printf("Unknown memory %s, use ddr or ocm\n\r", args[i + 1]);
+        return FAILURE;
+      }
+    } else if (strcmp(args[i], "-align") == 0 && i + 1 < *n) {
+      if (!parse_arg(args[i + 1], UINT_TYPE, align) ||
+          *align == 0 || (*align & (*align - 1))) {
+        xil_printf("Alignment must be a power of two\n\r");
+        return FAILURE;
+      }
+    } else {
+      i++;
+      continue;
+    }
+    for (j = i; j + 2 < *n; j++) args[j] = args[j + 2];
+    *n -= 2;
+  }
+  return SUCCESS;
+}
+
+void show_heap() {
+  int i;
+
+  for (i = 0; i < NUM_ARENAS; i ++) {
+    arena *a = &arenas[i];
+    arena_block *b;
+    u32 free_bytes = 0, largest = 0, used_blocks = 0, free_blocks = 0;
+
+    if (a->size == 0) {
+      xil_printf("%s: not available\n\r", mem_str[i]);
+      continue;
+    }
+    for (b = a->blocks; b; b = b->next) {
+      if (b->used) {
+        used_blocks++;
+      } else {
+        free_blocks++;
+        free_bytes += b->size;
+        if (b->size > largest) largest = b->size;
+      }
+    }
+    xil_printf("%s: %u bytes at %x\n\r", mem_str[i], a->size, (u32)a->base);
+    xil_printf("  used:  %u bytes in %u blocks, at most %u\n\r",
+               a->used, used_blocks, a->used_max);
+    xil_printf("  free:  %u bytes in %u blocks, largest %u (%u%% fragmented)\n\r",
+               free_bytes, free_blocks, largest,
+               free_bytes ? (u32)(100 - (u64)largest * 100 / free_bytes) : 0);
+    xil_printf("  top:   %u bytes from the start have been in use\n\r",
+               a->top_max);
+    xil_printf("  %u allocations, %u failed\n\r", a->allocs, a->failures);
+  }
+}
+
+/* ************************************************************
+ * Array management helper functions
+ *
+ * Arrays are known by a small integer ID and optionally by a name.
+ * The array records are allocated when an array is created and freed
+ * when it is removed. The ID table grows by doubling, and free IDs
+ * are kept on a doubly linked list threaded through it, so getting a
+ * free ID and taking a specific one are both O(1). Names go in a
+ * chained hash table that doubles when it gets 3/4 full.
+ *
+ * Wherever a command takes an array, an ID or a name can be given.
+ * A reference that is all digits is an ID.
+ *
+ * Views are arrays over memory the shell does not own: mapArray puts
+ * one over any address range (a buffer the PL writes, BRAM) and
+ * sliceArray over part of another array. They work with every array
+ * command, in place, and removing them leaves the memory alone. An
+ * array cannot be removed or reallocated while slices of it exist.
+ * ********************************************************* */
+
+typedef struct {
+  array *arr;          /* NULL if the ID is free */
+  int prev_free;
+  int next_free;
+} array_slot;
+
+array_slot *array_slots = NULL;
+int num_slots = 0;
+int first_free_id = -1;
+int num_arrays = 0;
+
+array **name_table = NULL;
+u32 name_buckets = 0; /* a power of two */
+u32 num_named = 0;
+
+u32 name_hash(const char *name) {
+  u32 h = 2166136261u; /* FNV-1a */
+  while (*name) {
+    h ^= (u8)*name++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+int isArrayId(const char *ref) {
+  if (!*ref) return 0;
+  while (*ref) {
+    if (!isdigit((int)*ref)) return 0;
+    ref++;
+  }
+  return 1;
+}
+
+int validArrayName(const char *name) {
+  int i;
+  if (!isalpha((int)name[0]) && name[0] != '_') return 0;
+  for (i = 1; name[i]; i++) {
+    if (!isalnum((int)name[i]) && name[i] != '_' && name[i] != '.' && name[i] != '-')
+      return 0;
+  }
+  return i < MAX_ARRAY_NAME;
+}
+
+void id_unlink(int id) {
+  array_slot *s = &array_slots[id];
+  if (s->prev_free >= 0) array_slots[s->prev_free].next_free = s->next_free;
+  else first_free_id = s->next_free;
+  if (s->next_free >= 0) array_slots[s->next_free].prev_free = s->prev_free;
+}
+
+void id_push(int id) {
+  array_slots[id].arr = NULL;
+  array_slots[id].prev_free = -1;
+  array_slots[id].next_free = first_free_id;
+  if (first_free_id >= 0) array_slots[first_free_id].prev_free = id;
+  first_free_id = id;
+}
+
+/* Make room for IDs up to at least id */
+int grow_slots(int id) {
+  int size = num_slots ? num_slots : 16;
+  int i;
+  array_slot *s;
+
+  while (size <= id) size *= 2;
+  if (size > MAX_ARRAY_ID + 1) size = MAX_ARRAY_ID + 1;
+  if (id > MAX_ARRAY_ID) return FAILURE;
+
+  s = (array_slot *)realloc(array_slots, size * sizeof(array_slot));
+  if (!s) return FAILURE;
+  array_slots = s;
+  /* pushed in reverse so that the lowest new ID is handed out first */
+  for (i = size - 1; i >= num_slots; i--) id_push(i);
+  num_slots = size;
+  return SUCCESS;
+}
+
+int grow_names() {
+  u32 size = name_buckets ? name_buckets * 2 : 64;
+  array **t = (array **)calloc(size, sizeof(array *));
+  u32 i;
+
+  if (!t) return FAILURE;
+  for (i = 0; i < name_buckets; i++) {
+    array *a = name_table[i];
+    while (a) {
+      array *next = a->next_name;
+      u32 h = name_hash(a->name) & (size - 1);
+      a->next_name = t[h];
+      t[h] = a;
+      a = next;
+    }
+  }
+  free(name_table);
+  name_table = t;
+  name_buckets = size;
+  return SUCCESS;
+}
+
+array *arrayByName(const char *name) {
+  array *a;
+  if (!name_buckets) return NULL;
+  for (a = name_table[name_hash(name) & (name_buckets - 1)]; a; a = a->next_name) {
+    if (strcmp(a->name, name) == 0) return a;
+  }
+  return NULL;
+}
+
+/* The array referred to by ref (an ID or a name), NULL if none */
+array *getArray(const char *ref) {
+  if (isArrayId(ref)) {
+    u32 id = strtoul(ref, NULL, 10);
+    return id < num_slots ? array_slots[id].arr : NULL;
+  }
+  return arrayByName(ref);
+}
+
+/* Same, but complains when there is no such array */
+array *argArray(const char *ref) {
+  array *a = getArray(ref);
+  if (!a) xil_printf("No array %s\n\r", ref);
+  return a;
+}
+
+/* A new, empty, array. ref is the ID or name to give it, or NULL
+   for the first free ID. */
+array *newArray(const char *ref) {
+  array *a;
+  int id;
+
+  int named = ref && !isArrayId(ref);
+
+  if (named) {
+    if (!validArrayName(ref)) {
+      xil_printf("Bad array name %s\n\r", ref);
+      return NULL;
+    }
+    if (arrayByName(ref)) {
+      xil_printf("Array %s already exists\n\r", ref);
+      return NULL;
+    }
+    if (num_named + 1 > name_buckets / 4 * 3 && !grow_names() && !name_buckets) {
+      xil_printf("Out of memory for array names\n\r");
+      return NULL;
+    }
+  }
+  if (ref && !named) {
+    u32 want = strtoul(ref, NULL, 10);
+    if (want > MAX_ARRAY_ID || (want >= num_slots && !grow_slots(want))) {
+      xil_printf("Array ID out of range (at most %d)\n\r", MAX_ARRAY_ID);
+      return NULL;
+    }
+    if (array_slots[want].arr) {
+      xil_printf("Array %u already exists\n\r", want);
+      return NULL;
+    }
+    id = want;
+    id_unlink(id);
+  } else {
+    if (first_free_id < 0 && !grow_slots(num_slots)) {
+      xil_printf("Out of array IDs\n\r");
+      return NULL;
+    }
+    id = first_free_id;
+    id_unlink(id);
+  }
+
+  a = (array *)calloc(1, sizeof(array));
+  if (!a) {
+    id_push(id);
+    xil_printf("Out of memory for array records\n\r");
+    return NULL;
+  }
+  a->id = id;
+  a->type = BYTE_TYPE;
+  array_slots[id].arr = a;
+  num_arrays++;
+
+  if (named) {
+    array **bucket = &name_table[name_hash(ref) & (name_buckets - 1)];
+    strcpy(a->name, ref);
+    a->next_name = *bucket;
+    *bucket = a;
+    num_named++;
+  }
+  return a;
+}
+
+/* Remove an array, its storage, name and ID */
+void freeArray(array *a) {
+  if (a->mem) arena_free(a->mem);
+  if (a->base) a->base->views--;
+  if (a->name[0]) {
+    array **p = &name_table[name_hash(a->name) & (name_buckets - 1)];
+    while (*p != a) p = &(*p)->next_name;
+    *p = a->next_name;
+    num_named--;
+  }
+  id_push(a->id);
+  num_arrays--;
+  free(a);
+}
+
+/* The data of a is in use by a background transfer, directly or
+   through the array a is a slice of */
+int array_pinned(array *a) {
+  return a->pinned || (a->base && a->base->pinned);
+}
+
+/* (Re)allocate the array ref (ID, name, or NULL for a new one) for
+   num elements of type, in arena where. Returns NULL on failure, an
+   existing array is then left as it was. */
+array *allocArray(const char *ref, int type, int num, int where, u32 align) {
+  array *a = ref ? getArray(ref) : NULL;
+  arena_block *mem;
+
+  /* Also keeps num * size from wrapping around */
+  if (num < 0 || (u32)num > arenas[where].size / types[type].size) {
+    xil_printf("Incorrect number of elements!\n\r");
+    return NULL;
+  }
+  if (a && array_pinned(a)) {
+    xil_printf("Array %s is in use by a transfer\n\r", ref);
+    return NULL;
+  }
+  if (a && a->views) {
+    xil_printf("Array %s has slices, remove them first\n\r", ref);
+    return NULL;
+  }
+
+  /* The new block first, so a failure leaves the old data alone */
+  mem = arena_alloc(where, num * types[type].size, align);
+  if (!mem) {
+    xil_printf("Error allocating memory for array (%u bytes in %s)\n\r",
+               num * types[type].size, mem_str[where]);
+    return NULL;
+  }
+  if (a) {
+    if (a->mem) arena_free(a->mem);
+    if (a->base) a->base->views--;
+    a->base = NULL;
+  } else {
+    a = newArray(ref);
+    if (!a) {
+      arena_free(mem);
+      return NULL;
+    }
+  }
+  a->mem = mem;
+  a->data = (char *)mem->addr;
+  a->type = type;
+  a->size = num;
+  a->owner = OWNER_CPU;
+  a->dirty_lo = a->dirty_hi = 0;
+  return a;
+}
+
+/* A view of num elements of type at data. base is the array it is
+   a slice of, or NULL for a view of plain memory (mapArray). */
+array *viewArray(const char *ref, int type, int num, char *data, array *base) {
+  array *a = ref ? getArray(ref) : NULL;
+
+  if (a && (array_pinned(a) || a->views || a == base)) {
+    xil_printf("Array %s is in use%s\n\r", ref,
+               a->views ? " by slices" : "");
+    return NULL;
+  }
+  if (a) freeArray(a);
+  a = newArray(ref);
+  if (!a) return NULL;
+
+  a->data = data;
+  a->type = type;
+  a->size = num;
+  a->base = base;
+  if (base) {
+    base->views++;
+  } else {
+    /* What is there now was put there by someone else, most likely
+       the PL: read it past the cache */
+    a->owner = OWNER_PL;
+  }
+  return a;
+}
+
+/* Where the data of a lives, for show */
+const char *array_mem_str(array *a) {
+  if (a->base) return "slice";
+  if (!a->mem) return "map";
+  return mem_str[a->mem->owner - arenas];
+}
+
+/* The arena to put an array like a in */
+int array_arena(array *a) {
+  while (a->base) a = a->base;
+  return a->mem ? a->mem->owner - arenas : MEM_DDR;
+}
+
+void freeArrays() {
+  int i = 0;
+  /* Slices first, they count themselves off their base */
+  for (i = 0; i < num_slots; i ++) {
+    if (array_slots[i].arr && array_slots[i].arr->base)
+      freeArray(array_slots[i].arr);
+  }
+  for (i = 0; i < num_slots; i ++) {
+    if (array_slots[i].arr) freeArray(array_slots[i].arr);
+  }
+}
+
+/* Returns the type index of type name str or -1 */
+int typeFromString(char *str) {
+  int i;
+  for (i = 0; i < NUM_TYPES; i ++) {
+    if (strcmp(str, types[i].name) == 0) return i;
+  }
+  return -1;
+}
+
+/* Size of the array data in bytes */
+u32 arrayBytes(array *a) {
+  return (u32)a->size * types[a->type].size;
+}
+
+/* ************************************************************
+ * Array cache coherency
+ *
+ * Each array has an owner. While the CPU owns it, the data can sit
+ * dirty in the caches, and dirty_lo..dirty_hi is the byte range
+ * written since the PL last saw it. While the PL owns it, the caches
+ * may hold stale copies of whatever the PL has since written.
+ *
+ * Commands call these at the points where the data changes hands:
+ *   array_cpu_write - before the CPU writes a range. A PL owned array
+ *                     is taken back first (invalidated whole).
+ *   array_cpu_read  - before the CPU reads a range. If the PL owns
+ *                     the array only that range is invalidated.
+ *   array_flush     - before the PL reads the array. Writes back the
+ *                     dirty range only.
+ *   array_to_pl     - before the PL may write the array.
+ * Ranges are widened to whole cache lines, which is safe because
+ * array storage starts and ends on a line (see "Array memory"). A
+ * mapped view need not, so lines it shares with other data are
+ * flushed rather than invalidated. A slice keeps no state of its own:
+ * it is that of the array it is cut from, at the slice's offset.
+ * cf and ci do the same by hand, for PL designs the shell does not
+ * drive itself.
+ * ********************************************************* */
+
+const char *owner_str[] = { "cpu", "pl" };
+
+/* Widen bytes [lo, hi) of a to cache lines */
+INTPTR line_range(array *a, u32 lo, u32 hi, u32 *len) {
+  INTPTR start = ((INTPTR)a->data + lo) & ~(ARENA_ALIGN - 1);
+  INTPTR end = ((INTPTR)a->data + hi + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  *len = end - start;
+  return start;
+}
+
+/* The array that holds the cache state of a, with off moved to it */
+array *array_root(array *a, u32 *off) {
+  if (!a->base) return a;
+  *off += a->data - a->base->data;
+  return a->base;
+}
+
+void array_cpu_read(array *a, u32 off, u32 len) {
+  INTPTR addr;
+  u32 bytes;
+
+  a = array_root(a, &off);
+  if (a->owner != OWNER_PL || len == 0) return;
+  addr = line_range(a, off, off + len, &bytes);
+  if (!a->mem && (addr < (INTPTR)a->data ||
+                  addr + bytes > (INTPTR)a->data + arrayBytes(a)))
+    Xil_DCacheFlushRange(addr, bytes);
+  else
+    Xil_DCacheInvalidateRange(addr, bytes);
+  if (off == 0 && len >= arrayBytes(a)) a->owner = OWNER_CPU;
+}
+
+void array_cpu_write(array *a, u32 off, u32 len) {
+  a = array_root(a, &off);
+  if (a->owner == OWNER_PL) array_cpu_read(a, 0, arrayBytes(a));
+  if (len == 0) return;
+  if (a->dirty_hi == a->dirty_lo) {
+    a->dirty_lo = off;
+    a->dirty_hi = off + len;
+  } else {
+    if (off < a->dirty_lo) a->dirty_lo = off;
+    if (off + len > a->dirty_hi) a->dirty_hi = off + len;
+  }
+}
+
+void array_flush(array *a) {
+  INTPTR addr;
+  u32 bytes;
+
+  while (a->base) a = a->base;
+  if (a->dirty_hi == a->dirty_lo) return;
+  addr = line_range(a, a->dirty_lo, a->dirty_hi, &bytes);
+  Xil_DCacheFlushRange(addr, bytes);
+  a->dirty_lo = a->dirty_hi = 0;
+}
+
+void array_to_pl(array *a) {
+  while (a->base) a = a->base;
+  array_flush(a);
+  a->owner = OWNER_PL;
+}
+
+/* ************************************************************
+ * Bitstream cache
+ *
+ * Bitstreams that are switched between often are kept in the cache
+ * under a name (cacheBitstream), in their own DDR blocks, so the
+ * arrays they came from can be freed. Each one is checked for the
+ * sync word when it is added and has a CRC-32, which identifies the
+ * configuration that is loaded in the FPGA: useBitstream does nothing
+ * when the CRC of the image equals that of the active configuration.
+ * Programming by other means (programFPGA, programFPGAFile) makes the
+ * active configuration unknown.
+ * ********************************************************* */
+
+#define MAX_BITSTREAMS 8
+
+/* Every Zynq bitstream has this word within its first few words */
+#define PCAP_SYNC_WORD   0xAA995566
+#define SYNC_SEARCH_WORDS 64
+
+typedef struct {
+  char name[MAX_ARRAY_NAME]; /* empty if the entry is unused */
+  arena_block *mem;
+  u32 size;     /* bytes */
+  u32 crc;
+  u32 switches; /* times this image was programmed */
+  XTime last;   /* ticks the last switch took */
+  XTime total;
+} bitstream;
+
+bitstream bitstreams[MAX_BITSTREAMS];
+
+int active_valid = 0; /* active_crc identifies the FPGA configuration */
+u32 active_crc;
+
+bitstream *bitstreamByName(const char *name) {
+  int i;
+  for (i = 0; i < MAX_BITSTREAMS; i ++) {
+    if (bitstreams[i].name[0] && strcmp(bitstreams[i].name, name) == 0)
+      return &bitstreams[i];
+  }
+  return NULL;
+}
+
+void show_bitstreams() {
+  int i;
+  xil_printf("Name\t Bytes\t CRC\t\t Switches\t Last us\t Mean us\n\r");
+  for (i = 0; i < MAX_BITSTREAMS; i ++) {
+    bitstream *b = &bitstreams[i];
+    if (!b->name[0]) continue;
+    xil_printf("%s%s\t %u\t %08x\t %u\t\t %u\t\t %u\n\r",
+               active_valid && active_crc == b->crc ? "*" : "",
+               b->name, b->size, b->crc, b->switches,
+               ticks_to_us(b->last),
+               b->switches ? ticks_to_us(b->total / b->switches) : 0);
+  }
+  xil_printf("Active configuration: ");
+  if (active_valid) xil_printf("crc %08x\n\r", active_crc);
+  else xil_printf("unknown\n\r");
+}
+
+/* ************************************************************
+ * Accelerators
+ *
+ * An accelerator is a kernel in the PL with an AXI-Lite register
+ * block, as generated by Vivado HLS:
+ *   ctrl + 0x0  ap_start (bit 0), ap_done (1), ap_idle (2)
+ *   ctrl + 0x4  global interrupt enable
+ *   ctrl + 0x8  interrupt enable, bit 0 is ap_done
+ *   ctrl + 0xC  interrupt status (toggle on write)
+ * and one register per kernel argument. The accel command describes
+ * one (bits and offsets can be changed for other layouts) and run
+ * binds arrays and scalars to the argument registers, starts the
+ * kernel and times it until ap_done. Array arguments are handed to
+ * the PL first, see "Array cache coherency".
+ *
+ * Without an interrupt the shell polls ap_done; with one (-irq) the
+ * end time is taken in the interrupt handler.
+ * ********************************************************* */
+
+#define MAX_ACCELS      8
+#define MAX_ACCEL_ARGS  16
+#define ACCEL_TIMEOUT_MS 1000
+
+#define ACCEL_GIE 0x4
+#define ACCEL_IER 0x8
+#define ACCEL_ISR 0xC
+
+typedef struct {
+  char name[MAX_ARRAY_NAME]; /* empty if the entry is unused */
+  UINTPTR base;
+  u32 ctrl;                  /* offset of the control register */
+  u32 start, done, idle;     /* masks in the control register */
+  int num_args;
+  u32 arg_off[MAX_ACCEL_ARGS];
+  int irq;                   /* -1 to poll */
+  u32 mhz;                   /* kernel clock, for cycle counts */
+  volatile int irq_seen;
+  XTime irq_time;
+  u32 runs;
+  XTime last;                /* ticks the last run took */
+  XTime total;
+} accel;
+
+accel accels[MAX_ACCELS];
+
+accel *accelByName(const char *name) {
+  int i;
+  for (i = 0; i < MAX_ACCELS; i ++) {
+    if (accels[i].name[0] && strcmp(accels[i].name, name) == 0)
+      return &accels[i];
+  }
+  return NULL;
+}
+
+void show_accels() {
+  int i, j;
+  xil_printf("Name\t Base\t\t Args\t\t IRQ\t MHz\t Runs\t Last us\t Mean us\n\r");
+  for (i = 0; i < MAX_ACCELS; i ++) {
+    accel *x = &accels[i];
+    if (!x->name[0]) continue;
+    xil_printf("%s\t %08x\t", x->name, (u32)x->base);
+    for (j = 0; j < x->num_args; j ++)
+      xil_printf("%s%x", j ? "," : " ", x->arg_off[j]);
+    if (x->irq < 0) xil_printf("\t -");
+    else xil_printf("\t %d", x->irq);
+    xil_printf("\t %u\t %u\t %u\t\t %u\n\r", x->mhz, x->runs,
+               ticks_to_us(x->last),
+               x->runs ? ticks_to_us(x->total / x->runs) : 0);
+  }
+}
+
+/* Kernel clock cycles in t ticks of the global timer */
+u32 ticks_to_cycles(XTime t, u32 mhz) {
+  return (u32)(t * mhz * 1000000 / COUNTS_PER_SECOND);
+}
+
+void accel_isr(void *ref) {
+  accel *x = (accel *)ref;
+  UINTPTR isr = x->base + x->ctrl + ACCEL_ISR;
+
+  XTime_GetTime(&x->irq_time);
+  Xil_Out32(isr, Xil_In32(isr));
+  x->irq_seen = 1;
+}
+
+void accel_release(accel *x) {
+  if (x->irq >= 0) {
+    XScuGic_Disable(&IntcInstance, x->irq);
+    XScuGic_Disconnect(&IntcInstance, x->irq);
+  }
+  memset(x, 0, sizeof(accel));
+}
+
+/* ************************************************************
+ * Memory bandwidth
+ *
+ * Kernels for membw: read (a stream of loads folded into a checksum),
+ * write (memset) and copy, 64 bytes per iteration with NEON when the
+ * compiler targets it, and a pointer chase for latency. The chase
+ * visits the cache lines of a block in a random cycle, so every load
+ * depends on the one before and prefetching does not help.
+ *
+ * The attributes of a range are those of its 1 MB sections in the
+ * translation table (MMUTable of the BSP).
+ * ********************************************************* */
+
+#define MEMBW_BYTES   (8 * 1024 * 1024) /* moved per block size and kernel */
+#define MEMBW_CHASES  (256 * 1024)      /* loads per latency measurement */
+#define MEMBW_MIN     1024
+#define SECTION_SIZE  0x100000
+
+extern u32 MMUTable[];
+
+volatile u32 membw_sink; /* keeps the read kernel from being removed */
+
+u32 bw_read(const u8 *p, u32 bytes) {
+  u32 i;
+#ifdef USE_NEON
+  uint32x4_t s0 = vdupq_n_u32(0), s1 = s0, s2 = s0, s3 = s0;
+
+  for (i = 0; i < bytes; i += 64) {
+    s0 = veorq_u32(s0, vld1q_u32((const u32 *)(p + i)));
+    s1 = veorq_u32(s1, vld1q_u32((const u32 *)(p + i + 16)));
+    s2 = veorq_u32(s2, vld1q_u32((const u32 *)(p + i + 32)));
+    s3 = veorq_u32(s3, vld1q_u32((const u32 *)(p + i + 48)));
+  }
+  s0 = veorq_u32(veorq_u32(s0, s1), veorq_u32(s2, s3));
+  return vgetq_lane_u32(s0, 0) ^ vgetq_lane_u32(s0, 1) ^
+         vgetq_lane_u32(s0, 2) ^ vgetq_lane_u32(s0, 3);
+#else
+  const volatile u64 *q = (const volatile u64 *)p;
+  u64 s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+  for (i = 0; i < bytes / 8; i += 8) {
+    s0 ^= q[i] ^ q[i + 4];
+    s1 ^= q[i + 1] ^ q[i + 5];
+    s2 ^= q[i + 2] ^ q[i + 6];
+    s3 ^= q[i + 3] ^ q[i + 7];
+  }
+  s0 ^= s1 ^ s2 ^ s3;
+  return (u32)(s0 ^ (s0 >> 32));
+#endif
+}
+
+void bw_write(u8 *p, u32 bytes, u8 v) {
+  u32 i;
+#ifdef USE_NEON
+  uint8x16_t x = vdupq_n_u8(v);
+
+  for (i = 0; i < bytes; i += 64) {
+    vst1q_u8(p + i, x);
+    vst1q_u8(p + i + 16, x);
+    vst1q_u8(p + i + 32, x);
+    vst1q_u8(p + i + 48, x);
+  }
+#else
+  volatile u64 *q = (volatile u64 *)p;
+  u64 x = v * 0x0101010101010101ULL;
+
+  for (i = 0; i < bytes / 8; i++) q[i] = x;
+#endif
+}
+
+void bw_copy(u8 *d, const u8 *s, u32 bytes) {
+  u32 i;
+#ifdef USE_NEON
+  for (i = 0; i < bytes; i += 64) {
+    uint8x16_t a = vld1q_u8(s + i);
+    uint8x16_t b = vld1q_u8(s + i + 16);
+    uint8x16_t c = vld1q_u8(s + i + 32);
+    uint8x16_t e = vld1q_u8(s + i + 48);
+    vst1q_u8(d + i, a);
+    vst1q_u8(d + i + 16, b);
+    vst1q_u8(d + i + 32, c);
+    vst1q_u8(d + i + 48, e);
+  }
+#else
+  volatile u64 *q = (volatile u64 *)d;
+  const volatile u64 *r = (const volatile u64 *)s;
+
+  for (i = 0; i < bytes / 8; i++) q[i] = r[i];
+#endif
+}
+
+/* Link the cache lines of the block at p into one random cycle
+   (Sattolo's algorithm). Each line holds the word offset of the
+   next in its first word. */
+void chase_setup(u32 *p, u32 bytes) {
+  u32 words = ARENA_ALIGN / 4;
+  u32 lines = bytes / ARENA_ALIGN;
+  u32 i, j, t, seed = 12345;
+
+  for (i = 0; i < lines; i++) p[i * words] = i;
+  for (i = lines - 1; i > 0; i--) {
+    seed = seed * 1103515245 + 12345;
+    j = (seed >> 8) % i;
+    t = p[i * words];
+    p[i * words] = p[j * words];
+    p[j * words] = t;
+  }
+  for (i = 0; i < lines; i++) p[i * words] *= words;
+}
+
+u32 chase(const volatile u32 *p, u32 loads) {
+  u32 off = 0;
+  while (loads--) off = p[off];
+  return off;
+}
+
+/* The TEX, C and B bits of a section entry give a cacheable
+   memory type (inner cacheable when TEX[2] is set) */
+int section_is_cacheable(u32 e) {
+  u32 tex = (e >> 12) & 7, cb = (e >> 2) & 3;
+
+  if ((e & 3) != 2) return 0;
+  if (tex & 4) return cb != 0;
+  return (tex << 2 | cb) == 2 || (tex << 2 | cb) == 3 || (tex << 2 | cb) == 7;
+}
+
+/* Memory type of a translation table section entry */
+const char *section_attr_str(u32 e) {
+  u32 tex = (e >> 12) & 7, cb = (e >> 2) & 3;
+
+  if ((e & 3) != 2) return "unmapped";
+  if (section_is_cacheable(e))
+    return tex == 0 && cb == 2 ? "cacheable (write-through)" : "cacheable";
+  if (tex & 4) return "non-cacheable";
+  switch (tex << 2 | cb) {
+  case 0:  return "strongly ordered";
+  case 1:
+  case 8:  return "device";
+  case 4:  return "non-cacheable";
+  default: return "other";
+  }
+}
+
+const char *region_str(UINTPTR addr) {
+  if (addr >= OCM_BASE) return "ocm";
+  if (addr < 0x40000000) return "ddr";
+  if (addr < 0xC0000000) return "pl";
+  return "io";
+}
+
+/* Time one kernel over block bytes at p, repeated until MEMBW_BYTES
+   have been moved. Returns GB/s. */
+double membw_run(int kernel, u8 *p, u32 block) {
+  u32 reps = block >= MEMBW_BYTES ? 1 : MEMBW_BYTES / block;
+  u32 i, sum = 0;
+  XTime t0, t1;
+
+  XTime_GetTime(&t0);
+  for (i = 0; i < reps; i++) {
+    switch (kernel) {
+    case 0: sum ^= bw_read(p, block); break;
+    case 1: bw_write(p, block, (u8)i); break;
+    default: bw_copy(p + block / 2, p, block / 2); break;
+    }
+  }
+  dsb();
+  XTime_GetTime(&t1);
+  membw_sink = sum;
+  if (kernel == 2) block /= 2;
+  return (double)block * reps * COUNTS_PER_SECOND / (t1 - t0) / 1e9;
+}
+
+/* ns per load of a pointer chase through block bytes at p */
+double membw_latency(u8 *p, u32 block) {
+  XTime t0, t1;
+
+  chase_setup((u32 *)p, block);
+  dsb();
+  chase((const u32 *)p, MEMBW_CHASES / 16); /* warm up */
+  XTime_GetTime(&t0);
+  membw_sink = chase((const u32 *)p, MEMBW_CHASES);
+  XTime_GetTime(&t1);
+  return (double)(t1 - t0) * 1e9 / COUNTS_PER_SECOND / MEMBW_CHASES;
+}
+
+/* ************************************************************
+ * Register polling
+ *
+ * watch and pulseAndWatch spin on a 32-bit word until its masked
+ * value matches. The timer is only read every WATCH_CHECK reads (for
+ * the timeout) and at the match, so the loop is one load, a compare
+ * and a branch, and a latency is known to about one read.
+ *
+ * The word is read around the caches: a section mapped cacheable
+ * (DDR, OCM) is mapped non-cacheable while the command runs. Device
+ * and strongly ordered sections (the PL windows) are used as they are.
+ * ********************************************************* */
+
+#define WATCH_CHECK   256  /* reads between looks at the timer */
+#define WATCH_MAX_MS  4000 /* latencies are kept as u32 ns */
+#define WATCH_BUCKETS 10
+#define WATCH_BAR     40   /* characters of the longest histogram bar */
+
+u32 ticks_to_ns(XTime ticks) {
+  return (u32)(ticks / COUNTS_PER_SECOND * 1000000000 +
+               ticks % COUNTS_PER_SECOND * 1000000000 / COUNTS_PER_SECOND);
+}
+
+/* Read addr until (word & mask) == value, or until limit ticks after
+   start. Returns 1 with the time of the matching read in *t, or 0
+   with the time it gave up. *v is the last word read. */
+int watch_spin(UINTPTR addr, u32 mask, u32 value, XTime start, XTime limit,
+               XTime *t, u32 *v, u32 *reads) {
+  u32 r = 0, k, x = 0;
+
+  for (;;) {
+    for (k = 0; k < WATCH_CHECK; k++) {
+      x = Xil_In32(addr);
+      if ((x & mask) == value) {
+        XTime_GetTime(t);
+        *v = x;
+        *reads = r + k + 1;
+        return 1;
+      }
+    }
+    r += WATCH_CHECK;
+    XTime_GetTime(t);
+    if (*t - start >= limit) {
+      *v = x;
+      *reads = r;
+      return 0;
+    }
+  }
+}
+
+/* Map the section of addr non-cacheable if it is cacheable. Returns
+   the entry for watch_unmap to put back, 0 if nothing was changed. */
+u32 watch_map(UINTPTR addr) {
+  u32 e = MMUTable[addr / SECTION_SIZE];
+
+  if (!section_is_cacheable(e)) return 0;
+  Xil_SetTlbAttributes(addr & ~(SECTION_SIZE - 1), NORM_NONCACHE);
+  return e;
+}
+
+void watch_unmap(UINTPTR addr, u32 saved) {
+  if (saved) Xil_SetTlbAttributes(addr & ~(SECTION_SIZE - 1), saved & 0xFFFFF);
+}
+
+/* Bars of WATCH_BUCKETS equal ranges from the first of n sorted
+   latencies to the p99, so that a few stragglers (an interrupt in
+   the loop) do not squeeze the rest into one bar. Those above it are
+   counted in a last bar. */
+void watch_histogram(const XTime *t, u32 n) {
+  u32 count[WATCH_BUCKETS + 1] = { 0 };
+  u32 lo = ticks_to_ns(t[0]);
+  u32 width = (ticks_to_ns(t[(n * 99 + 99) / 100 - 1]) - lo) / WATCH_BUCKETS + 1;
+  u32 i, b, len, most = 0;
+  char bar[WATCH_BAR + 1];
+
+  for (i = 0; i < n; i++) {
+    b = (ticks_to_ns(t[i]) - lo) / width;
+    if (b > WATCH_BUCKETS) b = WATCH_BUCKETS;
+    if (++count[b] > most) most = count[b];
+  }
+  for (b = 0; b <= WATCH_BUCKETS; b++) {
+    if (b == WATCH_BUCKETS && count[b] == 0) break;
+    len = (count[b] * WATCH_BAR + most - 1) / most;
+    memset(bar, '#', len);
+    bar[len] = 0;
+    if (b < WATCH_BUCKETS)
+      xil_printf("%10u - %10u ns %8u %s\n\r", lo + b * width,
+                 lo + (b + 1) * width - 1, count[b], bar);
+    else
+      xil_printf("%10u ns and above    %8u %s\n\r", lo + b * width, count[b],
+                 bar);
+  }
+}
+
+/* ************************************************************
+ * Array operations
+ *
+ * Element-wise kernels for arrayOp. Integer and fixed point results
+ * saturate at the limits of the type, fixed point products are
+ * rounded to nearest (ties away from zero, as when parsing). Floats
+ * follow IEEE 754, fp16 is computed in double and rounded once.
+ *
+ * With NEON, int, uint and float arrays go through the vector unit
+ * four elements at a time, and the remaining tail through the same
+ * scalar code as the other types. Note that NEON flushes subnormal
+ * floats to zero, where the scalar VFP code does not.
+ * ********************************************************* */
+
+#define OP_ADD     0
+#define OP_SUB     1
+#define OP_MUL     2
+#define OP_AXPY    3 /* alpha * x + y */
+#define OP_SCALE   4 /* alpha * x */
+#define OP_CONVERT 5
+#define NUM_OPS    6
+
+const char *op_str[NUM_OPS] = { "add", "sub", "mul", "axpy", "scale",
+                                "convert" };
+
+s64 clamp_s(s64 v, int size) {
+  s64 lim = 1LL << (size * 8 - 1);
+  return v < -lim ? -lim : v > lim - 1 ? lim - 1 : v;
+}
+
+u64 clamp_u(u64 v, int size) {
+  u64 lim = (1ULL << (size * 8)) - 1;
+  return v > lim ? lim : v;
+}
+
+/* v / 2^f rounded to nearest, ties away from zero */
+s64 round_shift(s64 v, int f) {
+  s64 h = 1LL << (f - 1);
+  return v >= 0 ? (v + h) >> f : -((-v + h) >> f);
+}
+
+/* Element i of any array as a double (exact for every type) */
+double elem_get(const void *data, int type, u32 i) {
+  const type_info *t = &types[type];
+
+  switch (t->kind) {
+  case TK_INT:
+  case TK_UINT:
+    return (double)load_int(data, t->size, t->kind == TK_INT, i);
+  case TK_FIXED:
+    return (double)load_int(data, t->size, 1, i) / (double)(1U << t->frac);
+  default:
+    if (t->size == 4) return ((const float *)data)[i];
+    if (t->size == 8) return ((const double *)data)[i];
+    return half_to_double(((const u16 *)data)[i]);
+  }
+}
+
+/* Store v as element i, rounded to nearest and saturated. NaN
+   becomes 0 in the integer and fixed point types. */
+void elem_set(void *data, int type, u32 i, double v) {
+  const type_info *t = &types[type];
+  double lo, hi;
+
+  switch (t->kind) {
+  case TK_INT:
+  case TK_UINT:
+  case TK_FIXED:
+    if (t->kind == TK_FIXED) v *= (double)(1U << t->frac);
+    if (t->kind == TK_UINT) {
+      lo = 0;
+      hi = (double)((1ULL << (t->size * 8)) - 1);
+    } else {
+      lo = -(double)(1ULL << (t->size * 8 - 1));
+      hi = -lo - 1;
+    }
+    v = v < 0 ? -floor(0.5 - v) : floor(v + 0.5);
+    if (!(v >= lo)) v = v < lo ? lo : 0; /* also nan */
+    if (v > hi) v = hi;
+    store_int((u8 *)data + i * t->size, t->size,
+              t->kind == TK_UINT ? (s64)(u64)v : (s64)v);
+    break;
+  default:
+    if (t->size == 4) ((float *)data)[i] = (float)v;
+    else if (t->size == 8) ((double *)data)[i] = v;
+    else ((u16 *)data)[i] = double_to_half(v);
+    break;
+  }
+}
+
+/* dst[i] = op(x[i], y[i]) for i in [from, count), all of type. y is
+   unused by scale, alpha by add, sub and mul. */
+void array_op_scalar(int op, int type, void *dst, const void *x,
+                     const void *y, const void *alpha, u32 from, u32 count) {
+  const type_info *t = &types[type];
+  int size = t->size;
+  u32 i;
+
+  switch (t->kind) {
+  case TK_INT:
+  case TK_FIXED: {
+    int f = t->kind == TK_FIXED ? t->frac : 0;
+    s64 al = alpha ? load_int(alpha, size, 1, 0) : 0;
+    for (i = from; i < count; i++) {
+      s64 a = load_int(x, size, 1, i);
+      s64 b = op == OP_SCALE ? 0 : load_int(y, size, 1, i);
+      s64 r;
+      switch (op) {
+      case OP_ADD:  r = a + b; break;
+      case OP_SUB:  r = a - b; break;
+      case OP_MUL:  r = f ? round_shift(a * b, f) : a * b; break;
+      case OP_AXPY: r = f ? round_shift(al * a + (b << f), f) : al * a + b; break;
+      default:      r = f ? round_shift(al * a, f) : al * a; break;
+      }
+      store_int((u8 *)dst + i * size, size, clamp_s(r, size));
+    }
+    break;
+  }
+  case TK_UINT: {
+    u64 al = alpha ? (u64)load_int(alpha, size, 0, 0) : 0;
+    for (i = from; i < count; i++) {
+      u64 a = (u64)load_int(x, size, 0, i);
+      u64 b = op == OP_SCALE ? 0 : (u64)load_int(y, size, 0, i);
+      u64 r;
+      switch (op) {
+      case OP_ADD:  r = a + b; break;
+      case OP_SUB:  r = a < b ? 0 : a - b; break;
+      case OP_MUL:  r = a * b; break;
+      case OP_AXPY: r = al * a + b; break;
+      default:      r = al * a; break;
+      }
+      store_int((u8 *)dst + i * size, size, (s64)clamp_u(r, size));
+    }
+    break;
+  }
+  default: /* TK_FLOAT */
+    if (size == 4) {
+      const float *a = (const float *)x, *b = (const float *)y;
+      float *d = (float *)dst;
+      float al = alpha ? *(const float *)alpha : 0;
+      for (i = from; i < count; i++) {
+        switch (op) {
+        case OP_ADD:  d[i] = a[i] + b[i]; break;
+        case OP_SUB:  d[i] = a[i] - b[i]; break;
+        case OP_MUL:  d[i] = a[i] * b[i]; break;
+        case OP_AXPY: d[i] = al * a[i] + b[i]; break;
+        default:      d[i] = al * a[i]; break;
+        }
+      }
+    } else if (size == 8) {
+      const double *a = (const double *)x, *b = (const double *)y;
+      double *d = (double *)dst;
+      double al = alpha ? *(const double *)alpha : 0;
+      for (i = from; i < count; i++) {
+        switch (op) {
+        case OP_ADD:  d[i] = a[i] + b[i]; break;
+        case OP_SUB:  d[i] = a[i] - b[i]; break;
+        case OP_MUL:  d[i] = a[i] * b[i]; break;
+        case OP_AXPY: d[i] = al * a[i] + b[i]; break;
+        default:      d[i] = al * a[i]; break;
+        }
+      }
+    } else {
+      double al = alpha ? half_to_double(*(const u16 *)alpha) : 0;
+      for (i = from; i < count; i++) {
+        double a = elem_get(x, type, i);
+        double b = op == OP_SCALE ? 0 : elem_get(y, type, i);
+        double r;
+        switch (op) {
+        case OP_ADD:  r = a + b; break;
+        case OP_SUB:  r = a - b; break;
+        case OP_MUL:  r = a * b; break;
+        case OP_AXPY: r = al * a + b; break;
+        default:      r = al * a; break;
+        }
+        elem_set(dst, type, i, r);
+      }
+    }
+    break;
+  }
+}
+
+#ifdef USE_NEON
+/* int and uint products are formed at 64 bits and narrowed with
+   saturation, like the scalar code */
+#define NARROW_MUL_S(a, b)                                          \
+  vcombine_s32(vqmovn_s64(vmull_s32(vget_low_s32(a), vget_low_s32(b))), \
+               vqmovn_s64(vmull_s32(vget_high_s32(a), vget_high_s32(b))))
+#define NARROW_MUL_U(a, b)                                          \
+  vcombine_u32(vqmovn_u64(vmull_u32(vget_low_u32(a), vget_low_u32(b))), \
+               vqmovn_u64(vmull_u32(vget_high_u32(a), vget_high_u32(b))))
+
+/* The NEON part of array_op_scalar for int, uint and float. Returns
+   the number of elements done, a multiple of 4. */
+u32 array_op_neon(int op, int type, void *dst, const void *x,
+                  const void *y, const void *alpha, u32 count) {
+  u32 n = count & ~3u, i;
+
+  if (type == FLOAT_TYPE) {
+    const float *a = (const float *)x, *b = (const float *)y;
+    float *d = (float *)dst;
+    float32x4_t al = vdupq_n_f32(alpha ? *(const float *)alpha : 0);
+    for (i = 0; i < n; i += 4) {
+      float32x4_t va = vld1q_f32(a + i), r;
+      switch (op) {
+      case OP_ADD:  r = vaddq_f32(va, vld1q_f32(b + i)); break;
+      case OP_SUB:  r = vsubq_f32(va, vld1q_f32(b + i)); break;
+      case OP_MUL:  r = vmulq_f32(va, vld1q_f32(b + i)); break;
+      case OP_AXPY: r = vmlaq_f32(vld1q_f32(b + i), va, al); break;
+      default:      r = vmulq_f32(va, al); break;
+      }
+      vst1q_f32(d + i, r);
+    }
+  } else if (type == INT_TYPE) {
+    const s32 *a = (const s32 *)x, *b = (const s32 *)y;
+    s32 *d = (s32 *)dst;
+    int32x4_t al = vdupq_n_s32(alpha ? *(const s32 *)alpha : 0);
+    for (i = 0; i < n; i += 4) {
+      int32x4_t va = vld1q_s32(a + i), r;
+      int64x2_t lo, hi;
+      switch (op) {
+      case OP_ADD:  r = vqaddq_s32(va, vld1q_s32(b + i)); break;
+      case OP_SUB:  r = vqsubq_s32(va, vld1q_s32(b + i)); break;
+      case OP_MUL:  r = NARROW_MUL_S(va, vld1q_s32(b + i)); break;
+      case OP_AXPY: {
+        int32x4_t vb = vld1q_s32(b + i);
+        lo = vaddw_s32(vmull_s32(vget_low_s32(al), vget_low_s32(va)),
+                       vget_low_s32(vb));
+        hi = vaddw_s32(vmull_s32(vget_high_s32(al), vget_high_s32(va)),
+                       vget_high_s32(vb));
+        r = vcombine_s32(vqmovn_s64(lo), vqmovn_s64(hi));
+        break;
+      }
+      default:      r = NARROW_MUL_S(al, va); break;
+      }
+      vst1q_s32(d + i, r);
+    }
+  } else if (type == UINT_TYPE) {
+    const u32 *a = (const u32 *)x, *b = (const u32 *)y;
+    u32 *d = (u32 *)dst;
+    uint32x4_t al = vdupq_n_u32(alpha ? *(const u32 *)alpha : 0);
+    for (i = 0; i < n; i += 4) {
+      uint32x4_t va = vld1q_u32(a + i), r;
+      uint64x2_t lo, hi;
+      switch (op) {
+      case OP_ADD:  r = vqaddq_u32(va, vld1q_u32(b + i)); break;
+      case OP_SUB:  r = vqsubq_u32(va, vld1q_u32(b + i)); break;
+      case OP_MUL:  r = NARROW_MUL_U(va, vld1q_u32(b + i)); break;
+      case OP_AXPY: {
+        uint32x4_t vb = vld1q_u32(b + i);
+        lo = vaddw_u32(vmull_u32(vget_low_u32(al), vget_low_u32(va)),
+                       vget_low_u32(vb));
+        hi = vaddw_u32(vmull_u32(vget_high_u32(al), vget_high_u32(va)),
+                       vget_high_u32(vb));
+        r = vcombine_u32(vqmovn_u64(lo), vqmovn_u64(hi));
+        break;
+      }
+      default:      r = NARROW_MUL_U(al, va); break;
+      }
+      vst1q_u32(d + i, r);
+    }
+  } else {
+    return 0;
+  }
+  return n;
+}
+#endif
+
+void array_op(int op, int type, void *dst, const void *x, const void *y,
+              const void *alpha, u32 count) {
+  u32 done = 0;
+#ifdef USE_NEON
+  done = array_op_neon(op, type, dst, x, y, alpha, count);
+#endif
+  array_op_scalar(op, type, dst, x, y, alpha, done, count);
+}
+
+void array_convert(void *dst, int dst_type, const void *src, int src_type,
+                   u32 count) {
+  u32 i = 0;
+#ifdef USE_NEON
+  /* int to float rounds the same way in NEON as in VFP */
+  if (dst_type == FLOAT_TYPE && src_type == INT_TYPE) {
+    for (; i + 4 <= count; i += 4)
+      vst1q_f32((float *)dst + i, vcvtq_f32_s32(vld1q_s32((const s32 *)src + i)));
+  } else if (dst_type == FLOAT_TYPE && src_type == UINT_TYPE) {
+    for (; i + 4 <= count; i += 4)
+      vst1q_f32((float *)dst + i, vcvtq_f32_u32(vld1q_u32((const u32 *)src + i)));
+  }
+#endif
+  for (; i < count; i++)
+    elem_set(dst, dst_type, i, elem_get(src, src_type, i));
+}
+
+/* ************************************************************
+ * Variables
+ *
+ * "set <name> <value>" defines a variable and $name or ${name} in a
+ * command line (typed or in a script) is replaced by its value
+ * before the line is split into tokens. Values are text; set can do
+ * integer arithmetic on two operands for sweeps:
+ *   set n $i * 1024
+ * ********************************************************* */
+
+#define MAX_VARS      32
+#define MAX_VAR_NAME  16
+#define MAX_VAR_VALUE 64
+
+typedef struct {
+  char name[MAX_VAR_NAME]; /* empty if the slot is free */
+  char value[MAX_VAR_VALUE];
+} variable;
+
+variable vars[MAX_VARS];
+
+int is_var_char(char c) {
+  return isalnum((int)c) || c == '_';
+}
+
+variable *var_find(const char *name, int len) {
+  int i;
+  for (i = 0; i < MAX_VARS; i++) {
+    if (strncmp(vars[i].name, name, len) == 0 && vars[i].name[len] == 0 &&
+        vars[i].name[0])
+      return &vars[i];
+  }
+  return NULL;
+}
+
+int var_set(const char *name, const char *value) {
+  variable *v;
+  int i, len = strlen(name);
+
+  for (i = 0; i < len; i++) {
+    if (!is_var_char(name[i])) break;
+  }
+  if (len == 0 || i < len || isdigit((int)name[0])) {
+    xil_printf("Bad variable name %s\n\r", name);
+    return FAILURE;
+  }
+  if (len >= MAX_VAR_NAME || strlen(value) >= MAX_VAR_VALUE) {
+    xil_printf("Variable name or value too long (%d/%d characters)\n\r",
+               MAX_VAR_NAME - 1, MAX_VAR_VALUE - 1);
+    return FAILURE;
+  }
+  v = var_find(name, len);
+  for (i = 0; !v && i < MAX_VARS; i++) {
+    if (!vars[i].name[0]) v = &vars[i];
+  }
+  if (!v) {
+    xil_printf("Too many variables (%d)\n\r", MAX_VARS);
+    return FAILURE;
+  }
+  strcpy(v->name, name);
+  strcpy(v->value, value);
+  return SUCCESS;
+}
+
+/* Copy line to out replacing $name and ${name} by their values.
+   A $ that is not followed by a name is kept. */
+int expand_vars(const char *line, char *out, int size) {
+  const char *p = line, *name;
+  int len, n = 0, brace;
+  variable *v;
+
+  while (*p) {
+    if (*p == '$' && (is_var_char(p[1]) || p[1] == '{')) {
+      brace = p[1] == '{';
+      name = p + 1 + brace;
+      for (len = 0; is_var_char(name[len]); len++);
+      if (brace && name[len] != '}') {
+        xil_printf("Missing } after ${%.*s\n\r", len, name);
+        return FAILURE;
+      }
+      v = var_find(name, len);
+      if (!v) {
+        xil_printf("Unknown variable $%.*s\n\r", len, name);
+        return FAILURE;
+      }
+      if (n + (int)strlen(v->value) >= size) break;
+      strcpy(out + n, v->value);
+      n += strlen(v->value);
+      p = name + len + brace;
+    } else {
+      if (n + 1 >= size) break;
+      out[n++] = *p++;
+    }
+  }
+  out[n] = 0;
+  if (*p) {
+    xil_printf("Line too long after replacing variables\n\r");
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/* ************************************************************
+ * Implementation of commands
+ * ********************************************************* */
+
+int exit_cmd(int n, char **args) {
+  running = 0;
+  return SUCCESS;
+}
+
+/* prints help message. Always returns success */
+int help_cmd(int n, char **args) {
+
+  if (n < 1 || n > 2) {
+      xil_printf("Wrong number of arguments!\n\rUsage: help [about]\n\r");
+  }
+  if (n == 2) {
+    xil_printf("Currently no valid abouts.\n\r");
+  } else {
+    xil_printf("%s", hlp_str);
+  }
+  return SUCCESS;
+}
+
+int mread_cmd(int n, char **args) {
+
+  u32 address;
+  u32 num_elts = 1; /* 1 element by default */
+  int type;
+  int fmt;
+
+  if (n < 3 || n > 4) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage: mread <type> <address>\n\r");
+    return FAILURE;
+  }
+
+  if (!parse_address(args[2], &address)) {
+    xil_printf("Bad address %s: %s\n\r", parse_token, parse_msg);
+    return FAILURE;
+  }
+
+  if (n == 4) {
+    if (!parse_arg(args[3], UINT_TYPE, &num_elts) || num_elts < 1) {
+      xil_printf("Bad count %s\n\r", args[3]);
+      return FAILURE;
+    }
+  }
+
+  /* Range form: mread <raw|hex|base64> <address> <num_bytes> */
+  fmt = dumpFmtFromString(args[1]);
+  if (fmt >= 0) {
+    if (n != 4) {
+      xil_printf("Usage: mread <raw|hex|base64> <address> <num_bytes>\n\r");
+      return FAILURE;
+    }
+    Xil_DCacheFlushRange(address, num_elts);
+    dump_bytes((u8 *)(UINTPTR)address, num_elts, fmt, 0);
+    return SUCCESS;
+  }
+
+  type = typeFromString(args[1]);
+  if (type < 0) {
+    xil_printf("Incorrect type specifier\n\r");
+    return FAILURE;
+  }
+
+  Xil_DCacheFlushRange(address, num_elts * types[type].size);
+  print_values((void *)(UINTPTR)address, type, num_elts);
+  return SUCCESS;
+}
+
+/* mwrite <type> <address> <value> [value ...]
+   Values go to consecutive elements starting at address. Each one is
+   written with a single access of the element size, so this also
+   works for device registers. */
+int mwrite_cmd(int n, char **args) {
+
+  u32 address;
+  int type;
+  int size;
+  int i;
+  u32 count = 0;
+  const char *pos;
+  union { u8 b; u16 h; u32 w; u64 d; } val;
+
+  if (n < 4) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage: mwrite <type> <address> <value> [value ...]\n\r");
+    return FAILURE;
+  }
+
+  if (!parse_address(args[2], &address)) {
+    xil_printf("Bad address %s: %s\n\r", parse_token, parse_msg);
+    return FAILURE;
+  }
+
+  type = typeFromString(args[1]);
+  if (type < 0) {
+    xil_printf("Incorrect type specifier\n\r");
+    return FAILURE;
+  }
+  size = types[type].size;
+
+  /* Check every value before writing any */
+  for (i = 3; i < n; i++) {
+    int r;
+    pos = args[i];
+    while ((r = parse_value(&pos, type, &val)) == PARSE_OK) count++;
+    if (r == PARSE_ERROR) {
+      xil_printf("Bad value %s: %s\n\r", parse_token, parse_msg);
+      return FAILURE;
+    }
+  }
+
+  for (i = 3; i < n; i++) {
+    pos = args[i];
+    while (parse_value(&pos, type, &val) == PARSE_OK) {
+      switch (size) {
+      case 1:  *(volatile u8 *)(UINTPTR)address = val.b; break;
+      case 2:  *(volatile u16 *)(UINTPTR)address = val.h; break;
+      case 4:  *(volatile u32 *)(UINTPTR)address = val.w; break;
+      default: *(volatile u64 *)(UINTPTR)address = val.d; break;
+      }
+      address += size;
+    }
+  }
+  Xil_DCacheFlushRange(address - count * size, count * size);
+
+  return SUCCESS;
+}
+
+int printArray(array *a) {
+  u32 bytes = arrayBytes(a);
+
+  array_cpu_read(a, 0, bytes);
+  print_values(a->data, a->type, a->size);
+  return SUCCESS;
+}
+
+/* dumpArray <array> [raw|hex|base64] [offset] [count] [-z] */
+int dumpArray_cmd(int n, char **args) {
+  array *a;
+  int fmt = DUMP_HEX;
+  int arg = 2;
+  u32 offset = 0;
+  u32 count;
+  int esize, i, z = 0;
+  arena_block *buf;
+  u32 bytes, packed;
+  char ratio[16];
+
+  for (i = 2; i < n; i++) {
+    if (strcmp(args[i], "-z") != 0) continue;
+    for (z = 1; i + 1 < n; i++) args[i] = args[i + 1];
+    n--;
+    break;
+  }
+  if (n < 2 || n > 5) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage: dumpArray <array> [raw|hex|base64] [offset] [count] [-z]\n\r");
+    return FAILURE;
+  }
+
+  a = argArray(args[1]);
+  if (!a) return FAILURE;
+
+  if (n > arg && !isdigit((int)args[arg][0])) {
+    fmt = dumpFmtFromString(args[arg]);
+    if (fmt < 0) {
+      xil_printf("Incorrect format %s\n\r", args[arg]);
+      return FAILURE;
+    }
+    arg++;
+  }
+
+  if (n > arg && !parse_arg(args[arg++], UINT_TYPE, &offset)) {
+    xil_printf("Bad offset %s: %s\n\r", parse_token, parse_msg);
+    return FAILURE;
+  }
+  if (offset > (u32)a->size) {
+    xil_printf("Offset out of range\n\r");
+    return FAILURE;
+  }
+  count = a->size - offset;
+  if (n > arg) {
+    if (!parse_arg(args[arg++], UINT_TYPE, &count)) {
+      xil_printf("Bad count %s: %s\n\r", parse_token, parse_msg);
+      return FAILURE;
+    }
+    if (count > a->size - offset) {
+      xil_printf("Count out of range\n\r");
+      return FAILURE;
+    }
+  }
+  if (n > arg) {
+    xil_printf("Too many arguments!\n\r");
+    return FAILURE;
+  }
+
+  esize = types[a->type].size;
+  bytes = count * esize;
+  array_cpu_read(a, offset * esize, bytes);
+  if (!z) {
+    dump_bytes((u8 *)a->data + offset * esize, bytes, fmt, 0);
+    return SUCCESS;
+  }
+
+  /* Pack it all first, the frame ends with a checksum of the data */
+  buf = arena_alloc(MEM_DDR, LZ4_FRAME_BOUND(bytes), ARENA_ALIGN);
+  if (!buf) {
+    xil_printf("No memory to pack %u bytes\n\r", bytes);
+    return FAILURE;
+  }
+  packed = lz4_frame_encode((u8 *)buf->addr, (u8 *)a->data + offset * esize,
+                            bytes);
+  dump_bytes((u8 *)buf->addr, packed, fmt, 1);
+  arena_free(buf);
+  ratio_str(ratio, sizeof(ratio), bytes, packed);
+  xil_printf("Packed %u bytes to %u (%s:1)\n\r", bytes, packed, ratio);
+  return SUCCESS;
+}
+
+int show_cmd(int n, char **args) {
+
+  int i;
+
+  if (n < 2 ) {
+    xil_printf("Wrong number of arguments!\n\rUsage: show <what>\n\r");
+    return FAILURE;
+  }
+
+  if (strcmp(args[1], "uart") == 0) {
+    show_uart();
+  } else if (strcmp(args[1], "heap") == 0) {
+    show_heap();
+  } else if (strcmp(args[1], "bitstreams") == 0) {
+    show_bitstreams();
+  } else if (strcmp(args[1], "accels") == 0) {
+    show_accels();
+  } else if (strcmp(args[1], "arrays") == 0) {
+    xil_printf("ID\t Name\t Addr\t Mem\t Type\t Size\t Owner\t Dirty\n\r");
+    for (i = 0; i < num_slots; i++) {
+      array *a = array_slots[i].arr;
+      array *r;
+      if (!a) continue;
+      r = a->base ? a->base : a;
+      xil_printf("%d\t %s\t %x\t %s\t %s\t %d\t %s\t %u\n\r", i,
+          a->name[0] ? a->name : "-", (unsigned int) a->data,
+          array_mem_str(a), types[a->type].name, a->size,
+          owner_str[r->owner], r->dirty_hi - r->dirty_lo);
+    }
+    xil_printf("%d arrays\n\r", num_arrays);
+  } else if (strcmp (args[1], "array") == 0) {
+
+    if (n < 3) {
+      xil_printf("Requires an array ID or name argument!\n\r");
+      return FAILURE;
+    }
+    array *a = getArray(args[2]);
+    if (!a) {
+      xil_printf("Available\n\r");
+    } else {
+      printArray(a);
+    }
+
+  } else {
+    xil_printf("No information available on %s\n\r", args[1]);
+  }
+  return SUCCESS;
+
+}
+
+/* Input lines for loadArray can hold any number of values, but have
+   to fit in this buffer */
+#define LOAD_LINE_SIZE 1024
+
+int loadArray_cmd(int n, char **args) {
+
+  int num = 0;
+  array *a;
+  int i = 0;
+  static char buffer[LOAD_LINE_SIZE];
+  int bytes = 0;
+  int type;
+  int esize;
+  int errors = 0;
+  int first_error = 0;
+  char first_token[sizeof(parse_token)];
+  const char *first_msg = "";
+  int where;
+  u32 align;
+  sum_opt sum;
+
+  if (!memOptions(&n, args, &where, &align)) return FAILURE;
+  if (!sumOption(&n, args, &sum)) return FAILURE;
+
+  if (n < 3 || n > 4) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage: loadArray <type> <num_elements> [ID|name] [-mem ddr|ocm] [-align bytes] [-sum alg[=hex]]\n\r");
+    return FAILURE;
+  }
+
+  type = typeFromString(args[1]);
+  if (type < 0) {
+    xil_printf("type %s not yet supported\n\r", args[1]);
+    return FAILURE;
+  }
+  esize = types[type].size;
+
+  if (!parse_arg(args[2], INT_TYPE, &num) || num < 1) {
+    xil_printf("Incorrect number of elements!\n\r");
+    return FAILURE;
+  }
+
+
+  a = allocArray(n == 4 ? args[3] : NULL, type, num, where, align);
+  if (!a) return FAILURE;
+
+  /* Read values until num have been seen. A bad value is stored as 0
+     and reading goes on, so that the rest of a pasted block is not
+     taken for commands. */
+  i = 0;
+  while (i < num) {
+    const char *pos = buffer;
+    int r;
+
+    if (inputline(buffer, LOAD_LINE_SIZE) == 0 &&
+        strlen(buffer) == LOAD_LINE_SIZE - 1) {
+      if (!errors++) {
+        first_error = i;
+        strcpy(first_token, "...");
+        first_msg = "line too long";
+      }
+    }
+    if (echo) xil_printf("\n\r");
+
+    while (i < num &&
+           (r = parse_value(&pos, type, a->data + i * esize)) != PARSE_END) {
+      if (r == PARSE_ERROR) {
+        memset(a->data + i * esize, 0, esize);
+        if (!errors++) {
+          first_error = i;
+          strcpy(first_token, parse_token);
+          first_msg = parse_msg;
+        }
+      }
+      i++;
+    }
+    while (is_sep(*pos)) pos++;
+    if (i == num && !is_end(*pos)) {
+      if (!errors++) {
+        parse_fail(pos, "more values than elements");
+        first_error = i;
+        strcpy(first_token, parse_token);
+        first_msg = parse_msg;
+      }
+    }
+  }
+  bytes = num * esize;
+
+  /* Written back when the PL needs it */
+  array_cpu_write(a, 0, bytes);
+  cmd_bytes += bytes;
+
+  if (errors) {
+    xil_printf("%d bad values, first at element %d (%s: %s)\n\r",
+               errors, first_error, first_token, first_msg);
+    return FAILURE;
+  }
+  return sum_report(&sum, (const u8 *)a->data, bytes);
+}
+
+int mkArray_cmd(int n, char **args) {
+  array *a;
+  int num = 0;
+  int type;
+  int where;
+  u32 align;
+
+  if (!memOptions(&n, args, &where, &align)) return FAILURE;
+
+  if (n < 3 || n > 4) {
+    xil_printf(
+            "Wrong number of arguments!\n\rUsage: mkArray <type> <num_elements> [ID|name] [-mem ddr|ocm] [-align bytes]\n\r");
+        return FAILURE;
+  }
+
+  type = typeFromString(args[1]);
+  if (type < 0) {
+    xil_printf("type %s not yet supported\n\r", args[1]);
+    return FAILURE;
+  }
+
+  if (!parse_arg(args[2], INT_TYPE, &num) || num < 1) {
+    xil_printf("Incorrect number of elements!\n\r");
+    return FAILURE;
+  }
+
+
+  a = allocArray(n == 4 ? args[3] : NULL, type, num, where, align);
+  if (!a) return FAILURE;
+  memset(a->data, 0, arrayBytes(a));
+  array_cpu_write(a, 0, arrayBytes(a));
+  return SUCCESS;
+}
+
+/* rmArray <array> [array ...] */
+int rmArray_cmd(int n, char **args) {
+  int i;
+  array *a;
+
+  if (n < 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage: rmArray <array> [array ...]\n\r");
+    return FAILURE;
+  }
+  for (i = 1; i < n; i++) {
+    a = argArray(args[i]);
+    if (!a) return FAILURE;
+    if (array_pinned(a)) {
+      xil_printf("Array %s is in use by a transfer\n\r", args[i]);
+      return FAILURE;
+    }
+    if (a->views) {
+      xil_printf("Array %s has slices, remove them first\n\r", args[i]);
+      return FAILURE;
+    }
+    freeArray(a);
+  }
+  return SUCCESS;
+}
+
+/* mapArray <address> <type> <num_elements> [ID|name] */
+int mapArray_cmd(int n, char **args) {
+  u32 addr, num;
+  int type;
+  array *a;
+
+  if (n < 4 || n > 5) {
+    xil_printf("Wrong number of arguments!\n\rUsage: mapArray <address> <type> <num_elements> [ID|name]\n\r");
+    return FAILURE;
+  }
+  type = typeFromString(args[2]);
+  if (type < 0) {
+    xil_printf("type %s not yet supported\n\r", args[2]);
+    return FAILURE;
+  }
+  if (!parse_address(args[1], &addr) ||
+      !parse_arg(args[3], UINT_TYPE, &num)) {
+    xil_printf("Bad argument %s: %s\n\r", parse_token, parse_msg);
+    return FAILURE;
+  }
+  if (num < 1 || num > 0x7FFFFFFF / types[type].size ||
+      (u64)addr + num * types[type].size > 0x100000000ULL) {
+    xil_printf("Incorrect number of elements!\n\r");
+    return FAILURE;
+  }
+  if (addr % types[type].size) {
+    xil_printf("Address is not aligned to %s elements\n\r", types[type].name);
+    return FAILURE;
+  }
+
+  a = viewArray(n == 5 ? args[4] : NULL, type, num, (char *)(UINTPTR)addr, NULL);
+  if (!a) return FAILURE;
+  xil_printf("Array %d\n\r", a->id);
+  return SUCCESS;
+}
+
+/* sliceArray <array> <offset> <count> [ID|name]
+   offset and count are in elements of array */
+int sliceArray_cmd(int n, char **args) {
+  u32 offset, count;
+  array *src, *a;
+  int esize;
+
+  if (n < 4 || n > 5) {
+    xil_printf("Wrong number of arguments!\n\rUsage: sliceArray <array> <offset> <count> [ID|name]\n\r");
+    return FAILURE;
+  }
+  src = argArray(args[1]);
+  if (!src) return FAILURE;
+  if (!parse_arg(args[2], UINT_TYPE, &offset) ||
+      !parse_arg(args[3], UINT_TYPE, &count) ||
+      count < 1 || offset > (u32)src->size || count > src->size - offset) {
+    xil_printf("Range out of bounds (array has %d elements)\n\r", src->size);
+    return FAILURE;
+  }
+
+  esize = types[src->type].size;
+  a = viewArray(n == 5 ? args[4] : NULL, src->type, count,
+                src->data + offset * esize, src->base ? src->base : src);
+  if (!a) return FAILURE;
+  xil_printf("Array %d\n\r", a->id);
+  return SUCCESS;
+}
+
+/* loadArrayBin -z: the payload is an LZ4 frame, unpacked block by
+   block into the array as the transfer brings them in */
+lz4_frame bin_frame;
+const u8 *bin_packed;
+u32 bin_used; /* bytes of bin_packed unpacked */
+
+int bin_unpack(u32 received) {
+  int r;
+
+  if (bin_used == 0) {
+    r = lz4_frame_header(&bin_frame, bin_packed, received);
+    if (r <= 0) return r == 0;
+    if ((bin_frame.flags & LZ4F_SIZE) && bin_frame.size != bin_frame.cap) {
+      lz4_msg = "LZ4 content size is not that of the array";
+      return FAILURE;
+    }
+    bin_used = r;
+  }
+  r = lz4_frame_feed(&bin_frame, bin_packed + bin_used, received - bin_used);
+  if (r < 0) return FAILURE;
+  bin_used += r;
+  return SUCCESS;
+}
+
+/* loadArrayBin <type> <num_elements> [ID|name] [-z <packed_bytes>]
+                [-mem ddr|ocm] [-align bytes] [-sum alg[=hex]] */
+int loadArrayBin_cmd(int n, char **args) {
+  array *a;
+  int num = 0;
+  int type;
+  u32 bytes;
+  int where;
+  u32 align;
+  sum_opt sum;
+  u32 packed = 0;
+  arena_block *buf = NULL;
+  XTime t0, t1;
+  int i, ok;
+
+  if (!memOptions(&n, args, &where, &align)) return FAILURE;
+  if (!sumOption(&n, args, &sum)) return FAILURE;
+  for (i = 1; i + 1 < n; i++) {
+    if (strcmp(args[i], "-z") != 0) continue;
+    if (!parse_arg(args[i + 1], UINT_TYPE, &packed) || packed == 0) {
+      xil_printf("Bad packed size %s\n\r", args[i + 1]);
+      return FAILURE;
+    }
+    for (; i + 2 < n; i++) args[i] = args[i + 2];
+    n -= 2;
+    break;
+  }
+
+  if (n < 3 || n > 4) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage: loadArrayBin <type> <num_elements> [ID|name] [-z packed_bytes] [-mem ddr|ocm] [-align bytes] [-sum alg[=hex]]\n\r");
+    return FAILURE;
+  }
+
+  type = typeFromString(args[1]);
+  if (type < 0) {
+    xil_printf("type %s not yet supported\n\r", args[1]);
+    return FAILURE;
+  }
+
+  if (!parse_arg(args[2], INT_TYPE, &num) || num < 1) {
+    xil_printf("Incorrect number of elements!\n\r");
+    return FAILURE;
+  }
+  bytes = num * types[type].size;
+
+  if (packed) {
+    buf = arena_alloc(MEM_DDR, packed, ARENA_ALIGN);
+    if (!buf) {
+      xil_printf("No memory for %u packed bytes\n\r", packed);
+      return FAILURE;
+    }
+  }
+
+  a = allocArray(n == 4 ? args[3] : NULL, type, num, where, align);
+  if (!a) {
+    if (buf) arena_free(buf);
+    return FAILURE;
+  }
+
+  XTime_GetTime(&t0);
+  if (packed) {
+    memset(&bin_frame, 0, sizeof(bin_frame));
+    bin_frame.dst = (u8 *)a->data;
+    bin_frame.cap = bytes;
+    bin_packed = (const u8 *)buf->addr;
+    bin_used = 0;
+    lz4_msg = "";
+    ok = bin_receive((u8 *)buf->addr, packed, bin_unpack);
+    if (ok && (bin_frame.state != LZ4_DONE || bin_frame.out != bytes)) {
+      lz4_msg = bin_frame.state != LZ4_DONE ? "LZ4 frame is cut short" :
+        "LZ4 frame is shorter than the array";
+      ok = 0;
+    }
+    arena_free(buf);
+  } else {
+    ok = bin_receive((u8 *)a->data, bytes, NULL);
+  }
+  XTime_GetTime(&t1);
+
+  if (!ok) {
+    freeArray(a);
+    xil_printf("\n\rTransfer aborted%s%s\n\r",
+               packed && lz4_msg[0] ? ": " : "", packed ? lz4_msg : "");
+    return FAILURE;
+  }
+
+  array_cpu_write(a, 0, bytes);
+
+  cmd_bytes += bytes;
+  xil_printf("\n\rLoaded %u bytes into array %d\n\r", bytes, a->id);
+  if (packed) lz4_report("Unpacked", bytes, packed, t1 - t0);
+  return sum_report(&sum, (const u8 *)a->data, bytes);
+}
+
+/* echo [on|off] */
+int echo_cmd(int n, char **args) {
+  if (n == 1) {
+    xil_printf("echo is %s\n\r", echo ? "on" : "off");
+  } else if (n == 2 && strcmp(args[1], "on") == 0) {
+    echo = 1;
+  } else if (n == 2 && strcmp(args[1], "off") == 0) {
+    echo = 0;
+  } else {
+    xil_printf("Usage: echo [on|off]\n\r");
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/* flow [none|xonxoff|rtscts] */
+int flow_cmd(int n, char **args) {
+#ifdef USE_UART_IRQ
+  int i;
+
+  if (n == 1) {
+    xil_printf("flow control is %s\n\r", flow_str[flow_mode]);
+    return SUCCESS;
+  }
+  if (n == 2) {
+    for (i = 0; i < sizeof(flow_str) / sizeof(char *); i ++) {
+      if (strcmp(args[1], flow_str[i]) == 0) {
+        uart_set_flow(i);
+        return SUCCESS;
+      }
+    }
+  }
+  xil_printf("Usage: flow [none|xonxoff|rtscts]\n\r");
+  return FAILURE;
+#else
+  xil_printf("Flow control needs USE_UART_IRQ\n\r");
+  return FAILURE;
+#endif
+}
+
+int dispatch(int num_toks, char **tokens);
+
+/* stats [reset] */
+int stats_cmd(int n, char **args) {
+  int i;
+  char rate[32];
+
+  if (n > 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage: stats [reset]\n\r");
+    return FAILURE;
+  }
+  if (n == 2) {
+    if (strcmp(args[1], "reset") != 0) {
+      xil_printf("Usage: stats [reset]\n\r");
+      return FAILURE;
+    }
+    cmd_stats_reset();
+    return SUCCESS;
+  }
+
+  xil_printf("Timer: %u ticks/s\n\r", (u32)COUNTS_PER_SECOND);
+  xil_printf("Command\t Calls\t Total us\t Min us\t Max us\t Mean us\t Bytes\t MB/s\n\r");
+  for (i = 0; i < NUM_CMDS; i++) {
+    cmd_stat *s = &cmd_stats[i];
+    if (s->calls == 0) continue;
+    rate_str(rate, sizeof(rate), s->bytes, s->total);
+    xil_printf("%s\t %u\t %u\t %u\t %u\t %u\t %u\t %s\n\r",
+               cmds[i], s->calls, ticks_to_us(s->total),
+               ticks_to_us(s->min), ticks_to_us(s->max),
+               ticks_to_us(s->total / s->calls), (u32)s->bytes, rate);
+  }
+  return SUCCESS;
+}
+
+/* time <command ...> */
+int time_cmd(int n, char **args) {
+  XTime t0, t1;
+  char rate[32];
+  int r;
+
+  if (n < 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage: time <command ...>\n\r");
+    return FAILURE;
+  }
+
+  XTime_GetTime(&t0);
+  r = dispatch(n - 1, args + 1);
+  XTime_GetTime(&t1);
+
+  if (cmd_bytes) {
+    rate_str(rate, sizeof(rate), cmd_bytes, t1 - t0);
+    xil_printf("time: %u us, %u bytes, %s MB/s\n\r",
+               ticks_to_us(t1 - t0), cmd_bytes, rate);
+  } else {
+    xil_printf("time: %u us\n\r", ticks_to_us(t1 - t0));
+  }
+  return r;
+}
+
+int cmp_ticks(const void *a, const void *b) {
+  XTime x = *(const XTime *)a, y = *(const XTime *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* bench [-a <array>] [-f <file>] <N> [warmup] <command ...>
+   Run a command warmup + N times with its output thrown away and
+   summarize the times of the last N runs. -a keeps the times (in ns)
+   in a uint array, -f appends the summary to a file on the sd card. */
+int bench_cmd(int n, char **args) {
+  const char *save_array = NULL;
+  const char *save_file = NULL;
+  u32 runs, warmup = 0, i;
+  u32 bytes = 0;
+  XTime *t, t0, t1, total = 0;
+  XTime tmin, tmed, tp99, tmax;
+  char rate[32];
+  int arg = 1, r = SUCCESS;
+
+  while (arg + 1 < n && args[arg][0] == '-') {
+    if (strcmp(args[arg], "-a") == 0) save_array = args[arg + 1];
+    else if (strcmp(args[arg], "-f") == 0) save_file = args[arg + 1];
+    else break;
+    arg += 2;
+  }
+  if (n - arg < 2 || !parse_arg(args[arg], UINT_TYPE, &runs) || runs == 0) {
+    xil_printf("Usage: bench [-a <array>] [-f <file>] <N> [warmup] <command ...>\n\r");
+    return FAILURE;
+  }
+  arg++;
+  if (isdigit((int)args[arg][0])) {
+    if (!parse_arg(args[arg], UINT_TYPE, &warmup) || n - arg < 2) {
+      xil_printf("Bad warmup count %s\n\r", args[arg]);
+      return FAILURE;
+    }
+    arg++;
+  }
+  for (i = 0; i < NUM_CMDS && strcmp(args[arg], cmds[i]) != 0; i++);
+  if (i == NUM_CMDS) {
+    xil_printf("%s: command not found\n\r", args[arg]);
+    return FAILURE;
+  }
+  if (strcmp(args[arg], "bench") == 0) {
+    xil_printf("bench cannot run bench\n\r");
+    return FAILURE;
+  }
+
+  t = (XTime *)malloc(runs * sizeof(XTime));
+  if (!t) {
+    xil_printf("No memory for %u samples\n\r", runs);
+    return FAILURE;
+  }
+
+  uart_flush();
+  out_quiet = 1;
+  for (i = 0; i < warmup + runs && r; i++) {
+    u32 before = cmd_bytes;
+    XTime_GetTime(&t0);
+    r = dispatch(n - arg, args + arg);
+    XTime_GetTime(&t1);
+    if (i >= warmup) {
+      t[i - warmup] = t1 - t0;
+      total += t1 - t0;
+      bytes = cmd_bytes - before;
+    }
+  }
+  out_quiet = 0;
+
+  if (!r) {
+    xil_printf("%s failed in run %u, run it alone to see why\n\r",
+               args[arg], i);
+    free(t);
+    return FAILURE;
+  }
+
+  qsort(t, runs, sizeof(XTime), cmp_ticks);
+  tmin = t[0];
+  tmed = t[(runs - 1) / 2];
+  tp99 = t[(runs * 99 + 99) / 100 - 1];
+  tmax = t[runs - 1];
+  rate_str(rate, sizeof(rate), bytes, tmed);
+
+  xil_printf("%u runs (%u warmup): min %u us, median %u us, p99 %u us, "
+             "max %u us, mean %u us",
+             runs, warmup, ticks_to_us(tmin), ticks_to_us(tmed),
+             ticks_to_us(tp99), ticks_to_us(tmax), ticks_to_us(total / runs));
+  if (bytes) xil_printf(", %u bytes, %s MB/s (median)", bytes, rate);
+  xil_printf("\n\r");
+
+  if (save_array) {
+    array *a = allocArray(save_array, UINT_TYPE, runs, MEM_DDR, ARENA_ALIGN);
+    if (!a) {
+      r = FAILURE;
+    } else {
+      for (i = 0; i < runs; i++)
+        ((u32 *)a->data)[i] = (u32)(t[i] * 1000000000ULL / COUNTS_PER_SECOND);
+      array_cpu_write(a, 0, arrayBytes(a));
+    }
+  }
+  free(t);
+
+  if (save_file) {
+#ifdef USE_SD
+    char path[MAX_PATH];
+    char line[256];
+    FIL fp;
+    UINT bw;
+    int len, j;
+
+    /* build, command, runs, min, median, p99, max (us), MB/s */
+    len = snprintf(line, sizeof(line), "%s %s,", __DATE__, __TIME__);
+    for (j = arg; j < n && len < (int)sizeof(line); j++)
+      len += snprintf(line + len, sizeof(line) - len, "%s%s",
+                      j > arg ? " " : "", args[j]);
+    if (len < (int)sizeof(line))
+      len += snprintf(line + len, sizeof(line) - len, ",%u,%u,%u,%u,%u,%s\n",
+                      runs, ticks_to_us(tmin), ticks_to_us(tmed),
+                      ticks_to_us(tp99), ticks_to_us(tmax), rate);
+    if (len >= (int)sizeof(line)) {
+      xil_printf("Command line too long to log\n\r");
+      return FAILURE;
+    }
+
+    strncpy(path, pwd, MAX_PATH);
+    strncat(path, save_file, MAX_PATH - strlen(path));
+    if (f_open(&fp, path, FA_WRITE | FA_OPEN_APPEND) != FR_OK) {
+      xil_printf("Could not open %s\n\r", save_file);
+      return FAILURE;
+    }
+    if (f_write(&fp, line, len, &bw) != FR_OK || bw != (UINT)len) {
+      f_close(&fp);
+      xil_printf("Could not append to %s\n\r", save_file);
+      return FAILURE;
+    }
+    f_close(&fp);
+#else
+    xil_printf("No sd card (USE_SD not set)\n\r");
+    return FAILURE;
+#endif
+  }
+  return r;
+}
+
+/* membw <array> | <address> <bytes>  [-min <bytes>] [-attr <attr>]
+   Read, write, copy bandwidth and load latency for block sizes from
+   min to the whole range. The range is overwritten. */
+int membw_cmd(int n, char **args) {
+  array *a = NULL;
+  UINTPTR addr;
+  u32 bytes, block, min = MEMBW_MIN, v, s;
+  u32 first, last, attr = 0;
+  u32 *saved = NULL;
+  int i, j, set_attr = 0;
+  char rb[16], wb[16], cb[16], lat[16];
+
+  /* Options, like memOptions */
+  i = 1;
+  while (i < n) {
+    if (strcmp(args[i], "-min") == 0 && i + 1 < n) {
+      /* copy moves half a block, 64 bytes at a time */
+      if (!parse_arg(args[i + 1], UINT_TYPE, &min) || min < 128 ||
+          (min & (min - 1))) {
+        xil_printf("-min must be a power of two, at least 128\n\r");
+        return FAILURE;
+      }
+    } else if (strcmp(args[i], "-attr") == 0 && i + 1 < n) {
+      set_attr = 1;
+      if (strcmp(args[i + 1], "cached") == 0) attr = NORM_WB_CACHE;
+      else if (strcmp(args[i + 1], "nocache") == 0) attr = NORM_NONCACHE;
+      else if (strcmp(args[i + 1], "device") == 0) attr = DEVICE_MEMORY;
+      else {
+        xil_printf("Unknown attribute %s, use cached, nocache or device\n\r",
+                   args[i + 1]);
+        return FAILURE;
+      }
+    } else {
+      i++;
+      continue;
+    }
+    for (j = i; j + 2 < n; j++) args[j] = args[j + 2];
+    n -= 2;
+  }
+
+  if (n == 2) {
+    a = argArray(args[1]);
+    if (!a) return FAILURE;
+    addr = (UINTPTR)a->data;
+    bytes = arrayBytes(a);
+  } else if (n == 3) {
+    if (!parse_address(args[1], &v) ||
+        !parse_arg(args[2], UINT_TYPE, &bytes)) {
+      xil_printf("Bad argument %s: %s\n\r", parse_token, parse_msg);
+      return FAILURE;
+    }
+    addr = v;
+  } else {
+    xil_printf("Wrong number of arguments!\n\rUsage:  membw <array> | <address> <bytes> [-min <bytes>] [-attr <attr>]\n\r");
+    return FAILURE;
+  }
+  if (addr & (ARENA_ALIGN - 1)) {
+    xil_printf("Range must start on a cache line\n\r");
+    return FAILURE;
+  }
+  if (bytes < min) {
+    xil_printf("Range is smaller than %u bytes\n\r", min);
+    return FAILURE;
+  }
+  if (a && array_pinned(a)) {
+    xil_printf("Array %s is in use by a transfer\n\r", args[1]);
+    return FAILURE;
+  }
+
+  first = addr / SECTION_SIZE;
+  last = (addr + bytes - 1) / SECTION_SIZE;
+  if (set_attr) {
+    /* Other data must not share the sections */
+    if (addr % SECTION_SIZE || bytes % SECTION_SIZE) {
+      xil_printf("-attr needs whole 1 MB sections (mkArray -align 1048576)\n\r");
+      return FAILURE;
+    }
+    saved = (u32 *)malloc((last - first + 1) * sizeof(u32));
+    if (!saved) {
+      xil_printf("Out of memory\n\r");
+      return FAILURE;
+    }
+    for (s = first; s <= last; s++) {
+      saved[s - first] = MMUTable[s];
+      Xil_SetTlbAttributes(s * SECTION_SIZE, attr);
+    }
+  }
+  if (a) array_cpu_write(a, 0, bytes);
+
+  xil_printf("%08x +%u, %s, %s", (u32)addr, bytes, region_str(addr),
+             section_attr_str(MMUTable[first]));
+  if (last != first) xil_printf(" (first of %u sections)", last - first + 1);
+  xil_printf("\n\rBlock\t\t Read GB/s\t Write GB/s\t Copy GB/s\t Latency ns\n\r");
+
+  for (block = min; block <= bytes && block; block <<= 1) {
+    snprintf(rb, sizeof(rb), "%.3f", membw_run(0, (u8 *)addr, block));
+    snprintf(wb, sizeof(wb), "%.3f", membw_run(1, (u8 *)addr, block));
+    snprintf(cb, sizeof(cb), "%.3f", membw_run(2, (u8 *)addr, block));
+    snprintf(lat, sizeof(lat), "%.1f", membw_latency((u8 *)addr, block));
+    xil_printf("%u\t\t %s\t\t %s\t\t %s\t\t %s\n\r", block, rb, wb, cb, lat);
+  }
+
+  if (set_attr) {
+    for (s = first; s <= last; s++)
+      Xil_SetTlbAttributes(s * SECTION_SIZE, saved[s - first] & 0xFFFFF);
+    free(saved);
+  }
+  return SUCCESS;
+}
+
+/* Options of watch and pulseAndWatch, ahead of the other arguments.
+   -n and -a are only taken when runs is given. */
+int watch_options(int n, char **args, int *arg, u32 *mhz, u32 *runs,
+                  const char **save_array) {
+  while (*arg + 1 < n && args[*arg][0] == '-') {
+    const char *opt = args[*arg], *val = args[*arg + 1];
+
+    if (strcmp(opt, "-mhz") == 0) {
+      if (!parse_arg(val, UINT_TYPE, mhz) || *mhz == 0) {
+        xil_printf("Bad clock %s\n\r", val);
+        return FAILURE;
+      }
+    } else if (runs && strcmp(opt, "-n") == 0) {
+      if (!parse_arg(val, UINT_TYPE, runs) || *runs == 0) {
+        xil_printf("Bad run count %s\n\r", val);
+        return FAILURE;
+      }
+    } else if (runs && strcmp(opt, "-a") == 0) {
+      *save_array = val;
+    } else {
+      break;
+    }
+    *arg += 2;
+  }
+  return SUCCESS;
+}
+
+/* Only a word in a mapped section can be read or written without a
+   fault that would take the shell down */
+int watch_word(u32 addr) {
+  if ((addr & 3) || (MMUTable[addr / SECTION_SIZE] & 3) != 2) {
+    xil_printf("Address %08x is not a mapped word\n\r", addr);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/* The address, mask and value of a watch, and the optional timeout
+   after them */
+int watch_args(int n, char **args, int arg, u32 *addr, u32 *mask,
+               u32 *value, u32 *timeout_ms) {
+  if (!parse_address(args[arg], addr) ||
+      !parse_arg(args[arg + 1], UINT_TYPE, mask) ||
+      !parse_arg(args[arg + 2], UINT_TYPE, value)) {
+    xil_printf("Bad argument %s: %s\n\r", parse_token, parse_msg);
+    return FAILURE;
+  }
+  if (arg + 3 < n) {
+    if (!parse_arg(args[arg + 3], UINT_TYPE, timeout_ms) ||
+        *timeout_ms == 0 || *timeout_ms > WATCH_MAX_MS) {
+      xil_printf("Timeout must be 1 to %u ms\n\r", WATCH_MAX_MS);
+      return FAILURE;
+    }
+  }
+  if (!watch_word(*addr)) return FAILURE;
+  if (*value & ~*mask) {
+    xil_printf("Value %08x has bits outside mask %08x\n\r", *value, *mask);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/* watch [-mhz <clock>] <address> <mask> <value> [timeout_ms]
+   Spin on the word at address until (word & mask) == value and show
+   how long that took, e.g. for a flag the PL sets in a buffer. */
+int watch_cmd(int n, char **args) {
+  u32 addr, mask, value, timeout_ms = 1000, mhz = 100;
+  u32 v, reads, saved;
+  XTime t0, t1;
+  int arg = 1, ok;
+
+  if (!watch_options(n, args, &arg, &mhz, NULL, NULL)) return FAILURE;
+  if (n - arg < 3 || n - arg > 4) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  watch [-mhz <clock>] <address> <mask> <value> [timeout_ms]\n\r");
+    return FAILURE;
+  }
+  if (!watch_args(n, args, arg, &addr, &mask, &value, &timeout_ms))
+    return FAILURE;
+
+  saved = watch_map(addr);
+  uart_flush();
+  XTime_GetTime(&t0);
+  ok = watch_spin(addr, mask, value, t0,
+                  (XTime)timeout_ms * (COUNTS_PER_SECOND / 1000),
+                  &t1, &v, &reads);
+  watch_unmap(addr, saved);
+
+  if (!ok) {
+    xil_printf("No match within %u ms, last read %08x (%u reads)\n\r",
+               timeout_ms, v, reads);
+    return FAILURE;
+  }
+  xil_printf("%08x after %u ns, %u cycles at %u MHz (%u reads)\n\r", v,
+             ticks_to_ns(t1 - t0), ticks_to_cycles(t1 - t0, mhz), mhz, reads);
+  return SUCCESS;
+}
+
+/* pulseAndWatch [-n <N>] [-a <array>] [-mhz <clock>]
+                 <waddr> <wval> <raddr> <mask> <value> [timeout_ms]
+   Write wval to waddr and spin on raddr as watch does, timing from
+   just before the write. With -n the pulse is repeated N times and
+   the latencies are summarized in a histogram; the condition has to
+   be cleared by the write or by the read that sees it (as ap_done
+   is). -a keeps the latencies (ns, in run order) in a uint array. */
+int pulseAndWatch_cmd(int n, char **args) {
+  const char *save_array = NULL;
+  u32 waddr, wval, raddr, mask, value, timeout_ms = 1000, mhz = 100;
+  u32 runs = 1, v = 0, reads = 0, total_reads = 0, wsaved, rsaved, i;
+  XTime *t, t0, t1, limit, total = 0;
+  int arg = 1, ok = 1;
+
+  if (!watch_options(n, args, &arg, &mhz, &runs, &save_array))
+    return FAILURE;
+  if (n - arg < 5 || n - arg > 6) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  pulseAndWatch [-n <N>] [-a <array>] [-mhz <clock>] <waddr> <wval> <raddr> <mask> <value> [timeout_ms]\n\r");
+    return FAILURE;
+  }
+  if (!parse_address(args[arg], &waddr) ||
+      !parse_arg(args[arg + 1], UINT_TYPE, &wval)) {
+    xil_printf("Bad argument %s: %s\n\r", parse_token, parse_msg);
+    return FAILURE;
+  }
+  if (!watch_word(waddr)) return FAILURE;
+  if (!watch_args(n, args, arg + 2, &raddr, &mask, &value, &timeout_ms))
+    return FAILURE;
+
+  t = (XTime *)malloc(runs * sizeof(XTime));
+  if (!t) {
+    xil_printf("No memory for %u samples\n\r", runs);
+    return FAILURE;
+  }
+
+  /* The write must not sit in the cache either */
+  wsaved = watch_map(waddr);
+  rsaved = watch_map(raddr);
+  limit = (XTime)timeout_ms * (COUNTS_PER_SECOND / 1000);
+  uart_flush();
+  for (i = 0; i < runs && ok; i++) {
+    XTime_GetTime(&t0);
+    Xil_Out32(waddr, wval);
+    ok = watch_spin(raddr, mask, value, t0, limit, &t1, &v, &reads);
+    t[i] = t1 - t0;
+    total += t1 - t0;
+    total_reads += reads;
+  }
+  watch_unmap(raddr, rsaved);
+  watch_unmap(waddr, wsaved);
+
+  if (!ok) {
+    xil_printf("No match within %u ms", timeout_ms);
+    if (runs > 1) xil_printf(" in run %u", i);
+    xil_printf(", last read %08x (%u reads)\n\r", v, reads);
+    free(t);
+    return FAILURE;
+  }
+
+  if (runs == 1) {
+    xil_printf("%08x after %u ns, %u cycles at %u MHz (%u reads)\n\r", v,
+               ticks_to_ns(t[0]), ticks_to_cycles(t[0], mhz), mhz, reads);
+  }
+
+  if (save_array) {
+    array *a = allocArray(save_array, UINT_TYPE, runs, MEM_DDR, ARENA_ALIGN);
+    if (!a) {
+      free(t);
+      return FAILURE;
+    }
+    for (i = 0; i < runs; i++) ((u32 *)a->data)[i] = ticks_to_ns(t[i]);
+    array_cpu_write(a, 0, arrayBytes(a));
+  }
+
+  if (runs > 1) {
+    XTime tmed;
+    char per_read[16];
+
+    qsort(t, runs, sizeof(XTime), cmp_ticks);
+    tmed = t[(runs - 1) / 2];
+    xil_printf("%u runs: min %u ns, median %u ns, p99 %u ns, max %u ns, "
+               "mean %u ns\n\r",
+               runs, ticks_to_ns(t[0]), ticks_to_ns(tmed),
+               ticks_to_ns(t[(runs * 99 + 99) / 100 - 1]),
+               ticks_to_ns(t[runs - 1]), ticks_to_ns(total / runs));
+    snprintf(per_read, sizeof(per_read), "%.1f",
+             (double)total * 1e9 / COUNTS_PER_SECOND / total_reads);
+    xil_printf("median %u cycles at %u MHz, %s ns per read\n\r",
+               ticks_to_cycles(tmed, mhz), mhz, per_read);
+    watch_histogram(t, runs);
+  }
+  free(t);
+  return SUCCESS;
+}
+
+/* arrayOp add|sub|mul <dst> <x> <y>
+   arrayOp axpy <dst> <alpha> <x> <y>
+   arrayOp scale <dst> <alpha> <x>
+   arrayOp convert <dst> <type> <x>
+   dst is made (or remade) with the size of x, and its type, except
+   for convert. dst can be x or y when the type stays the same. */
+int arrayOp_cmd(int n, char **args) {
+  int op, type, want;
+  array *x, *y = NULL, *d;
+  union { u8 b; u16 h; u32 w; u64 d; } alpha;
+  const char *xref, *yref = NULL;
+
+  for (op = 0; op < NUM_OPS && n > 1 && strcmp(args[1], op_str[op]); op++);
+  if (n < 2 || op == NUM_OPS) {
+    xil_printf("Usage: arrayOp add|sub|mul|axpy|scale|convert <dst> ...\n\r");
+    return FAILURE;
+  }
+  want = op == OP_AXPY ? 6 : 5;
+  if (n != want) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  arrayOp %s <dst> %s\n\r",
+               op_str[op],
+               op == OP_AXPY ? "<alpha> <x> <y>" :
+               op == OP_SCALE ? "<alpha> <x>" :
+               op == OP_CONVERT ? "<type> <x>" : "<x> <y>");
+    return FAILURE;
+  }
+
+  if (op <= OP_MUL) {
+    xref = args[3];
+    yref = args[4];
+  } else {
+    xref = args[4];
+    if (op == OP_AXPY) yref = args[5];
+  }
+  x = argArray(xref);
+  if (!x) return FAILURE;
+  if (yref) {
+    y = argArray(yref);
+    if (!y) return FAILURE;
+    if (y->type != x->type || y->size != x->size) {
+      xil_printf("%s and %s differ in type or size\n\r", xref, yref);
+      return FAILURE;
+    }
+  }
+
+  type = x->type;
+  if (op == OP_CONVERT) {
+    type = typeFromString(args[3]);
+    if (type < 0) {
+      xil_printf("Incorrect type specifier\n\r");
+      return FAILURE;
+    }
+  } else if (op >= OP_AXPY && !parse_arg(args[3], x->type, &alpha)) {
+    xil_printf("Bad alpha %s: %s\n\r", parse_token, parse_msg);
+    return FAILURE;
+  }
+
+  d = getArray(args[2]);
+  if (!d || d->type != type || d->size != x->size) {
+    if (d == x || (d && d == y)) {
+      xil_printf("%s cannot change type in place\n\r", args[2]);
+      return FAILURE;
+    }
+    d = allocArray(args[2], type, x->size, array_arena(x), ARENA_ALIGN);
+    if (!d) return FAILURE;
+  } else if (array_pinned(d)) {
+    xil_printf("Array %s is in use by a transfer\n\r", args[2]);
+    return FAILURE;
+  }
+
+  array_cpu_read(x, 0, arrayBytes(x));
+  if (y) array_cpu_read(y, 0, arrayBytes(y));
+  array_cpu_write(d, 0, arrayBytes(d));
+
+  if (op == OP_CONVERT)
+    array_convert(d->data, type, x->data, x->type, x->size);
+  else
+    array_op(op, type, d->data, x->data, y ? y->data : NULL,
+             op >= OP_AXPY ? &alpha : NULL, x->size);
+
+  cmd_bytes += arrayBytes(x) + (y ? arrayBytes(y) : 0) + arrayBytes(d);
+  return SUCCESS;
+}
+
+/* checksum <array> [crc32|xxh64]
+   checksum <address> <bytes> [crc32|xxh64]
+   The cache is flushed over the range first, so the sum is of what
+   is in memory (for example, what the PL has written). */
+int checksum_cmd(int n, char **args) {
+  array *a = NULL;
+  UINTPTR addr;
+  u32 bytes, v;
+  int alg = SUM_CRC32;
+  u64 sum;
+  XTime t0, t1;
+  char buf[17], rate[16];
+
+  if (n == 4 || (n == 3 && sumFromString(args[2]) < 0)) {
+    if (!parse_address(args[1], &v) ||
+        !parse_arg(args[2], UINT_TYPE, &bytes)) {
+      xil_printf("Bad argument %s: %s\n\r", parse_token, parse_msg);
+      return FAILURE;
+    }
+    addr = v;
+    if (n == 4) alg = sumFromString(args[3]);
+  } else if (n == 2 || n == 3) {
+    a = argArray(args[1]);
+    if (!a) return FAILURE;
+    addr = (UINTPTR)a->data;
+    bytes = arrayBytes(a);
+    if (n == 3) alg = sumFromString(args[2]);
+  } else {
+    xil_printf("Wrong number of arguments!\n\rUsage:  checksum <array> | <address> <bytes> [crc32|xxh64]\n\r");
+    return FAILURE;
+  }
+  if (alg < 0) {
+    xil_printf("Unknown checksum %s, use crc32 or xxh64\n\r", args[n - 1]);
+    return FAILURE;
+  }
+
+  if (a) array_cpu_read(a, 0, bytes);
+  else Xil_DCacheFlushRange(addr, bytes);
+
+  XTime_GetTime(&t0);
+  sum = checksum(alg, (const u8 *)addr, bytes);
+  XTime_GetTime(&t1);
+  cmd_bytes += bytes;
+
+  sum_hex(buf, alg, sum);
+  rate_str(rate, sizeof(rate), bytes, t1 - t0);
+  xil_printf("%s %s, %u bytes in %u us (%s MB/s)\n\r", sum_str[alg], buf,
+             bytes, ticks_to_us(t1 - t0), rate);
+  return SUCCESS;
+}
+
+/* cf [array ...]
+   Hand arrays (default all) to the PL, writing back what the CPU
+   changed since the PL last had them. */
+int cf_cmd(int n, char **args) {
+  int i;
+  array *a;
+
+  for (i = 1; i < n; i++) {
+    if (!argArray(args[i])) return FAILURE;
+  }
+  if (n == 1) {
+    for (i = 0; i < num_slots; i++) {
+      if (array_slots[i].arr) array_to_pl(array_slots[i].arr);
+    }
+  }
+  for (i = 1; i < n; i++) {
+    a = getArray(args[i]);
+    array_to_pl(a);
+  }
+  return SUCCESS;
+}
+
+/* ci [array [offset count]]
+   The PL has written the array (default all arrays), or count elements
+   of it from offset: drop the cached copies so the CPU reads them. */
+int ci_cmd(int n, char **args) {
+  int i;
+  array *a;
+  u32 offset = 0, count, esize;
+
+  if (n == 1) {
+    for (i = 0; i < num_slots; i++) {
+      a = array_slots[i].arr;
+      if (!a) continue;
+      array_to_pl(a);
+      array_cpu_read(a, 0, arrayBytes(a));
+    }
+    return SUCCESS;
+  }
+  if (n != 2 && n != 4) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  ci [array [offset count]]\n\r");
+    return FAILURE;
+  }
+
+  a = argArray(args[1]);
+  if (!a) return FAILURE;
+  count = a->size;
+  if (n == 4) {
+    if (!parse_arg(args[2], UINT_TYPE, &offset) ||
+        !parse_arg(args[3], UINT_TYPE, &count) ||
+        offset > (u32)a->size || count > a->size - offset) {
+      xil_printf("Range out of bounds (array has %d elements)\n\r", a->size);
+      return FAILURE;
+    }
+  }
+  esize = types[a->type].size;
+  array_to_pl(a);
+  array_cpu_read(a, offset * esize, count * esize);
+  return SUCCESS;
+}
+
+/* set [<name> [<value> | <a> <op> <b>]]
+   Without arguments list the variables, with only a name remove it.
+   op is one of + - * / % on integers (decimal or 0x hex). */
+int set_cmd(int n, char **args) {
+  char buf[MAX_VAR_VALUE];
+  long long a, b, r = 0;
+  int overflow;
+  char *end_a, *end_b;
+  variable *v;
+  int i;
+
+  if (n == 1) {
+    for (i = 0; i < MAX_VARS; i++) {
+      if (vars[i].name[0])
+        xil_printf("%s = %s\n\r", vars[i].name, vars[i].value);
+    }
+    return SUCCESS;
+  }
+  if (n == 2) {
+    v = var_find(args[1], strlen(args[1]));
+    if (!v) {
+      xil_printf("No variable %s\n\r", args[1]);
+      return FAILURE;
+    }
+    v->name[0] = 0;
+    return SUCCESS;
+  }
+  if (n == 3) return var_set(args[1], args[2]);
+  if (n != 5 || strlen(args[3]) != 1 || !strchr("+-*/%", args[3][0])) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  set [<name> [<value> | <a> +|-|*|/|% <b>]]\n\r");
+    return FAILURE;
+  }
+
+  a = strtoll(args[2], &end_a, 0);
+  b = strtoll(args[4], &end_b, 0);
+  if (*end_a || end_a == args[2] || *end_b || end_b == args[4]) {
+    xil_printf("%s is not an integer\n\r", *end_a || end_a == args[2] ? args[2] : args[4]);
+    return FAILURE;
+  }
+  switch (args[3][0]) {
+  case '+': overflow = __builtin_add_overflow(a, b, &r); break;
+  case '-': overflow = __builtin_sub_overflow(a, b, &r); break;
+  case '*': overflow = __builtin_mul_overflow(a, b, &r); break;
+  default:
+    if (b == 0) {
+      xil_printf("Division by zero\n\r");
+      return FAILURE;
+    }
+    /* The one quotient that does not fit traps on the host */
+    overflow = b == -1 && a == LLONG_MIN;
+    if (!overflow) r = args[3][0] == '/' ? a / b : a % b;
+    break;
+  }
+  if (overflow) {
+    xil_printf("%s %s %s overflows\n\r", args[2], args[3], args[4]);
+    return FAILURE;
+  }
+  snprintf(buf, sizeof(buf), "%lld", r);
+  return var_set(args[1], buf);
+}
+
+/* ************************************************************
+ * FatFS, Files, Directories
+ * ********************************************************* */
+#ifdef USE_SD
+
+FRESULT ls(char* path){
+  FRESULT res;
+  DIR dir;
+  static FILINFO fno;
+
+  res = f_opendir(&dir, path);
+  if (res == FR_OK) {
+    for (;;) {
+      res = f_readdir(&dir, &fno);
+      if (res != FR_OK || fno.fname[0] == 0) break;
+      xil_printf("%s/%s\n\r", path, fno.fname);
+    }
+    f_closedir(&dir);
+  }
+  return res;
+}
+
+int ls_cmd(int n, char **args) {
+  FRESULT res;
+  /* ignores all arguments, if any */
+  res = ls(pwd);
+  if (res != FR_OK) return FAILURE;
+
+  return SUCCESS;
+}
+
+/* Files are read and written in chunks of SD_CHUNK_SIZE bytes (a
+   multiple of the 512 byte sector) straight to or from array memory.
+   FatFS moves the whole sectors of a request with multi-block
+   commands and without copying through its sector buffer, so large
+   chunks keep the card streaming. Only a chunk that starts or ends
+   inside a sector (the end of the file, or an append) is partly
+   copied. */
+#define SD_CHUNK_SIZE (4 * 1024 * 1024)
+
+#define SD_NEW       0 /* sdStore modes */
+#define SD_OVERWRITE 1
+#define SD_APPEND    2
+
+/* Read up to bytes from fp into dst. Returns the number of bytes
+   read, *res is the first error. */
+u32 sd_read(FIL *fp, u8 *dst, u32 bytes, FRESULT *res) {
+  u32 done = 0;
+  UINT rd;
+
+  *res = FR_OK;
+  while (done < bytes) {
+    u32 chunk = bytes - done > SD_CHUNK_SIZE ? SD_CHUNK_SIZE : bytes - done;
+    *res = f_read(fp, dst + done, chunk, &rd);
+    done += rd;
+    if (*res != FR_OK || rd < chunk) break;
+  }
+  return done;
+}
+
+/* Write bytes from src to fp. Returns the number of bytes written, a
+   short count with FR_OK means the card is full. */
+u32 sd_write(FIL *fp, const u8 *src, u32 bytes, FRESULT *res) {
+  u32 done = 0;
+  UINT wrt;
+
+  *res = FR_OK;
+  while (done < bytes) {
+    u32 chunk = bytes - done > SD_CHUNK_SIZE ? SD_CHUNK_SIZE : bytes - done;
+    *res = f_write(fp, src + done, chunk, &wrt);
+    done += wrt;
+    if (*res != FR_OK || wrt < chunk) break;
+  }
+  return done;
+}
+
+void sd_report(const char *what, u32 bytes, XTime ticks) {
+  char rate[16];
+  rate_str(rate, sizeof(rate), bytes, ticks);
+  xil_printf("%s %u bytes in %u us (%s MB/s)\n\r",
+             what, bytes, ticks_to_us(ticks), rate);
+}
+
+/* The array to load size bytes into. An existing array is filled in
+   place, without reallocating, if they fit and no type is given.
+   Otherwise a new array of type (byte if type < 0) is made with room
+   for all of them. */
+array *load_target(char *array_ref, int type, u32 size, int where, u32 align) {
+  array *a = getArray(array_ref);
+
+  if (a && array_pinned(a)) {
+    xil_printf("Array %s is in use by a transfer\n\r", array_ref);
+    return NULL;
+  }
+  if (a && type < 0) {
+    if (size > arrayBytes(a)) {
+      xil_printf("File is %u bytes, array %s only holds %u\n\r",
+                 size, array_ref, arrayBytes(a));
+      return NULL;
+    }
+    return a;
+  }
+  if (type < 0) type = BYTE_TYPE;
+  if (size == 0 || size % types[type].size) {
+    xil_printf("File size %u is not a whole number of %s elements\n\r",
+               size, types[type].name);
+    return NULL;
+  }
+  return allocArray(array_ref, type, size / types[type].size, where, align);
+}
+
+/* Load a file into array array_ref (see load_target). The -sum
+   checksum covers the bytes of the file. */
+int load_raw(char *path, char *array_ref, int type, int where, u32 align,
+             sum_opt *sum) {
+
+  FIL fp;
+  FRESULT r;
+  u32 size, bytes;
+  array *a;
+  XTime t0, t1;
+
+  r = f_open(&fp, path, FA_READ);
+  if (r != FR_OK) {
+    xil_printf("Error opening file: %d\n\r", r);
+    return FAILURE;
+  }
+  size = file_size(&fp);
+
+  a = load_target(array_ref, type, size, where, align);
+  if (!a) {
+    f_close(&fp);
+    return FAILURE;
+  }
+
+  /* Partial sectors are copied by the CPU */
+  array_cpu_write(a, 0, size);
+
+  XTime_GetTime(&t0);
+  bytes = sd_read(&fp, (u8 *)a->data, size, &r);
+  XTime_GetTime(&t1);
+  f_close(&fp);
+  cmd_bytes += bytes;
+
+  if (r != FR_OK || bytes < size) {
+    xil_printf("Read error %d after %u of %u bytes\n\r", r, bytes, size);
+    return FAILURE;
+  }
+  sd_report("Loaded", bytes, t1 - t0);
+  return sum_report(sum, (const u8 *)a->data, bytes);
+}
+
+/* Load an LZ4 frame file, unpacking it into the array while it is
+   read. The size of the data is that given in the frame header; a
+   frame without one (lz4 without --content-size) can only go into an
+   existing array. The -sum checksum covers the unpacked data. */
+int load_lz4(char *path, char *array_ref, int type, int where, u32 align,
+             sum_opt *sum) {
+
+  FIL fp;
+  FRESULT r;
+  u8 hdr[LZ4_HEADER_MAX];
+  lz4_frame f;
+  arena_block *buf = NULL;
+  u32 size, have = 0, packed, bufsize;
+  UINT rd;
+  array *a = NULL;
+  XTime t0, t1;
+  int used;
+
+  r = f_open(&fp, path, FA_READ);
+  if (r != FR_OK) {
+    xil_printf("Error opening file: %d\n\r", r);
+    return FAILURE;
+  }
+
+  XTime_GetTime(&t0);
+  r = f_read(&fp, hdr, sizeof(hdr), &rd);
+  used = r == FR_OK ? lz4_frame_header(&f, hdr, rd) : -1;
+  if (used <= 0) {
+    if (r != FR_OK) xil_printf("Read error %d\n\r", r);
+    else xil_printf("%s: %s\n\r", path, used ? lz4_msg : "file too short");
+    goto fail;
+  }
+  if (f.flags & LZ4F_SIZE) {
+    if (f.size > 0x7FFFFFFF) {
+      xil_printf("Unpacked size %u MB is too large\n\r", (u32)(f.size >> 20));
+      goto fail;
+    }
+    size = f.size;
+    a = load_target(array_ref, type, size, where, align);
+  } else {
+    a = getArray(array_ref);
+    if (!a || type >= 0) {
+      xil_printf("The frame has no content size, load it into an existing array\n\r");
+      goto fail;
+    }
+    size = arrayBytes(a);
+    a = load_target(array_ref, type, 0, where, align);
+  }
+  if (!a) goto fail;
+
+  /* Room for the largest block with its size and checksum */
+  bufsize = f.max_block + 8;
+  buf = arena_alloc(MEM_DDR, bufsize, ARENA_ALIGN);
+  if (!buf) {
+    xil_printf("No memory for a %u byte LZ4 block\n\r", f.max_block);
+    goto fail;
+  }
+
+  array_cpu_write(a, 0, size);
+  f.dst = (u8 *)a->data;
+  f.cap = size;
+  f_lseek(&fp, used);
+  packed = used;
+  do {
+    r = f_read(&fp, (u8 *)buf->addr + have, bufsize - have, &rd);
+    if (r != FR_OK) {
+      xil_printf("Read error %d after %u packed bytes\n\r", r, packed);
+      goto fail;
+    }
+    have += rd;
+    used = lz4_frame_feed(&f, (u8 *)buf->addr, have);
+    if (used < 0) {
+      xil_printf("%s after %u bytes\n\r", lz4_msg, f.out);
+      goto fail;
+    }
+    packed += used;
+    have -= used;
+    memmove((u8 *)buf->addr, (u8 *)buf->addr + used, have);
+    if (f.state != LZ4_DONE && rd == 0) {
+      xil_printf("File ends in the middle of the LZ4 frame\n\r");
+      goto fail;
+    }
+  } while (f.state != LZ4_DONE);
+  XTime_GetTime(&t1);
+  f_close(&fp);
+  arena_free(buf);
+  cmd_bytes += f.out;
+
+  lz4_report("Loaded", f.out, packed, t1 - t0);
+  return sum_report(sum, (const u8 *)a->data, f.out);
+
+ fail:
+  f_close(&fp);
+  if (buf) arena_free(buf);
+  return FAILURE;
+}
+
+/* sdLoad <filename> <array> [-type <type>] [-z] [-mem ddr|ocm]
+          [-align bytes] [-sum alg[=hex]] */
+int sd_load_raw_cmd(int n, char **args) {
+
+  char path[MAX_PATH];
+  int where;
+  u32 align;
+  int type = -1;
+  int i, j, z = 0;
+  sum_opt sum;
+
+  if (!memOptions(&n, args, &where, &align)) return FAILURE;
+  if (!sumOption(&n, args, &sum)) return FAILURE;
+
+  for (i = 1, j = 1; i < n; i++) {
+    if (strcmp(args[i], "-type") == 0 && i + 1 < n) {
+      type = typeFromString(args[++i]);
+      if (type < 0) {
+        xil_printf("Incorrect type specifier\n\r");
+        return FAILURE;
+      }
+    } else if (strcmp(args[i], "-z") == 0) {
+      z = 1;
+    } else {
+      args[j++] = args[i];
+    }
+  }
+  n = j;
+
+  if (n < 3 || n > 3) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage:  sdLoad <filename> <array> [-type type] [-z] [-mem ddr|ocm] [-align bytes] [-sum alg[=hex]]\n\r");
+    return FAILURE;
+  }
+
+  strncpy(path,pwd,MAX_PATH);
+  strncat(path,args[1],MAX_PATH - strlen(path));
+
+  xil_printf("Loading file: %s\n\r", path);
+  if (z) return load_lz4(path, args[2], type, where, align, &sum);
+  return load_raw(path, args[2], type, where, align, &sum);
+}
+
+
+int store_raw(char *path, array *a, int mode, sum_opt *sum) {
+
+  FIL fp;
+  FRESULT r, rc;
+  u32 size, bytes;
+  BYTE flags = FA_WRITE;
+  XTime t0, t1;
+  int expanded = 0;
+
+  size = arrayBytes(a);
+
+  if (mode == SD_OVERWRITE) flags |= FA_CREATE_ALWAYS;
+  else if (mode == SD_APPEND) flags |= FA_OPEN_APPEND;
+  else flags |= FA_CREATE_NEW;
+
+  r = f_open(&fp, path, flags);
+  if (r == FR_EXIST) {
+    xil_printf("File exists, use -o to overwrite or -a to append\n\r");
+    return FAILURE;
+  } else if (r != FR_OK) {
+    xil_printf("Error opening file: %d\n\r", r);
+    return FAILURE;
+  }
+
+  XTime_GetTime(&t0);
+#if FF_USE_EXPAND || _USE_EXPAND
+  /* Allocate the clusters of a new file in one contiguous run, so the
+     data goes out in long multi-block writes with no FAT updates */
+  if (f_size(&fp) == 0) {
+    expanded = f_expand(&fp, size, 1) == FR_OK;
+    if (!expanded) xil_printf("No contiguous space, file will be fragmented\n\r");
+  }
+#endif
+
+  array_cpu_read(a, 0, size);
+  array_flush(a);
+  bytes = sd_write(&fp, (const u8 *)a->data, size, &r);
+  if (bytes < size && expanded) f_truncate(&fp);
+  rc = f_close(&fp);
+  XTime_GetTime(&t1);
+  cmd_bytes += bytes;
+
+  if (r == FR_OK) r = rc;
+  if (r != FR_OK || bytes < size) {
+    xil_printf("Write error %d after %u of %u bytes%s\n\r", r, bytes, size,
+               r == FR_OK ? " (card full)" : "");
+    return FAILURE;
+  }
+  sd_report("Stored", bytes, t1 - t0);
+  return sum_report(sum, (const u8 *)a->data, bytes);
+}
+
+/* Store an array as an LZ4 frame file, packing it a block at a time */
+int store_lz4(char *path, array *a, int mode, sum_opt *sum) {
+
+  FIL fp;
+  FRESULT r, rc;
+  u32 size, len, off, end, wrote, packed = 0;
+  const u8 *data = (const u8 *)a->data;
+  arena_block *buf;
+  XTime t0, t1;
+
+  size = arrayBytes(a);
+  buf = arena_alloc(MEM_DDR, LZ4_HEADER_MAX + LZ4_BOUND(LZ4_BLOCK_SIZE) + 4,
+                    ARENA_ALIGN);
+  if (!buf) {
+    xil_printf("No memory to pack a %u byte block\n\r", LZ4_BLOCK_SIZE);
+    return FAILURE;
+  }
+
+  r = f_open(&fp, path, FA_WRITE |
+             (mode == SD_OVERWRITE ? FA_CREATE_ALWAYS : FA_CREATE_NEW));
+  if (r == FR_EXIST) {
+    xil_printf("File exists, use -o to overwrite\n\r");
+    arena_free(buf);
+    return FAILURE;
+  } else if (r != FR_OK) {
+    xil_printf("Error opening file: %d\n\r", r);
+    arena_free(buf);
+    return FAILURE;
+  }
+
+  XTime_GetTime(&t0);
+  array_cpu_read(a, 0, size);
+  len = lz4_frame_begin((u8 *)buf->addr, size);
+  for (off = 0; ; off = end, len = 0) {
+    end = size - off > LZ4_BLOCK_SIZE ? off + LZ4_BLOCK_SIZE : size;
+    if (off < size)
+      len += lz4_frame_block((u8 *)buf->addr + len, data, off, end);
+    else
+      len += lz4_frame_end((u8 *)buf->addr + len, data, size);
+    wrote = sd_write(&fp, (const u8 *)buf->addr, len, &r);
+    packed += wrote;
+    if (r != FR_OK || wrote < len || off == size) break;
+  }
+  rc = f_close(&fp);
+  XTime_GetTime(&t1);
+  arena_free(buf);
+  cmd_bytes += size;
+
+  if (r == FR_OK) r = rc;
+  if (r != FR_OK || wrote < len) {
+    xil_printf("Write error %d after %u packed bytes%s\n\r", r, packed,
+               r == FR_OK ? " (card full)" : "");
+    return FAILURE;
+  }
+  lz4_report("Stored", size, packed, t1 - t0);
+  return sum_report(sum, data, size);
+}
+
+/* sdStore <filename> <array> [-o|-a] [-z] [-sum alg[=hex]] */
+int sd_store_raw_cmd(int n, char **args) {
+
+  array *a;
+  char path[MAX_PATH];
+  int mode = SD_NEW;
+  int i, z = 0;
+  sum_opt sum;
+
+  if (!sumOption(&n, args, &sum)) return FAILURE;
+
+  for (i = 3; i < n; i++) {
+    if (strcmp(args[i], "-z") != 0) continue;
+    for (z = 1; i + 1 < n; i++) args[i] = args[i + 1];
+    n--;
+    break;
+  }
+
+  if (n == 4 && strcmp(args[3], "-o") == 0) {
+    mode = SD_OVERWRITE;
+    n--;
+  } else if (n == 4 && strcmp(args[3], "-a") == 0) {
+    mode = SD_APPEND;
+    n--;
+  }
+
+  if (n < 3 || n > 3) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage:  sdStore <filename> <array> [-o|-a] [-z] [-sum alg[=hex]]\n\r");
+    return FAILURE;
+  }
+  if (z && mode == SD_APPEND) {
+    xil_printf("-z cannot append to a file\n\r");
+    return FAILURE;
+  }
+
+  a = argArray(args[2]);
+  if (!a) return FAILURE;
+
+  strncpy(path,pwd,MAX_PATH);
+  strncat(path,args[1],MAX_PATH - strlen(path));
+
+  xil_printf("Storing to file: %s\n\r", path);
+
+  if (z) return store_lz4(path, a, mode, &sum);
+  return store_raw(path, a, mode, &sum);
+}
+
+#endif
+
+/* ************************************************************
+ * Scripts
+ *
+ * "source <file>" runs the commands in a file on the sd card, one per
+ * line, as if they were typed (with the output going to the UART), so
+ * that test sequences run at CPU speed and can be repeated. Besides
+ * commands a script has
+ *   # comment                   (and empty lines)
+ *   repeat <N> [<var>] {        run the lines up to the matching }
+ *   }                           N times, with $var counting 0..N-1
+ * Variables ($name, see "set") are replaced when a line is run, so
+ * they can change from one round to the next.
+ *
+ * A script stops at the first command that fails unless it is run
+ * with -k, and Ctrl-C stops it between commands. AUTOEXEC_FILE is
+ * run at boot if the card has one.
+ * ********************************************************* */
+#ifdef USE_SD
+
+#define AUTOEXEC_FILE      "autoexec.zs"
+#define SCRIPT_MAX_SIZE    (1024 * 1024)
+#define SCRIPT_MAX_DEPTH   8  /* scripts sourcing scripts */
+#define SCRIPT_MAX_NESTING 16 /* repeat blocks in repeat blocks */
+#define SCRIPT_LINE_SIZE   512
+#define CTRL_C             3
+
+#define LINE_SKIP  -1 /* empty or comment */
+#define LINE_CMD   -2
+#define LINE_CLOSE -3
+
+typedef struct {
+  const char *name;
+  char *text;     /* the file, with the lines 0 terminated */
+  char **lines;
+  int *kind;      /* LINE_* or, for a repeat, the line of its } */
+  int num_lines;
+  int keep_going; /* -k */
+  u32 commands;   /* run so far */
+  u32 errors;
+  char *buf;      /* the line being run, after replacing variables */
+  char **tokens;
+} script;
+
+int tokenize(char *cmd_str, char ***tokens);
+
+int script_depth = 0;
+int script_stop = 0; /* Ctrl-C seen, unwind all scripts */
+
+/* Sort lines into commands, repeats and closing braces and match the
+   braces up, so that a broken script is refused before it runs. */
+int script_scan(script *s) {
+  int open[SCRIPT_MAX_NESTING];
+  int depth = 0, i, len;
+  char *p;
+
+  for (i = 0; i < s->num_lines; i++) {
+    p = s->lines[i];
+    while (isspace((int)*p)) p++;
+    len = strlen(p);
+    while (len && isspace((int)p[len - 1])) len--;
+
+    if (len == 0 || p[0] == '#') {
+      s->kind[i] = LINE_SKIP;
+    } else if (len == 1 && p[0] == '}') {
+      if (depth == 0) {
+        xil_printf("%s:%d: } without repeat\n\r", s->name, i + 1);
+        return FAILURE;
+      }
+      s->kind[open[--depth]] = i;
+      s->kind[i] = LINE_CLOSE;
+    } else if (p[len - 1] == '{') {
+      if (depth == SCRIPT_MAX_NESTING) {
+        xil_printf("%s:%d: repeats nested too deep\n\r", s->name, i + 1);
+        return FAILURE;
+      }
+      open[depth++] = i;
+    } else {
+      s->kind[i] = LINE_CMD;
+    }
+  }
+  if (depth) {
+    xil_printf("%s:%d: repeat without }\n\r", s->name, open[depth - 1] + 1);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/* Take a Ctrl-C from the input. Other input stays for the commands
+   that read it; polled input cannot be looked at without taking it,
+   so there a script can only be stopped by a failing command. */
+int script_interrupted() {
+#ifdef USE_UART_IRQ
+  if (!script_stop && uart_irq_ok && rx_head != rx_tail &&
+      rx_ring[rx_tail & (RX_RING_SIZE - 1)] == CTRL_C) {
+    inbyte();
+    xil_printf("Interrupted\n\r");
+    script_stop = 1;
+  }
+#endif
+  return script_stop;
+}
+
+/* Replace variables in line i, into s->buf */
+int script_line(script *s, int i) {
+  if (!expand_vars(s->lines[i], s->buf, SCRIPT_LINE_SIZE)) {
+    xil_printf("%s:%d: not run\n\r", s->name, i + 1);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+int is_command(const char *name) {
+  int i;
+  for (i = 0; i < NUM_CMDS; i++) {
+    if (strcmp(name, cmds[i]) == 0) return 1;
+  }
+  return 0;
+}
+
+/* Run lines first to end - 1. Returns FAILURE when the script has
+   to stop. */
+int script_run(script *s, int first, int end) {
+  char var[MAX_VAR_NAME];
+  char count[16];
+  u32 rounds, k;
+  int i, n;
+
+  for (i = first; i < end && running; i++) {
+    if (script_interrupted()) return FAILURE;
+    if (s->kind[i] == LINE_SKIP || s->kind[i] == LINE_CLOSE) continue;
+
+    if (s->kind[i] >= 0) {
+      if (!script_line(s, i)) return FAILURE;
+      n = tokenize(s->buf, &s->tokens);
+      if (n < 3 || n > 4 || strcmp(s->tokens[0], "repeat") != 0 ||
+          strcmp(s->tokens[n - 1], "{") != 0 ||
+          !parse_arg(s->tokens[1], UINT_TYPE, &rounds)) {
+        xil_printf("%s:%d: expected \"repeat <N> [<var>] {\"\n\r",
+                   s->name, i + 1);
+        return FAILURE;
+      }
+      var[0] = 0;
+      if (n == 4) {
+        if (strlen(s->tokens[2]) >= MAX_VAR_NAME) {
+          xil_printf("%s:%d: variable name too long\n\r", s->name, i + 1);
+          return FAILURE;
+        }
+        strcpy(var, s->tokens[2]);
+      }
+      for (k = 0; k < rounds; k++) {
+        if (var[0]) {
+          snprintf(count, sizeof(count), "%u", k);
+          if (!var_set(var, count)) return FAILURE;
+        }
+        if (!script_run(s, i + 1, s->kind[i])) return FAILURE;
+      }
+      i = s->kind[i];
+      continue;
+    }
+
+    if (!script_line(s, i)) {
+      s->errors++;
+      if (s->keep_going) continue;
+      return FAILURE;
+    }
+    if (echo) xil_printf("%s %s\n\r", prompt, s->buf);
+    n = tokenize(s->buf, &s->tokens);
+    s->commands++;
+    /* No tokens is too many of them, or a line that expanded to
+       nothing. dispatch only complains about unknown commands. */
+    if (n == 0 || !dispatch(n, s->tokens) || !is_command(s->tokens[0])) {
+      xil_printf("%s:%d: error\n\r", s->name, i + 1);
+      s->errors++;
+      if (!s->keep_going) return FAILURE;
+    }
+  }
+  return SUCCESS;
+}
+
+/* Run a script file. With must_exist == 0 a missing file is not an
+   error (autoexec). */
+int source_file(const char *path, int keep_going, int must_exist) {
+  script s;
+  FIL fp;
+  FRESULT r;
+  u32 size, bytes, i;
+  XTime t0, t1;
+  int ok = FAILURE;
+
+  if (script_depth == SCRIPT_MAX_DEPTH) {
+    xil_printf("Scripts nested too deep (%d)\n\r", SCRIPT_MAX_DEPTH);
+    return FAILURE;
+  }
+
+  r = f_open(&fp, path, FA_READ);
+  if (r != FR_OK) {
+    if (!must_exist && (r == FR_NO_FILE || r == FR_NO_PATH ||
+                        r == FR_NOT_READY || r == FR_NO_FILESYSTEM))
+      return SUCCESS;
+    xil_printf("Error opening file: %d\n\r", r);
+    return FAILURE;
+  }
+  size = file_size(&fp);
+  if (size > SCRIPT_MAX_SIZE) {
+    xil_printf("Script is %u bytes, at most %u\n\r", size, SCRIPT_MAX_SIZE);
+    f_close(&fp);
+    return FAILURE;
+  }
+
+  memset(&s, 0, sizeof(s));
+  s.name = path;
+  s.keep_going = keep_going;
+  s.text = (char *)malloc(size + 1);
+  s.buf = (char *)malloc(SCRIPT_LINE_SIZE);
+  s.tokens = (char **)malloc(max_tokens * sizeof(char *));
+  if (!s.text || !s.buf || !s.tokens) {
+    xil_printf("Out of memory\n\r");
+    f_close(&fp);
+    goto done;
+  }
+  bytes = sd_read(&fp, (u8 *)s.text, size, &r);
+  f_close(&fp);
+  if (r != FR_OK || bytes < size) {
+    xil_printf("Read error %d after %u of %u bytes\n\r", r, bytes, size);
+    goto done;
+  }
+  s.text[size] = 0;
+
+  /* Split into lines, \n, \r\n or \r */
+  s.num_lines = 1;
+  for (i = 0; i < size; i++) {
+    if (s.text[i] == '\n' || (s.text[i] == '\r' && s.text[i + 1] != '\n'))
+      s.num_lines++;
+  }
+  s.lines = (char **)malloc(s.num_lines * sizeof(char *));
+  s.kind = (int *)malloc(s.num_lines * sizeof(int));
+  if (!s.lines || !s.kind) {
+    xil_printf("Out of memory\n\r");
+    goto done;
+  }
+  s.lines[0] = s.text;
+  s.num_lines = 1;
+  for (i = 0; i < size; i++) {
+    if (s.text[i] == '\r' && s.text[i + 1] == '\n') s.text[i++] = 0;
+    if (s.text[i] == '\n' || s.text[i] == '\r') {
+      s.text[i] = 0;
+      s.lines[s.num_lines++] = s.text + i + 1;
+    }
+  }
+  for (i = 0; i < (u32)s.num_lines; i++) {
+    if (strlen(s.lines[i]) >= SCRIPT_LINE_SIZE) {
+      xil_printf("%s:%u: line longer than %d characters\n\r",
+                 path, i + 1, SCRIPT_LINE_SIZE - 1);
+      goto done;
+    }
+  }
+  if (!script_scan(&s)) goto done;
+
+  if (script_depth == 0) script_stop = 0;
+  script_depth++;
+  XTime_GetTime(&t0);
+  ok = script_run(&s, 0, s.num_lines);
+  XTime_GetTime(&t1);
+  script_depth--;
+
+  xil_printf("%s: %u commands, %u errors in %u us\n\r", path, s.commands,
+             s.errors, ticks_to_us(t1 - t0));
+  if (s.errors) ok = FAILURE;
+
+done:
+  free(s.kind);
+  free(s.lines);
+  free(s.tokens);
+  free(s.buf);
+  free(s.text);
+  return ok;
+}
+
+/* source [-k] <file> */
+int source_cmd(int n, char **args) {
+  char path[MAX_PATH];
+  int keep_going = 0;
+
+  if (n == 3 && strcmp(args[1], "-k") == 0) {
+    keep_going = 1;
+    args++;
+    n--;
+  }
+  if (n != 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  source [-k] <file>\n\r");
+    return FAILURE;
+  }
+
+  strncpy(path, pwd, MAX_PATH);
+  strncat(path, args[1], MAX_PATH - strlen(path));
+  return source_file(path, keep_going, 1);
+}
+
+#endif
+
+/* ************************************************************
+ * PROGRAM FPGA WITH BITSTREAM
+ * ********************************************************* */
+/* A bitstream can be sent to the PCAP in several DMA transfers. Bit 0
+   of the source address marks the last one, after which the PCAP
+   expects no more data (Zynq TRM, DevC DMA). */
+#define PCAP_LAST_TRANSFER 0x1
+
+/* programFPGAFile streams the file through two buffers of this size */
+#define PCAP_CHUNK_SIZE (1024 * 1024)
+
+/* Time allowed for the FPGA to signal DONE after the last word */
+#define PCFG_DONE_TIMEOUT_US 100000
+
+/* Time allowed for a DMA transfer into the PCAP: a wide margin over
+   its nominal rate, plus a fixed part for short transfers */
+#define PCAP_TIMEOUT_US(bytes) (100000 + (bytes) / 10)
+
+/* Background programming sends the bitstream in transfers of this
+   size, one DevC interrupt each, so that its progress can be seen */
+#define PCAP_IRQ_CHUNK (256 * 1024)
+
+/* Start a DMA transfer of WordLength words at StartAddress into the
+   PCAP. Returns at once; pcap_wait waits for it to finish. */
+int pcap_start(XDcfg *Instance, u32 StartAddress, u32 WordLength, int last)
+{
+  // Clear DMA and PCAP Done Interrupts, and errors of earlier transfers
+  XDcfg_IntrClear(Instance, (XDCFG_IXR_DMA_DONE_MASK | XDCFG_IXR_D_P_DONE_MASK |
+                             XDCFG_IXR_ERROR_FLAGS_MASK));
+
+  // Transfer bitstream from DDR into fabric in non secure mode
+  return XDcfg_Transfer(Instance,
+                        (u32 *) (StartAddress | (last ? PCAP_LAST_TRANSFER : 0)),
+                        WordLength, (u32 *) XDCFG_DMA_INVALID_ADDRESS, 0,
+                        XDCFG_NON_SECURE_PCAP_WRITE);
+}
+
+/* Stop whatever the PCAP is doing. Pulsing PROG_B resets the PL
+   configuration logic, which also ends a transfer that is stuck. */
+void pcap_abort(XDcfg *Instance)
+{
+  XDcfg_IntrDisable(Instance, XDCFG_IXR_ALL_MASK);
+  XDcfg_ClearControlRegister(Instance, XDCFG_CTRL_PCFG_PROG_B_MASK);
+  XDcfg_SetControlRegister(Instance, XDCFG_CTRL_PCFG_PROG_B_MASK);
+  XDcfg_IntrClear(Instance, XDCFG_IXR_ALL_MASK);
+  active_valid = 0;
+}
+
+/* Wait for the transfer started by pcap_start. A transfer that fails,
+   or is not done within timeout_us, is stopped. */
+int pcap_wait(XDcfg *Instance, u32 timeout_us)
+{
+  u32 IntrStsReg;
+  XTime t0, t;
+
+  XTime_GetTime(&t0);
+  for (;;) {
+    // Poll DMA Done and PCAP Done Interrupts
+    IntrStsReg = XDcfg_IntrGetStatus(Instance);
+    if ((IntrStsReg & XDCFG_IXR_DMA_DONE_MASK) &&
+        (IntrStsReg & XDCFG_IXR_D_P_DONE_MASK))
+      return XST_SUCCESS;
+    if (IntrStsReg & XDCFG_IXR_ERROR_FLAGS_MASK) break;
+    XTime_GetTime(&t);
+    if (ticks_to_us(t - t0) > timeout_us) break;
+  }
+  pcap_abort(Instance);
+  return XST_FAILURE;
+}
+
+int program_bitstream(XDcfg *Instance, u32 StartAddress, u32 WordLength)
+{
+  int Status;
+
+  Status = pcap_start(Instance, StartAddress, WordLength, 1);
+  if (Status != XST_SUCCESS)
+    return Status;
+
+  return pcap_wait(Instance, PCAP_TIMEOUT_US(WordLength * 4));
+}
+
+/* Wait for the FPGA to raise DONE after the whole bitstream is in */
+int pcfg_done_wait(XDcfg *Instance) {
+  XTime t0, t;
+
+  XTime_GetTime(&t0);
+  do {
+    if (XDcfg_IntrGetStatus(Instance) & XDCFG_IXR_PCFG_DONE_MASK)
+      return SUCCESS;
+    XTime_GetTime(&t);
+  } while (ticks_to_us(t - t0) < PCFG_DONE_TIMEOUT_US);
+  return FAILURE;
+}
+
+/* Background programming ("programFPGA <array> &"). The transfers
+   are chained from the DevC interrupt handler; fpgaStatus and
+   fpgaWait look at the job. Only one job runs at a time and the
+   synchronous commands wait for it to be over. */
+#define FPGA_IDLE    0
+#define FPGA_BUSY    1
+#define FPGA_DONE    2
+#define FPGA_FAILED  3
+#define FPGA_TIMEOUT 4
+
+const char *fpga_state_str[] = { "idle", "programming", "done", "failed",
+                                 "timed out" };
+
+typedef struct {
+  volatile int state;
+  UINTPTR addr;
+  u32 total;          /* bytes */
+  volatile u32 sent;  /* bytes handed to the DMA */
+  volatile u32 done;  /* bytes taken by the PCAP */
+  array *a;           /* source array, pinned while busy */
+  bitstream *b;       /* or cached image */
+  volatile u32 irqs;
+  u32 status;         /* DevC status when it failed */
+  u32 timeout_us;
+  XTime start;
+  XTime end;
+} fpga_job_t;
+
+fpga_job_t fpga_job;
+int dcfg_irq_ok = 0;
+
+int fpga_send_next() {
+  u32 len = fpga_job.total - fpga_job.sent;
+  if (len > PCAP_IRQ_CHUNK) len = PCAP_IRQ_CHUNK;
+  if (pcap_start(&DcfgInstance, fpga_job.addr + fpga_job.sent, len >> 2,
+                 fpga_job.sent + len == fpga_job.total) != XST_SUCCESS)
+    return FAILURE;
+  fpga_job.sent += len;
+  return SUCCESS;
+}
+
+/* End the job. Runs in the IRQ handler, or with interrupts off. */
+void fpga_finish(int state) {
+  bitstream *b = fpga_job.b;
+
+  XDcfg_IntrDisable(&DcfgInstance, XDCFG_IXR_ALL_MASK);
+  XTime_GetTime(&fpga_job.end);
+  if (fpga_job.a) {
+    fpga_job.a->pinned--;
+    if (fpga_job.a->base) fpga_job.a->base->pinned--;
+  }
+  if (state == FPGA_DONE && b) {
+    active_valid = 1;
+    active_crc = b->crc;
+    b->switches++;
+    b->last = fpga_job.end - fpga_job.start;
+    b->total += b->last;
+  }
+  fpga_job.state = state;
+}
+
+void dcfg_isr(void *ref) {
+  XDcfg *Instance = (XDcfg *)ref;
+  u32 status = XDcfg_IntrGetStatus(Instance);
+
+  XDcfg_IntrClear(Instance, status);
+  fpga_job.irqs++;
+  if (fpga_job.state != FPGA_BUSY) return;
+
+  if (status & XDCFG_IXR_ERROR_FLAGS_MASK) {
+    fpga_job.status = status;
+    pcap_abort(Instance);
+    fpga_finish(FPGA_FAILED);
+    return;
+  }
+  if (status & XDCFG_IXR_D_P_DONE_MASK) {
+    fpga_job.done = fpga_job.sent;
+    if (fpga_job.sent < fpga_job.total && !fpga_send_next()) {
+      fpga_job.status = status;
+      pcap_abort(Instance);
+      fpga_finish(FPGA_FAILED);
+      return;
+    }
+  }
+  if ((status & XDCFG_IXR_PCFG_DONE_MASK) && fpga_job.done == fpga_job.total)
+    fpga_finish(FPGA_DONE);
+}
+
+/* Stop a background job that has used up its time */
+void fpga_check() {
+  XTime t;
+
+  if (fpga_job.state != FPGA_BUSY) return;
+  XTime_GetTime(&t);
+  if (ticks_to_us(t - fpga_job.start) <= fpga_job.timeout_us) return;
+
+  Xil_ExceptionDisable();
+  if (fpga_job.state == FPGA_BUSY) {
+    pcap_abort(&DcfgInstance);
+    fpga_finish(FPGA_TIMEOUT);
+  }
+  Xil_ExceptionEnable();
+}
+
+/* Commands that use the PCAP refuse to start while a job runs */
+int fpga_busy() {
+  fpga_check();
+  if (fpga_job.state != FPGA_BUSY) return 0;
+  xil_printf("FPGA programming in progress (see fpgaStatus, fpgaWait)\n\r");
+  return 1;
+}
+
+/* Start programming bytes at addr in the background */
+int fpga_background(UINTPTR addr, u32 bytes, array *a, bitstream *b) {
+  int ok;
+
+  if (!dcfg_irq_ok) {
+    xil_printf("No DevC interrupt, cannot program in the background\n\r");
+    return FAILURE;
+  }
+
+  memset(&fpga_job, 0, sizeof(fpga_job));
+  fpga_job.addr = addr;
+  fpga_job.total = bytes;
+  fpga_job.a = a;
+  fpga_job.b = b;
+  fpga_job.timeout_us = PCAP_TIMEOUT_US(bytes) + PCFG_DONE_TIMEOUT_US;
+  if (a) {
+    a->pinned++;
+    if (a->base) a->base->pinned++; /* so it is not reloaded under us */
+  }
+  active_valid = 0;
+
+  XDcfg_IntrClear(&DcfgInstance, XDCFG_IXR_ALL_MASK);
+  XDcfg_IntrEnable(&DcfgInstance, XDCFG_IXR_D_P_DONE_MASK |
+                   XDCFG_IXR_PCFG_DONE_MASK | XDCFG_IXR_ERROR_FLAGS_MASK);
+
+  /* The first interrupt must not come before the job is set up */
+  Xil_ExceptionDisable();
+  XTime_GetTime(&fpga_job.start);
+  fpga_job.state = FPGA_BUSY;
+  ok = fpga_send_next();
+  if (!ok) {
+    pcap_abort(&DcfgInstance);
+    fpga_finish(FPGA_FAILED);
+  }
+  Xil_ExceptionEnable();
+
+  if (!ok) {
+    xil_printf("Failed to program FPGA\n\r");
+    return FAILURE;
+  }
+  cmd_bytes += bytes;
+  xil_printf("Programming %u bytes in the background\n\r", bytes);
+  return SUCCESS;
+}
+
+void fpga_print_status() {
+  XTime t = fpga_job.end;
+  char rate[16];
+
+  if (fpga_job.state == FPGA_BUSY) XTime_GetTime(&t);
+  t -= fpga_job.start;
+
+  xil_printf("FPGA: %s", fpga_state_str[fpga_job.state]);
+  switch (fpga_job.state) {
+  case FPGA_IDLE:
+    break;
+  case FPGA_BUSY:
+    xil_printf(", %u of %u bytes (%u%%), %u us",
+               fpga_job.done, fpga_job.total,
+               (u32)((u64)fpga_job.done * 100 / fpga_job.total),
+               ticks_to_us(t));
+    break;
+  case FPGA_DONE:
+    rate_str(rate, sizeof(rate), fpga_job.total, t);
+    xil_printf(", %u bytes in %u us (%s MB/s)", fpga_job.total,
+               ticks_to_us(t), rate);
+    break;
+  case FPGA_FAILED:
+    xil_printf(" at byte %u, status %08x", fpga_job.done, fpga_job.status);
+    break;
+  default: /* FPGA_TIMEOUT */
+    if (fpga_job.done == fpga_job.total)
+      xil_printf(", bitstream sent but no DONE after %u us", ticks_to_us(t));
+    else
+      xil_printf(" at byte %u of %u after %u us", fpga_job.done,
+                 fpga_job.total, ticks_to_us(t));
+    break;
+  }
+  if (fpga_job.state != FPGA_IDLE)
+    xil_printf(", %u interrupts", fpga_job.irqs);
+  xil_printf("\n\r");
+}
+
+/* Set up the DevCfg driver on first use */
+int init_dcfg() {
+  static int dcfg_ready = 0;
+  XDcfg_Config *ConfigPtr;
+  int status;
+
+  if (dcfg_ready) return SUCCESS;
+
+  ConfigPtr = XDcfg_LookupConfig(DCFG_DEVICE_ID);
+
+  status = XDcfg_CfgInitialize(&DcfgInstance, ConfigPtr,
+            ConfigPtr->BaseAddr);
+  if (status != XST_SUCCESS) {
+    xil_printf("Failed to initialize DevCFG driver\n\r");
+    return FAILURE;
+  }
+  status = XDcfg_SelfTest(&DcfgInstance);
+  if (status != XST_SUCCESS) {
+    xil_printf("Failed DevCFG self test\n\r");
+    return FAILURE;
+  }
+
+  XDcfg_IntrDisable(&DcfgInstance, XDCFG_IXR_ALL_MASK);
+  if (intc_ok &&
+      XScuGic_Connect(&IntcInstance, DCFG_INT_IRQ_ID,
+                      (Xil_InterruptHandler)dcfg_isr,
+                      &DcfgInstance) == XST_SUCCESS) {
+    XScuGic_Enable(&IntcInstance, DCFG_INT_IRQ_ID);
+    dcfg_irq_ok = 1;
+  }
+  dcfg_ready = 1;
+  return SUCCESS;
+}
+
+int programFPGA_cmd(int n, char **args) {
+
+  array *a;
+  int status;
+  int bg = n == 3 && strcmp(args[2], "&") == 0;
+
+  if (bg) n--;
+  if (n < 2 || n > 2) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage:  programFPGA <array> [&]\n\r");
+    return FAILURE;
+  }
+
+  a = argArray(args[1]);
+  if (!a) return FAILURE;
+
+  if (fpga_busy() || !init_dcfg()) return FAILURE;
+  if (arrayBytes(a) == 0 || arrayBytes(a) % 4) {
+    xil_printf("Array %s does not hold a bitstream\n\r", args[1]);
+    return FAILURE;
+  }
+  array_flush(a);
+  if (bg) return fpga_background((UINTPTR)a->data, arrayBytes(a), a, NULL);
+
+  active_valid = 0;
+  status = program_bitstream(&DcfgInstance,
+                             (u32)a->data,
+                             arrayBytes(a) >> 2);
+
+  if (status != XST_SUCCESS) {
+    xil_printf("Failed to program FPGA\n\r");
+    return FAILURE;
+  }
+  cmd_bytes += arrayBytes(a);
+  xil_printf("OK!\n\r");
+  return SUCCESS;
+}
+
+/* cacheBitstream <name> <array> */
+int cacheBitstream_cmd(int n, char **args) {
+  array *a;
+  bitstream *b;
+  arena_block *mem;
+  u32 size, i;
+  const u32 *w;
+
+  if (n != 3) {
+    xil_printf(
+        "Wrong number of arguments!\n\rUsage:  cacheBitstream <name> <array>\n\r");
+    return FAILURE;
+  }
+  if (strlen(args[1]) >= MAX_ARRAY_NAME) {
+    xil_printf("Name too long\n\r");
+    return FAILURE;
+  }
+
+  a = argArray(args[2]);
+  if (!a) return FAILURE;
+
+  size = arrayBytes(a);
+  array_cpu_read(a, 0, size);
+  w = (const u32 *)a->data;
+  for (i = 0; i < size / 4 && i < SYNC_SEARCH_WORDS; i ++) {
+    if (w[i] == PCAP_SYNC_WORD) break;
+  }
+  if (size % 4 || i == size / 4 || i == SYNC_SEARCH_WORDS) {
+    xil_printf("Array %s does not hold a bitstream\n\r", args[2]);
+    return FAILURE;
+  }
+
+  b = bitstreamByName(args[1]);
+  if (b && fpga_busy()) return FAILURE;
+  if (!b) {
+    for (i = 0; i < MAX_BITSTREAMS && bitstreams[i].name[0]; i ++);
+    if (i == MAX_BITSTREAMS) {
+      xil_printf("Bitstream cache is full (%d images)\n\r", MAX_BITSTREAMS);
+      return FAILURE;
+    }
+    b = &bitstreams[i];
+  }
+
+  mem = arena_alloc(MEM_DDR, size, ARENA_ALIGN);
+  if (!mem) {
+    xil_printf("No memory for bitstream (%u bytes)\n\r", size);
+    return FAILURE;
+  }
+  if (b->mem) arena_free(b->mem);
+
+  memset(b, 0, sizeof(bitstream));
+  strcpy(b->name, args[1]);
+  b->mem = mem;
+  b->size = size;
+  memcpy((void *)mem->addr, a->data, size);
+  b->crc = crc32_update(0, (const u8 *)mem->addr, size);
+  Xil_DCacheFlushRange(mem->addr, size);
+  cmd_bytes += size;
+
+  xil_printf("Cached %s: %u bytes, crc %08x\n\r", b->name, size, b->crc);
+  return SUCCESS;
+}
+
+/* rmBitstream <name> */
+int rmBitstream_cmd(int n, char **args) {
+  bitstream *b;
+
+  if (n != 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  rmBitstream <name>\n\r");
+    return FAILURE;
+  }
+  b = bitstreamByName(args[1]);
+  if (!b) {
+    xil_printf("No bitstream %s\n\r", args[1]);
+    return FAILURE;
+  }
+  if (fpga_busy()) return FAILURE;
+  arena_free(b->mem);
+  memset(b, 0, sizeof(bitstream));
+  return SUCCESS;
+}
+
+/* useBitstream <name> [&]
+   Program the FPGA with a cached image, unless it is already active. */
+int useBitstream_cmd(int n, char **args) {
+  bitstream *b;
+  XTime t0, t1;
+  int status;
+  int bg = n == 3 && strcmp(args[2], "&") == 0;
+
+  if (bg) n--;
+  if (n != 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  useBitstream <name> [&]\n\r");
+    return FAILURE;
+  }
+  b = bitstreamByName(args[1]);
+  if (!b) {
+    xil_printf("No bitstream %s\n\r", args[1]);
+    return FAILURE;
+  }
+
+  if (active_valid && active_crc == b->crc) {
+    xil_printf("%s is already active\n\r", b->name);
+    return SUCCESS;
+  }
+
+  if (fpga_busy() || !init_dcfg()) return FAILURE;
+  if (bg) return fpga_background(b->mem->addr, b->size, NULL, b);
+
+  XTime_GetTime(&t0);
+  active_valid = 0;
+  XDcfg_IntrClear(&DcfgInstance, XDCFG_IXR_PCFG_DONE_MASK);
+  status = program_bitstream(&DcfgInstance, b->mem->addr, b->size >> 2);
+  if (status != XST_SUCCESS) {
+    xil_printf("Failed to program FPGA\n\r");
+    return FAILURE;
+  }
+  if (!pcfg_done_wait(&DcfgInstance)) {
+    xil_printf("Bitstream sent, but the FPGA did not signal DONE\n\r");
+    return FAILURE;
+  }
+  XTime_GetTime(&t1);
+
+  active_valid = 1;
+  active_crc = b->crc;
+  b->switches++;
+  b->last = t1 - t0;
+  b->total += t1 - t0;
+  cmd_bytes += b->size;
+
+  xil_printf("Switched to %s in %u us\n\r", b->name, ticks_to_us(t1 - t0));
+  return SUCCESS;
+}
+
+/* fpgaStatus - progress of background programming */
+int fpgaStatus_cmd(int n, char **args) {
+  if (n != 1) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  fpgaStatus\n\r");
+    return FAILURE;
+  }
+  fpga_check();
+  fpga_print_status();
+  return fpga_job.state == FPGA_FAILED || fpga_job.state == FPGA_TIMEOUT ?
+    FAILURE : SUCCESS;
+}
+
+/* The [timeout_ms] of a command that waits for a background job.
+   A typo must not become a timeout of 0, which stops the job. */
+int wait_args(int n, char **args, u32 *timeout_ms) {
+  if (n > 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  %s [timeout_ms]\n\r",
+               args[0]);
+    return FAILURE;
+  }
+  if (n == 2 && !parse_arg(args[1], UINT_TYPE, timeout_ms)) {
+    xil_printf("Bad argument %s: %s\n\r", parse_token, parse_msg);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
 
-  if (strcmp(args[1], "int") == 0) {
-    if (!arrays[use_id].available) { // if selected is in use
-      freeArray(use_id);
-    }
-    arrays[use_id].size = num;
-    arrays[use_id].available = 0;
-    arrays[use_id].data = (char *)malloc(num * sizeof(int));
-    arrays[use_id].type = INT_TYPE;
-    for (i = 0; i < num; i++) {
-      inputline(buffer, 256);
-      xil_printf("\n\r");
-      int val = atoi(buffer);
-      ((int*) arrays[use_id].data)[i] = val;
+/* fpgaWait [timeout_ms]
+   Wait for background programming to end. A job still running at
+   the timeout is stopped. */
+int fpgaWait_cmd(int n, char **args) {
+  u32 timeout_ms = 0;
+  XTime t0, t;
+
+  if (!wait_args(n, args, &timeout_ms)) return FAILURE;
+
+  XTime_GetTime(&t0);
+  while (fpga_job.state == FPGA_BUSY) {
+    fpga_check();
+    XTime_GetTime(&t);
+    if (n == 2 && ticks_to_us(t - t0) / 1000 >= timeout_ms) {
+      Xil_ExceptionDisable();
+      if (fpga_job.state == FPGA_BUSY) {
+        pcap_abort(&DcfgInstance);
+        fpga_finish(FPGA_TIMEOUT);
       }
-    bytes = num * sizeof(int);
-  } else if (strcmp(args[1], "uint") == 0) {
-    if (!arrays[use_id].available) { // if selected is in use
-      freeArray(use_id);
-    }
-    arrays[use_id].size = num;
-    arrays[use_id].available = 0;
-    arrays[use_id].data = (char *)malloc(num * sizeof(unsigned int));
-    arrays[use_id].type = UINT_TYPE;
-    for (i = 0; i < num; i ++)  {
-      inputline(buffer, 256);
-      xil_printf("\n\r");
-      unsigned int val = atoi(buffer);
-      ((unsigned int*)arrays[use_id].data)[i] = val;
-    }
-    bytes = num * sizeof(unsigned int);
-  } else if (strcmp(args[1], "float") == 0) {
-    if (!arrays[use_id].available) { // if selected is in use
-      freeArray(use_id);
-    }
-    arrays[use_id].size = num;
-    arrays[use_id].available = 0;
-    arrays[use_id].data = (char *)malloc(num * sizeof(float));
-    arrays[use_id].type = FLOAT_TYPE;
-    for (i = 0; i < num; i ++) {
-      inputline(buffer,256);
-      xil_printf("\n\r");
-      float val = atof(buffer);
-      ((float*)arrays[use_id].data)[i] = val;
+      Xil_ExceptionEnable();
     }
-    bytes = num * sizeof(float);
-  } else {
-    /*
-     * Unsupported type
-     */
-    //arrays[use_id].available = 1;
-    //arrays[use_id].size = 0;
-    xil_printf("type %s not yet supported\n\r", args[1]);
-    return FAILURE;
   }
-  dsb();
-  //xil_printf("flushing %d bytes at address %x\n\r", bytes, (unsigned int)arrays[use_id].data);
-  xil_printf("flushing cache\n\r");
-  Xil_DCacheFlushRange((unsigned int)arrays[use_id].data, bytes);
-  //Xil_DCacheFlush();
-
-  return SUCCESS;
+  fpga_print_status();
+  return fpga_job.state == FPGA_DONE || fpga_job.state == FPGA_IDLE ?
+    SUCCESS : FAILURE;
 }
 
-int mkArray_cmd(int n, char **args) {
-  int i = 0;
-  int use_id = -1;
-  int num = 0;
+#ifdef USE_SD
 
-  if (n < 3 || n > 4) {
+/* Program the FPGA from a file without loading all of it first. The
+   file is read in PCAP_CHUNK_SIZE chunks into two buffers in turn:
+   while the PCAP DMA takes one buffer, the next chunk is read from the
+   card into the other. */
+int programFPGAFile_cmd(int n, char **args) {
+
+  char path[MAX_PATH];
+  FIL fp;
+  FRESULT r;
+  struct arena_block *buf[2];
+  u32 size, off = 0, len, rd;
+  int cur = 0, busy = 0, status = XST_SUCCESS, ok = SUCCESS;
+  XTime t0, t1, t_sd = 0, t_wait = 0, t;
+  char rate[16];
+
+  if (n != 2) {
     xil_printf(
-            "Wrong number of arguments!\n\rUsage: mkArray <type> <num_elements> [ID]\n\r");
-        return FAILURE;
+        "Wrong number of arguments!\n\rUsage:  programFPGAFile <filename>\n\r");
+    return FAILURE;
   }
 
-  num = atoi(args[2]);
+  if (fpga_busy()) return FAILURE;
 
-  if (n == 4) {
-    use_id = atoi(args[3]);
-
-    if (use_id < 0 || use_id > MAX_ALLOCATED_ARRAYS) {
-      xil_printf("Incorrect array id!\n\r");
-      return FAILURE;
-    }
-    /* free the array */
-    freeArray(use_id);
+  strncpy(path,pwd,MAX_PATH);
+  strncat(path,args[1],MAX_PATH - strlen(path));
 
-  } else { /* find free array slot */
-    for (i = 0; i < MAX_ALLOCATED_ARRAYS; i++) {
-      if (arrays[i].available) {
-        use_id = i;
-        break;
-      }
-    }
+  r = f_open(&fp, path, FA_READ);
+  if (r != FR_OK) {
+    xil_printf("Error opening file: %d\n\r", r);
+    return FAILURE;
+  }
+  size = file_size(&fp);
+  if (size == 0 || size % 4) {
+    xil_printf("%s is not a bitstream (%u bytes)\n\r", path, size);
+    f_close(&fp);
+    return FAILURE;
   }
-  if (use_id == -1) {
-    xil_printf("No available array slot\n\r");
+
+  buf[0] = arena_alloc(MEM_DDR, PCAP_CHUNK_SIZE, ARENA_ALIGN);
+  buf[1] = arena_alloc(MEM_DDR, PCAP_CHUNK_SIZE, ARENA_ALIGN);
+  if (!buf[0] || !buf[1] || !init_dcfg()) {
+    if (!buf[0] || !buf[1]) xil_printf("No memory for PCAP buffers\n\r");
+    if (buf[0]) arena_free(buf[0]);
+    if (buf[1]) arena_free(buf[1]);
+    f_close(&fp);
     return FAILURE;
   }
 
-  if (strcmp(args[1], "int") == 0) {
-    if (!arrays[use_id].available) { // if selected is in use
-      freeArray(use_id);
+  XDcfg_IntrClear(&DcfgInstance, XDCFG_IXR_PCFG_DONE_MASK);
+  active_valid = 0;
+  XTime_GetTime(&t0);
+
+  len = size > PCAP_CHUNK_SIZE ? PCAP_CHUNK_SIZE : size;
+  while (off < size) {
+    /* Chunk off..off+len goes into buf[cur] while the PCAP is busy
+       with the previous one */
+    XTime_GetTime(&t);
+    r = f_read(&fp, (void *)buf[cur]->addr, len, &rd);
+    XTime_GetTime(&t1);
+    t_sd += t1 - t;
+    if (r != FR_OK || rd != len) {
+      xil_printf("\n\rRead error %d at byte %u\n\r", r, off);
+      ok = FAILURE;
+      break;
     }
-    arrays[use_id].size = num;
-    arrays[use_id].available = 0;
-    arrays[use_id].data = (char *) malloc(num * sizeof(int));
-    memset(arrays[use_id].data,0,num * sizeof(int));
-    arrays[use_id].type = INT_TYPE;
-  } else if (strcmp(args[1], "uint") == 0) {
-    if (!arrays[use_id].available) { // if selected is in use
-      freeArray(use_id);
+    Xil_DCacheFlushRange(buf[cur]->addr, len);
+
+    if (busy) {
+      status = pcap_wait(&DcfgInstance, PCAP_TIMEOUT_US(PCAP_CHUNK_SIZE));
+      XTime_GetTime(&t);
+      t_wait += t - t1;
+      if (status != XST_SUCCESS) {
+        busy = 0;
+        break;
+      }
     }
-    arrays[use_id].size = num;
-    arrays[use_id].available = 0;
-    arrays[use_id].data = (char *) malloc(num * sizeof(unsigned int));
-    memset(arrays[use_id].data,0,num * sizeof(unsigned int));
-    arrays[use_id].type = UINT_TYPE;
-  } else if (strcmp(args[1], "float") == 0) {
-    if (!arrays[use_id].available) { // if selected is in use
-      freeArray(use_id);
+    status = pcap_start(&DcfgInstance, buf[cur]->addr, len >> 2,
+                        off + len == size);
+    if (status != XST_SUCCESS) {
+      busy = 0;
+      break;
     }
-    arrays[use_id].size = num;
-    arrays[use_id].available = 0;
-    arrays[use_id].data = (char *) malloc(num * sizeof(float));
-    memset(arrays[use_id].data,0,num * sizeof(float));
-    arrays[use_id].type = FLOAT_TYPE;
-  } else {
-    /*
-     * Unsupported type
-     */
-    xil_printf("type %s not yet supported\n\r", args[1]);
+    busy = 1;
+    off += len;
+    cur ^= 1;
+    len = size - off > PCAP_CHUNK_SIZE ? PCAP_CHUNK_SIZE : size - off;
+  }
+  if (busy) {
+    XTime_GetTime(&t);
+    status = pcap_wait(&DcfgInstance, PCAP_TIMEOUT_US(PCAP_CHUNK_SIZE));
+    XTime_GetTime(&t1);
+    t_wait += t1 - t;
+  }
+  XTime_GetTime(&t1);
+  f_close(&fp);
+  arena_free(buf[0]);
+  arena_free(buf[1]);
+  cmd_bytes += off;
+
+  if (status != XST_SUCCESS) {
+    xil_printf("Failed to program FPGA\n\r");
+    return FAILURE;
+  }
+  if (!ok) return FAILURE;
+  if (!pcfg_done_wait(&DcfgInstance)) {
+    xil_printf("Bitstream sent, but the FPGA did not signal DONE\n\r");
     return FAILURE;
   }
-  return SUCCESS;
-}
 
-int cf_cmd(int n, char **args) {
-  Xil_DCacheFlush();
+  rate_str(rate, sizeof(rate), size, t1 - t0);
+  xil_printf("Programmed %u bytes in %u us (%s MB/s), SD %u us, waiting for PCAP %u us\n\r",
+             size, ticks_to_us(t1 - t0), rate, ticks_to_us(t_sd),
+             ticks_to_us(t_wait));
   return SUCCESS;
 }
 
-int ci_cmd(int n, char **args) {
-  Xil_DCacheInvalidate();
-  return SUCCESS;
-}
+#endif
 
 /* ************************************************************
- * FatFS, Files, Directories
+ * PS DMA
+ *
+ * copyArray moves array data with the PS DMA controller (PL330)
+ * instead of the CPU. A copy is a list of segments of the source,
+ * gathered back to back into the destination. The driver takes one
+ * buffer descriptor per command, so the segments are sent as a chain
+ * of commands started from the done interrupt, each at most
+ * DMA_CHUNK bytes, with the widest burst that the addresses and
+ * length allow. Like background programming, a job runs while the
+ * shell takes other commands; dmaWait waits for it and both arrays
+ * are pinned until it is over.
+ *
+ * The DMA reads and writes memory past the caches: the source is
+ * flushed before the copy and the destination is handed to the PL
+ * (see "Array cache coherency"), so the CPU invalidates it before it
+ * next reads it.
  * ********************************************************* */
-#ifdef USE_SD
-
-FRESULT ls(char* path){
-  FRESULT res;
-  DIR dir;
-  static FILINFO fno;
 
-  res = f_opendir(&dir, path);
-  if (res == FR_OK) {
-    for (;;) {
-      res = f_readdir(&dir, &fno);
-      if (res != FR_OK || fno.fname[0] == 0) break;
-      xil_printf("%s/%s\n\r", path, fno.fname);
-    }
-    f_closedir(&dir);
-  }
-  return res;
-}
+#define DMA_MAX_SEGMENTS 8
+#define DMA_CHUNK        (1024 * 1024)
+#define DMA_BURST_LEN    16 /* beats per burst */
 
-int ls_cmd(int n, char **args) {
-  FRESULT res;
-  /* ignores all arguments, if any */
-  res = ls(pwd);
-  if (res != FR_OK) return FAILURE;
+/* A wide margin over the DMA rate, as for the PCAP */
+#define DMA_TIMEOUT_US(bytes) (100000 + (bytes) / 10)
 
-  return SUCCESS;
-}
+#define DMA_IDLE    0
+#define DMA_BUSY    1
+#define DMA_DONE    2
+#define DMA_FAILED  3
+#define DMA_TIMEOUT 4
 
-int load_raw(char *path, int array_id) {
+const char *dma_state_str[] = { "idle", "copying", "done", "failed",
+                                "timed out" };
 
-  FIL fp;
-  int r;
-  int size;
+typedef struct {
+  UINTPTR src;
+  u32 len;
+} dma_segment;
 
-  r = f_open(&fp, path, FA_READ);
-  if ( r != FR_OK) {
-    xil_printf("Error opening file\n\r");
-    return FAILURE;
-  } else {
+typedef struct {
+  volatile int state;
+  dma_segment seg[DMA_MAX_SEGMENTS];
+  int num_segs;
+  UINTPTR dst;
+  int cur;            /* segment in flight */
+  u32 seg_off;        /* bytes of it sent before this command */
+  u32 chunk;          /* bytes of the command in flight */
+  u32 total;          /* bytes */
+  volatile u32 done;  /* bytes copied */
+  array *src_a;       /* pinned while busy */
+  array *dst_a;
+  volatile u32 cmds;  /* DMA commands completed */
+  u32 timeout_us;
+  XTime start;
+  XTime end;
+} dma_job_t;
+
+dma_job_t dma_job;
+XDmaPs_Cmd dma_cmd;
+int dma_irq_ok = 0;
+
+/* Start the next command of the job */
+int dma_send_next() {
+  dma_segment *s = &dma_job.seg[dma_job.cur];
+  UINTPTR src = s->src + dma_job.seg_off;
+  UINTPTR dst = dma_job.dst + dma_job.done;
+  u32 len = s->len - dma_job.seg_off;
+  u32 size = 8;
+
+  if (len > DMA_CHUNK) len = DMA_CHUNK;
+  /* Bursts of size bytes need size aligned addresses and length.
+     An odd tail goes in a command of its own. */
+  while ((src | dst) & (size - 1)) size >>= 1;
+  if (len >= size) len &= ~(size - 1);
+  else while (len & (size - 1)) size >>= 1;
+
+  memset(&dma_cmd, 0, sizeof(dma_cmd));
+  dma_cmd.ChanCtrl.SrcBurstSize = size;
+  dma_cmd.ChanCtrl.SrcBurstLen = DMA_BURST_LEN;
+  dma_cmd.ChanCtrl.SrcInc = 1;
+  dma_cmd.ChanCtrl.DstBurstSize = size;
+  dma_cmd.ChanCtrl.DstBurstLen = DMA_BURST_LEN;
+  dma_cmd.ChanCtrl.DstInc = 1;
+  dma_cmd.BD.SrcAddr = (u32)src;
+  dma_cmd.BD.DstAddr = (u32)dst;
+  dma_cmd.BD.Length = len;
+  dma_job.chunk = len;
+  return XDmaPs_Start(&DmaInstance, DMA_CHANNEL, &dma_cmd, 0) == XST_SUCCESS;
+}
 
-    size = file_size(&fp);
+/* End the job. Runs in the IRQ handler, or with interrupts off. */
+void dma_finish(int state) {
+  array *a[2] = { dma_job.src_a, dma_job.dst_a };
+  int i;
 
-    /* check if array is free or used */
-    if (!arrays[array_id].available) {
-      free(arrays[array_id].data);
-    }
+  XTime_GetTime(&dma_job.end);
+  for (i = 0; i < 2; i++) {
+    if (!a[i]) continue;
+    a[i]->pinned--;
+    if (a[i]->base) a[i]->base->pinned--;
+  }
+  dma_job.state = state;
+}
 
-    /* allocate storage for data from file */
-    if ((arrays[array_id].data = (char*)malloc(size))) {
-      arrays[array_id].available = 0;
-      arrays[array_id].type = BYTE_TYPE;
-      arrays[array_id].size = size;
-    } else {
-      xil_printf("Error allocating memory for file contents\n\r");
-      return FAILURE;
-    }
+void dma_done(unsigned int channel, XDmaPs_Cmd *cmd, void *ref) {
+  dma_job.cmds++;
+  if (dma_job.state != DMA_BUSY) return;
 
-    unsigned int rd = 0;
-    f_read(&fp, arrays[array_id].data, size, &rd);
-    f_close(&fp);
+  dma_job.done += dma_job.chunk;
+  dma_job.seg_off += dma_job.chunk;
+  if (dma_job.seg_off == dma_job.seg[dma_job.cur].len) {
+    dma_job.cur++;
+    dma_job.seg_off = 0;
   }
-
-  return SUCCESS;
+  if (dma_job.done == dma_job.total)
+    dma_finish(DMA_DONE);
+  else if (!dma_send_next())
+    dma_finish(DMA_FAILED);
 }
 
-int sd_load_raw_cmd(int n, char **args) {
-
-  int array_id = 0;
-  char path[MAX_PATH];
+void dma_fault(unsigned int channel, XDmaPs_Cmd *cmd, void *ref) {
+  if (dma_job.state == DMA_BUSY) dma_finish(DMA_FAILED);
+}
 
-  if (n < 3 || n > 3) {
-    xil_printf(
-        "Wrong number of arguments!\n\rUsage:  sdLoad <filename> <Array ID>\n\r");
-    return FAILURE;
-  }
+/* Stop the job, if it still runs. The caller has interrupts off. */
+void dma_abort(int state) {
+  if (dma_job.state != DMA_BUSY) return;
+  XDmaPs_ResetChannel(&DmaInstance, DMA_CHANNEL);
+  dma_finish(state);
+}
 
-  array_id = atoi(args[2]);
+/* Stop a job that has used up its time */
+void dma_check() {
+  XTime t;
 
-  strncpy(path,pwd,MAX_PATH);
-  strncat(path,args[1],MAX_PATH - strlen(path));
+  if (dma_job.state != DMA_BUSY) return;
+  XTime_GetTime(&t);
+  if (ticks_to_us(t - dma_job.start) <= dma_job.timeout_us) return;
 
-  xil_printf("Loading file: %s\n\r", path);
-  load_raw(path,array_id);
-  return SUCCESS;
+  Xil_ExceptionDisable();
+  dma_abort(DMA_TIMEOUT);
+  Xil_ExceptionEnable();
 }
 
+void dma_print_status() {
+  XTime t = dma_job.end;
+  char rate[16];
 
-int store_raw(char *path, int array_id) {
-
-  FIL fp;
-  int r;
-  int size;
+  if (dma_job.state == DMA_BUSY) XTime_GetTime(&t);
+  t -= dma_job.start;
 
-  if(arrays[array_id].available) {
-    xil_printf("Error: input array is not in use\n\r");
-    return FAILURE;
+  xil_printf("DMA: %s", dma_state_str[dma_job.state]);
+  switch (dma_job.state) {
+  case DMA_IDLE:
+    break;
+  case DMA_BUSY:
+    xil_printf(", %u of %u bytes (%u%%), %u us", dma_job.done, dma_job.total,
+               (u32)((u64)dma_job.done * 100 / dma_job.total), ticks_to_us(t));
+    break;
+  case DMA_DONE:
+    rate_str(rate, sizeof(rate), dma_job.total, t);
+    xil_printf(", %u bytes in %u us (%s MB/s)", dma_job.total,
+               ticks_to_us(t), rate);
+    break;
+  default: /* DMA_FAILED, DMA_TIMEOUT */
+    xil_printf(" at byte %u of %u after %u us", dma_job.done, dma_job.total,
+               ticks_to_us(t));
+    break;
   }
+  if (dma_job.state != DMA_IDLE)
+    xil_printf(", %u commands", dma_job.cmds);
+  xil_printf("\n\r");
+}
 
-  size = arrays[array_id].size * (type_size[arrays[array_id].type]);
+/* Set up the DMA driver on first use */
+int init_dma() {
+  static int dma_ready = 0;
+  XDmaPs_Config *ConfigPtr;
 
-  r = f_open(&fp, path, FA_WRITE | FA_CREATE_NEW);
-  if ( r != FR_OK) {
-    xil_printf("Error: %d\n\r", r);
-    return FAILURE;
-  } else {
+  if (dma_ready) return SUCCESS;
 
-    unsigned int wrt = 0;
-    f_write(&fp, arrays[array_id].data, size, &wrt);
-    f_close(&fp);
-    printf("%d Bytes written to file\n\r",wrt);
+  ConfigPtr = XDmaPs_LookupConfig(DMA_DEVICE_ID);
+  if (!ConfigPtr ||
+      XDmaPs_CfgInitialize(&DmaInstance, ConfigPtr,
+                           ConfigPtr->BaseAddress) != XST_SUCCESS) {
+    xil_printf("Failed to initialize DMA driver\n\r");
+    return FAILURE;
+  }
+  XDmaPs_SetDoneHandler(&DmaInstance, DMA_CHANNEL, dma_done, NULL);
+  XDmaPs_SetFaultHandler(&DmaInstance, dma_fault, NULL);
+  if (intc_ok &&
+      XScuGic_Connect(&IntcInstance, DMA_FAULT_IRQ_ID,
+                      (Xil_InterruptHandler)XDmaPs_FaultISR,
+                      &DmaInstance) == XST_SUCCESS &&
+      XScuGic_Connect(&IntcInstance, DMA_DONE_IRQ_ID,
+                      (Xil_InterruptHandler)XDmaPs_DoneISR_0,
+                      &DmaInstance) == XST_SUCCESS) {
+    XScuGic_Enable(&IntcInstance, DMA_FAULT_IRQ_ID);
+    XScuGic_Enable(&IntcInstance, DMA_DONE_IRQ_ID);
+    dma_irq_ok = 1;
   }
+  dma_ready = 1;
   return SUCCESS;
 }
 
-/* sdStore <filename> <array_id>*/
-int sd_store_raw_cmd(int n, char **args) {
-
-  int array_id = 0;
-  char path[MAX_PATH];
-
-  if (n < 3 || n > 3) {
-    xil_printf(
-        "Wrong number of arguments!\n\rUsage:  sdStore <filename> <Array ID>\n\r");
+/* copyArray <dst> <src> [<offset> <count> ...] [&]
+   Copy src, or the pieces of it given by offset and count (in
+   elements), one after the other into dst. dst is made (like src) if
+   it does not exist or does not have the type and room for them. */
+int copyArray_cmd(int n, char **args) {
+  array *src, *dst;
+  dma_segment seg[DMA_MAX_SEGMENTS];
+  int bg = 0, esize, i, num_segs = 0;
+  u32 off, count, elems = 0, total;
+  XTime t0, t1;
+  char rate[16];
+
+  if (n > 2 && strcmp(args[n - 1], "&") == 0) {
+    bg = 1;
+    n--;
+  }
+  if (n < 3 || n % 2 == 0 || (n - 3) / 2 > DMA_MAX_SEGMENTS) {
+    xil_printf("Wrong number of arguments!\n\rUsage: copyArray <dst> <src> [<offset> <count> ...] [&]\n\r");
+    return FAILURE;
+  }
+  dma_check();
+  if (dma_job.state == DMA_BUSY) {
+    xil_printf("A copy is in progress (see dmaWait)\n\r");
     return FAILURE;
   }
+  src = argArray(args[2]);
+  if (!src) return FAILURE;
+  esize = types[src->type].size;
+
+  if (n == 3) {
+    seg[0].src = (UINTPTR)src->data;
+    seg[0].len = arrayBytes(src);
+    num_segs = 1;
+    elems = src->size;
+  }
+  for (i = 3; i < n; i += 2) {
+    if (!parse_arg(args[i], UINT_TYPE, &off) ||
+        !parse_arg(args[i + 1], UINT_TYPE, &count) ||
+        count < 1 || off > (u32)src->size || count > src->size - off ||
+        elems + count > 0x7FFFFFFF / esize) {
+      xil_printf("Range out of bounds (array has %d elements)\n\r", src->size);
+      return FAILURE;
+    }
+    seg[num_segs].src = (UINTPTR)src->data + off * esize;
+    seg[num_segs].len = count * esize;
+    num_segs++;
+    elems += count;
+  }
+  total = elems * esize;
 
-  array_id = atoi(args[2]);
-  if (array_id < 0 || array_id > MAX_ALLOCATED_ARRAYS) {
-    xil_printf("Error: Faulty array ID\n\r");
+  dst = getArray(args[1]);
+  if (dst == src) {
+    xil_printf("Cannot copy an array onto itself\n\r");
+    return FAILURE;
+  }
+  if (!dst || dst->type != src->type || (u32)dst->size < elems) {
+    dst = allocArray(args[1], src->type, elems, array_arena(src), ARENA_ALIGN);
+    if (!dst) return FAILURE;
+  } else if (array_pinned(dst)) {
+    xil_printf("Array %s is in use by a transfer\n\r", args[1]);
     return FAILURE;
   }
+  for (i = 0; i < num_segs; i++) {
+    if (seg[i].src < (UINTPTR)dst->data + total &&
+        (UINTPTR)dst->data < seg[i].src + seg[i].len) {
+      xil_printf("Source and destination overlap\n\r");
+      return FAILURE;
+    }
+  }
 
-  strncpy(path,pwd,MAX_PATH);
-  strncat(path,args[1],MAX_PATH - strlen(path));
+  if (!init_dma()) return FAILURE;
+  if (!dma_irq_ok) {
+    if (bg) {
+      xil_printf("No DMA interrupt, cannot copy in the background\n\r");
+      return FAILURE;
+    }
+    /* The commands are chained from the interrupt, so without it
+       the CPU has to do the copy */
+    xil_printf("No DMA interrupt, copying with the CPU\n\r");
+    array_cpu_read(src, 0, arrayBytes(src));
+    array_cpu_write(dst, 0, total);
+    XTime_GetTime(&t0);
+    for (i = 0, off = 0; i < num_segs; off += seg[i].len, i++)
+      memcpy(dst->data + off, (void *)seg[i].src, seg[i].len);
+    XTime_GetTime(&t1);
+    rate_str(rate, sizeof(rate), total, t1 - t0);
+    xil_printf("Copied %u bytes in %u us (%s MB/s)\n\r", total,
+               ticks_to_us(t1 - t0), rate);
+    cmd_bytes += total;
+    return SUCCESS;
+  }
 
-  xil_printf("Storing to file: %s\n\r", path);
+  array_flush(src);
+  array_to_pl(dst);
+  memset(&dma_job, 0, sizeof(dma_job));
+  memcpy(dma_job.seg, seg, sizeof(seg));
+  dma_job.num_segs = num_segs;
+  dma_job.dst = (UINTPTR)dst->data;
+  dma_job.total = total;
+  dma_job.src_a = src;
+  dma_job.dst_a = dst;
+  dma_job.timeout_us = DMA_TIMEOUT_US(dma_job.total);
+  for (i = 0; i < 2; i++) {
+    array *a = i ? dst : src;
+    a->pinned++;
+    if (a->base) a->base->pinned++;
+  }
 
-  store_raw(path,array_id);
+  /* The first interrupt must not come before the job is set up */
+  Xil_ExceptionDisable();
+  XTime_GetTime(&dma_job.start);
+  dma_job.state = DMA_BUSY;
+  if (!dma_send_next()) dma_finish(DMA_FAILED);
+  Xil_ExceptionEnable();
 
-  return SUCCESS;
+  if (dma_job.state == DMA_FAILED) {
+    xil_printf("Failed to start DMA\n\r");
+    return FAILURE;
+  }
+  cmd_bytes += dma_job.total;
+  if (bg) {
+    xil_printf("Copying %u bytes in the background\n\r", dma_job.total);
+    return SUCCESS;
+  }
+  while (dma_job.state == DMA_BUSY) dma_check();
+  dma_print_status();
+  return dma_job.state == DMA_DONE ? SUCCESS : FAILURE;
+}
+
+/* dmaWait [timeout_ms]
+   Wait for a background copy to end. A copy still running at the
+   timeout is stopped. */
+int dmaWait_cmd(int n, char **args) {
+  u32 timeout_ms = 0;
+  XTime t0, t;
+
+  if (!wait_args(n, args, &timeout_ms)) return FAILURE;
+
+  XTime_GetTime(&t0);
+  while (dma_job.state == DMA_BUSY) {
+    dma_check();
+    XTime_GetTime(&t);
+    if (n == 2 && ticks_to_us(t - t0) / 1000 >= timeout_ms) {
+      Xil_ExceptionDisable();
+      dma_abort(DMA_TIMEOUT);
+      Xil_ExceptionEnable();
+    }
+  }
+  dma_print_status();
+  return dma_job.state == DMA_DONE || dma_job.state == DMA_IDLE ?
+    SUCCESS : FAILURE;
 }
 
-#endif
 
 /* ************************************************************
- * PROGRAM FPGA WITH BITSTREAM
+ * Accelerator commands
  * ********************************************************* */
-int program_bitstream(XDcfg *Instance, u32 StartAddress, u32 WordLength)
-{
-  int Status;
-  volatile u32 IntrStsReg = 0;
 
-  // Clear DMA and PCAP Done Interrupts
-  XDcfg_IntrClear(Instance, (XDCFG_IXR_DMA_DONE_MASK | XDCFG_IXR_D_P_DONE_MASK));
+/* accel <name> <base> [arg_offset ...] [-ctrl <offset>]
+         [-bits <start> <done> <idle>] [-irq <id>] [-mhz <clock>]
+   Describe (or redescribe) an accelerator. Addresses and offsets are
+   hex. */
+int accel_cmd(int n, char **args) {
+  accel d, *x;
+  u32 v[3];
+  int i, j, k, take;
+
+  memset(&d, 0, sizeof(accel));
+  d.start = 0x1;
+  d.done = 0x2;
+  d.idle = 0x4;
+  d.irq = -1;
+  d.mhz = 100;
+
+  /* Options first, like memOptions */
+  i = 1;
+  while (i < n) {
+    take = 0;
+    if (strcmp(args[i], "-ctrl") == 0 && i + 1 < n) {
+      if (!parse_address(args[i + 1], &d.ctrl)) goto bad;
+      take = 2;
+    } else if (strcmp(args[i], "-irq") == 0 && i + 1 < n) {
+      if (!parse_arg(args[i + 1], UINT_TYPE, &v[0])) goto bad;
+      d.irq = v[0];
+      take = 2;
+    } else if (strcmp(args[i], "-mhz") == 0 && i + 1 < n) {
+      if (!parse_arg(args[i + 1], UINT_TYPE, &d.mhz) || d.mhz == 0) goto bad;
+      take = 2;
+    } else if (strcmp(args[i], "-bits") == 0 && i + 3 < n) {
+      for (k = 0; k < 3; k ++) {
+        if (!parse_arg(args[i + 1 + k], UINT_TYPE, &v[k]) || v[k] > 31)
+          goto bad;
+      }
+      d.start = 1u << v[0];
+      d.done = 1u << v[1];
+      d.idle = 1u << v[2];
+      take = 4;
+    }
+    if (!take) {
+      i++;
+      continue;
+    }
+    for (j = i; j + take < n; j++) args[j] = args[j + take];
+    n -= take;
+  }
 
-  // Transfer bitstream from DDR into fabric in non secure mode
-  Status = XDcfg_Transfer(Instance, (u32 *) StartAddress, WordLength, (u32 *) XDCFG_DMA_INVALID_ADDRESS, 0, XDCFG_NON_SECURE_PCAP_WRITE);
-  if (Status != XST_SUCCESS)
-    return Status;
+  if (n < 3 || n - 3 > MAX_ACCEL_ARGS) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  accel <name> <base> [arg_offset ...] [options]\n\r");
+    return FAILURE;
+  }
+  if (strlen(args[1]) >= MAX_ARRAY_NAME) {
+    xil_printf("Name too long\n\r");
+    return FAILURE;
+  }
+  if (!parse_address(args[2], &v[0]) || v[0] & 3) goto bad;
+  /* Its section is mapped as device memory, which is only right for
+     the PL windows (AXI GP0 and GP1) */
+  if (v[0] < 0x40000000 || v[0] >= 0xC0000000) {
+    xil_printf("Bad argument %s: not in the PL (40000000 to bfffffff)\n\r",
+               args[2]);
+    return FAILURE;
+  }
+  d.base = v[0];
+  for (i = 3; i < n; i ++) {
+    if (!parse_address(args[i], &d.arg_off[i - 3]) || d.arg_off[i - 3] & 3)
+      goto bad;
+  }
+  d.num_args = n - 3;
+  if (d.irq >= 0 && !intc_ok) {
+    xil_printf("No interrupt controller, %s will be polled\n\r", args[1]);
+    d.irq = -1;
+  }
 
-  // Poll DMA Done Interrupt
-  while ((IntrStsReg & XDCFG_IXR_DMA_DONE_MASK) != XDCFG_IXR_DMA_DONE_MASK)
-    IntrStsReg = XDcfg_IntrGetStatus(Instance);
+  x = accelByName(args[1]);
+  if (x) {
+    accel_release(x);
+  } else {
+    for (i = 0; i < MAX_ACCELS && accels[i].name[0]; i ++);
+    if (i == MAX_ACCELS) {
+      xil_printf("Too many accelerators (%d)\n\r", MAX_ACCELS);
+      return FAILURE;
+    }
+    x = &accels[i];
+  }
+  *x = d;
+  strcpy(x->name, args[1]);
 
-  // Poll PCAP Done Interrupt
-  while ((IntrStsReg & XDCFG_IXR_D_P_DONE_MASK) != XDCFG_IXR_D_P_DONE_MASK)
-    IntrStsReg = XDcfg_IntrGetStatus(Instance);
+  /* Registers must not be cached or reordered */
+  Xil_SetTlbAttributes(x->base & ~0xFFFFF, DEVICE_MEMORY);
 
-  return XST_SUCCESS;
-}
+  if (x->irq >= 0) {
+    XScuGic_Connect(&IntcInstance, x->irq,
+                    (Xil_InterruptHandler)accel_isr, x);
+    XScuGic_Enable(&IntcInstance, x->irq);
+  }
+  return SUCCESS;
 
-int programFPGA_cmd(int n, char **args) {
+ bad:
+  xil_printf("Bad argument %s\n\r", parse_token);
+  return FAILURE;
+}
 
-  int array_id;
-  XDcfg_Config *ConfigPtr;
-  int status;
+/* rmAccel <name> */
+int rmAccel_cmd(int n, char **args) {
+  accel *x;
 
-  if (n < 2 || n > 2) {
-    xil_printf(
-        "Wrong number of arguments!\n\rUsage:  programFPGA <Array ID>\n\r");
+  if (n != 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  rmAccel <name>\n\r");
+    return FAILURE;
+  }
+  x = accelByName(args[1]);
+  if (!x) {
+    xil_printf("No accelerator %s\n\r", args[1]);
     return FAILURE;
   }
+  accel_release(x);
+  return SUCCESS;
+}
 
-  array_id = atoi(args[1]);
+/* Value for an argument register: @array gives its address, anything
+   else is a scalar (an integer, or a float if it has a point) */
+int accel_arg(const char *str, u32 *val) {
+  array *a;
 
-  if (array_id < 0 || array_id >= MAX_ALLOCATED_ARRAYS) {
-    xil_printf("Incorrect Array ID\n\r");
-    return FAILURE;
+  if (str[0] == '@') {
+    a = argArray(str + 1);
+    if (!a) return FAILURE;
+    *val = (u32)(UINTPTR)a->data;
+    return SUCCESS;
   }
+  if (strchr(str, '.') && !strchr(str, 'x'))
+    return parse_arg(str, FLOAT_TYPE, val);
+  if (str[0] == '-')
+    return parse_arg(str, INT_TYPE, val);
+  return parse_arg(str, UINT_TYPE, val);
+}
 
-  if (arrays[array_id].available) {
-    xil_printf("Array is empty\n\r");
+/* run <accel> [arg ...] [-timeout <ms>] */
+int run_cmd(int n, char **args) {
+  accel *x;
+  u32 val[MAX_ACCEL_ARGS];
+  u32 timeout_ms = ACCEL_TIMEOUT_MS;
+  UINTPTR ctrl;
+  XTime t0, t1, t;
+  int i, finished = 0;
+
+  if (n >= 4 && strcmp(args[n - 2], "-timeout") == 0) {
+    if (!parse_arg(args[n - 1], UINT_TYPE, &timeout_ms)) {
+      xil_printf("Bad timeout %s\n\r", args[n - 1]);
+      return FAILURE;
+    }
+    n -= 2;
+  }
+  if (n < 2) {
+    xil_printf("Wrong number of arguments!\n\rUsage:  run <accel> [arg ...] [-timeout <ms>]\n\r");
+    return FAILURE;
+  }
+  x = accelByName(args[1]);
+  if (!x) {
+    xil_printf("No accelerator %s\n\r", args[1]);
+    return FAILURE;
+  }
+  if (n - 2 != x->num_args) {
+    xil_printf("%s takes %d arguments\n\r", x->name, x->num_args);
     return FAILURE;
   }
 
-  /* Maybe can be moved to some, run once, init procedure */
-  ConfigPtr = XDcfg_LookupConfig(DCFG_DEVICE_ID);
+  for (i = 0; i < x->num_args; i ++) {
+    if (!accel_arg(args[i + 2], &val[i])) {
+      if (args[i + 2][0] != '@')
+        xil_printf("Bad argument %s: %s\n\r", parse_token, parse_msg);
+      return FAILURE;
+    }
+  }
 
-  status = XDcfg_CfgInitialize(&DcfgInstance, ConfigPtr,
-            ConfigPtr->BaseAddr);
-  if (status != XST_SUCCESS) {
-    xil_printf("Failed to initialize DevCFG driver\n\r");
+  ctrl = x->base + x->ctrl;
+  if (!(Xil_In32(ctrl) & x->idle)) {
+    xil_printf("Accelerator %s is busy\n\r", x->name);
     return FAILURE;
   }
-  status = XDcfg_SelfTest(&DcfgInstance);
-  if (status != XST_SUCCESS) {
-    xil_printf("Failed DevCFG self test\n\r");
-    return FAILURE;
+
+  /* The kernel may read and write any array it is given. Their size
+     is what run counts as bytes moved. */
+  for (i = 0; i < x->num_args; i ++) {
+    if (args[i + 2][0] == '@') {
+      array *a = getArray(args[i + 2] + 1);
+      array_to_pl(a);
+      cmd_bytes += arrayBytes(a);
+    }
+    Xil_Out32(x->base + x->arg_off[i], val[i]);
   }
 
-  status = program_bitstream(&DcfgInstance,
-                             (u32)arrays[array_id].data,
-                             arrays[array_id].size >> 2);
+  if (x->irq >= 0) {
+    x->irq_seen = 0;
+    Xil_Out32(ctrl + ACCEL_IER, 1);
+    Xil_Out32(ctrl + ACCEL_GIE, 1);
+  }
 
-  if (status != XST_SUCCESS) {
-    xil_printf("Failed to program FPGA\n\r");
+  dsb();
+  XTime_GetTime(&t0);
+  Xil_Out32(ctrl, x->start);
+  do {
+    XTime_GetTime(&t);
+    if (x->irq >= 0 ? x->irq_seen : (Xil_In32(ctrl) & x->done)) {
+      finished = 1;
+      break;
+    }
+  } while (ticks_to_us(t - t0) / 1000 < timeout_ms);
+  t1 = x->irq >= 0 ? x->irq_time : t;
+
+  if (x->irq >= 0) {
+    Xil_Out32(ctrl + ACCEL_GIE, 0);
+    Xil_Out32(ctrl + ACCEL_IER, 0);
+  }
+  if (!finished) {
+    xil_printf("%s did not finish within %u ms\n\r", x->name, timeout_ms);
     return FAILURE;
   }
-  xil_printf("OK!\n\r");
+
+  x->runs++;
+  x->last = t1 - t0;
+  x->total += t1 - t0;
+
+  xil_printf("%s done in %u us, %u cycles at %u MHz\n\r", x->name,
+             ticks_to_us(t1 - t0), ticks_to_cycles(t1 - t0, x->mhz), x->mhz);
   return SUCCESS;
 }
 
-
 /* ************************************************************
  * Command function array
  * ********************************************************* */
@@ -802,14 +7466,44 @@ int (*cmd_func[])(int, char **) = {
   ,&show_cmd
   ,&loadArray_cmd
   ,&mkArray_cmd
+  ,&rmArray_cmd
+  ,&mapArray_cmd
+  ,&sliceArray_cmd
+  ,&loadArrayBin_cmd
+  ,&dumpArray_cmd
+  ,&echo_cmd
+  ,&flow_cmd
+  ,&stats_cmd
+  ,&time_cmd
+  ,&bench_cmd
+  ,&membw_cmd
+  ,&watch_cmd
+  ,&pulseAndWatch_cmd
+  ,&arrayOp_cmd
+  ,&checksum_cmd
   ,&cf_cmd
   ,&ci_cmd
+  ,&set_cmd
 #ifdef USE_SD
   ,&ls_cmd
   ,&sd_load_raw_cmd
   ,&sd_store_raw_cmd
 #endif
   ,&programFPGA_cmd
+  ,&cacheBitstream_cmd
+  ,&useBitstream_cmd
+  ,&rmBitstream_cmd
+  ,&fpgaStatus_cmd
+  ,&fpgaWait_cmd
+  ,&copyArray_cmd
+  ,&dmaWait_cmd
+  ,&accel_cmd
+  ,&rmAccel_cmd
+  ,&run_cmd
+#ifdef USE_SD
+  ,&programFPGAFile_cmd
+  ,&source_cmd
+#endif
 };
 
 
@@ -836,16 +7530,31 @@ int tokenize(char *cmd_str, char ***tokens) {
 }
 
 
+/* Run a command, timing it and counting the bytes it moves. Output
+   is flushed before the clock is stopped so that commands that print
+   a lot are charged for sending it. Nested calls (time) add their
+   bytes to the caller. */
 int dispatch(int num_toks, char **tokens) {
   int i = 0;
   int n_cmds = sizeof(cmds) / sizeof(char *);
+  XTime t0, t1;
+  u32 outer_bytes;
+  int r;
 
   if (!num_toks)
     return 1;
 
   for (i = 0; i < n_cmds; i++) {
     if (strcmp(tokens[0], cmds[i]) == 0) {
-      return (*cmd_func[i])(num_toks, tokens);
+      outer_bytes = cmd_bytes;
+      cmd_bytes = 0;
+      XTime_GetTime(&t0);
+      r = (*cmd_func[i])(num_toks, tokens);
+      uart_flush();
+      XTime_GetTime(&t1);
+      cmd_stats_add(i, t1 - t0, cmd_bytes);
+      cmd_bytes += outer_bytes;
+      return r;
     }
   }
 
@@ -866,7 +7575,7 @@ int inputline(char *buffer, int size) {
       if (n > 0)
         n--;
       buffer[n] = 0;
-      outbyte('\b'); /* output backspace character */
+      if (echo) outbyte('\b'); /* output backspace character */
       n--; /* set up next iteration to deal with preceding char location */
       break;
     case '\n': /* fall through to \r */
@@ -875,7 +7584,7 @@ int inputline(char *buffer, int size) {
       return n;
     default:
       if (isprint(c)) { /* ignore non-printable characters */
-        outbyte(c);
+        if (echo) outbyte(c);
         buffer[n] = c;
       } else {
         n -= 1;
@@ -894,25 +7603,36 @@ int inputline(char *buffer, int size) {
 int main()
 {
   char *cmd_buffer;
+  char *line_buffer;
   size_t  cmd_buffer_size = 512;
   int result;
 
   char **tokens;
   int n = 0;
   int status = 0;
-  int i = 0;
 
   init_platform();
 
-  init_app();
-
   /* Print the welcome text */
   xil_printf("%s", header);
 
   /* Initialisation */
   cmd_buffer = malloc(cmd_buffer_size * sizeof(char));
+  line_buffer = malloc(cmd_buffer_size * sizeof(char));
   tokens = malloc(max_tokens * sizeof(char*));
 
+  crc32_init();
+
+  if (!init_interrupts()) {
+    xil_printf("Error initialising interrupt controller!\n\r");
+  } else {
+#ifdef USE_UART_IRQ
+    if (!init_uart_irq()) {
+      xil_printf("Error setting up UART interrupts, output is polled\n\r");
+    }
+#endif
+  }
+
 #ifdef USE_SD
   /* Initialise file system */
   result = f_mount(&fat_fs,"0:", 0);
@@ -926,21 +7646,27 @@ int main()
 #endif
 
   /* Initialise array storage */
-  for (i = 0; i < MAX_ALLOCATED_ARRAYS; i ++) {
-    arrays[i].available = 1;
-    arrays[i].data = NULL;
-    arrays[i].type = BYTE_TYPE;
-    arrays[i].size = 0;
+  init_arenas();
+
+#ifdef USE_SD
+  if (sd_ok && !source_file(AUTOEXEC_FILE, 0, 0)) {
+    xil_printf("Error in %s!\n\r", AUTOEXEC_FILE);
   }
+#endif
 
   /* The command parsing and executing loop */
   while(running) {
     xil_printf("%s ", prompt);
+    uart_flush();
     inputline(cmd_buffer, cmd_buffer_size);
 
     xil_printf("\n\r");
 
-    n = tokenize(cmd_buffer, &tokens);
+    if (!expand_vars(cmd_buffer, line_buffer, cmd_buffer_size)) {
+      xil_printf("Error executing command!\n\r");
+      continue;
+    }
+    n = tokenize(line_buffer, &tokens);
 
     status = dispatch(n, tokens);
 
@@ -949,8 +7675,10 @@ int main()
     }
   }
 
+  uart_flush();
   freeArrays();
   free(tokens);
+  free(line_buffer);
   free(cmd_buffer);
 
   cleanup_platform();